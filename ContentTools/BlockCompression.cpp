@@ -0,0 +1,572 @@
+#include "BlockCompression.h"
+#include "ThreadPool.h"
+#include <DirectXPackedVector.h>
+#include <cfloat>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace lightning::tools::bc {
+	namespace {
+
+		constexpr u32 block_dim{ 4 };
+		constexpr u32 block_pixels{ block_dim * block_dim };
+		constexpr u32 block_rows_per_job{ 4 };
+		constexpr u32 power_iterations{ 8 };
+		constexpr u32 refine_iterations[Quality::count]{ 0, 2, 4 };
+
+		// Interpolation weights out of 64. BC1 entries are in palette order c0, c1, 1/3, 2/3.
+		constexpr u32 bc1_weights[4]{ 0, 64, 21, 43 };
+		constexpr u32 bc7_weights[16]{ 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		const XMVECTOR rgb_mask{ XMVectorSet(1.f, 1.f, 1.f, 0.f) };
+		const XMVECTOR rgba_mask{ XMVectorSet(1.f, 1.f, 1.f, 1.f) };
+
+		class BitWriter {
+			public:
+				explicit BitWriter(u8* const block) : _block{ block } { memset(block, 0, 16); }
+
+				void write(u32 value, u32 bit_count) {
+					for (u32 i{ 0 }; i < bit_count; ++i, ++_position) {
+						if ((value >> i) & 1) _block[_position >> 3] |= (u8)(1 << (_position & 7));
+					}
+				}
+
+			private:
+				u8* const _block;
+				u32 _position{ 0 };
+		};
+
+		struct BC7Mode6 {
+			u32 endpoints[2][4];
+			u32 p_bits[2];
+			u8 indices[block_pixels];
+			f32 error;
+		};
+
+		struct BC6HMode11 {
+			u32 endpoints[2][3];
+			u8 indices[block_pixels];
+			f32 error;
+		};
+
+		void load_rgba8_block(const SourceImage& image, u32 block_x, u32 block_y, XMVECTOR* const pixels) {
+			for (u32 y{ 0 }; y < block_dim; ++y) {
+				const u32 src_y{ std::min(block_y * block_dim + y, image.height - 1) };
+				const u8* const row{ image.pixels + (u64)src_y * image.row_pitch };
+
+				for (u32 x{ 0 }; x < block_dim; ++x) {
+					const u32 src_x{ std::min(block_x * block_dim + x, image.width - 1) };
+					pixels[y * block_dim + x] = XMLoadUByte4((const XMUBYTE4*)&row[src_x * 4]);
+				}
+			}
+		}
+
+		// BC6H interpolates the bit patterns of unsigned halfs, scaled by 64/31 to undo the final unquantize step.
+		f32 half_to_bc6h(u16 half) {
+			if (half & 0x8000) return 0.f;
+			return (f32)std::min(half, (u16)0x7bff) * (64.f / 31.f);
+		}
+
+		void load_rgba16f_block(const SourceImage& image, u32 block_x, u32 block_y, XMVECTOR* const pixels) {
+			for (u32 y{ 0 }; y < block_dim; ++y) {
+				const u32 src_y{ std::min(block_y * block_dim + y, image.height - 1) };
+				const u8* const row{ image.pixels + (u64)src_y * image.row_pitch };
+
+				for (u32 x{ 0 }; x < block_dim; ++x) {
+					const u32 src_x{ std::min(block_x * block_dim + x, image.width - 1) };
+					const u16* const texel{ (const u16*)&row[src_x * sizeof(u16) * 4] };
+					pixels[y * block_dim + x] = XMVectorSet(half_to_bc6h(texel[0]), half_to_bc6h(texel[1]), half_to_bc6h(texel[2]), 0.f);
+				}
+			}
+		}
+
+		// Endpoints at the extremes of the pixels projected onto their principal axis.
+		void principal_axis_endpoints(const XMVECTOR* const pixels, u32 count, FXMVECTOR mask, XMVECTOR& e0, XMVECTOR& e1) {
+			assert(count);
+			XMVECTOR mean{ XMVectorZero() };
+			XMVECTOR min{ g_XMFltMax };
+			XMVECTOR max{ XMVectorNegate(g_XMFltMax) };
+
+			for (u32 i{ 0 }; i < count; ++i) {
+				const XMVECTOR p{ XMVectorMultiply(pixels[i], mask) };
+				mean = XMVectorAdd(mean, p);
+				min = XMVectorMin(min, p);
+				max = XMVectorMax(max, p);
+			}
+
+			mean = XMVectorScale(mean, 1.f / (f32)count);
+
+			XMVECTOR covariance[4]{ XMVectorZero(), XMVectorZero(), XMVectorZero(), XMVectorZero() };
+
+			for (u32 i{ 0 }; i < count; ++i) {
+				const XMVECTOR d{ XMVectorSubtract(XMVectorMultiply(pixels[i], mask), mean) };
+				covariance[0] = XMVectorMultiplyAdd(d, XMVectorSplatX(d), covariance[0]);
+				covariance[1] = XMVectorMultiplyAdd(d, XMVectorSplatY(d), covariance[1]);
+				covariance[2] = XMVectorMultiplyAdd(d, XMVectorSplatZ(d), covariance[2]);
+				covariance[3] = XMVectorMultiplyAdd(d, XMVectorSplatW(d), covariance[3]);
+			}
+
+			XMVECTOR axis{ XMVectorSubtract(max, min) };
+
+			for (u32 i{ 0 }; i < power_iterations; ++i) {
+				XMVECTOR v{ XMVectorMultiply(covariance[0], XMVectorSplatX(axis)) };
+				v = XMVectorMultiplyAdd(covariance[1], XMVectorSplatY(axis), v);
+				v = XMVectorMultiplyAdd(covariance[2], XMVectorSplatZ(axis), v);
+				v = XMVectorMultiplyAdd(covariance[3], XMVectorSplatW(axis), v);
+				axis = XMVector4Normalize(v);
+			}
+
+			if (XMVector4Equal(axis, XMVectorZero())) {
+				e0 = min;
+				e1 = max;
+				return;
+			}
+
+			f32 min_t{ FLT_MAX };
+			f32 max_t{ -FLT_MAX };
+
+			for (u32 i{ 0 }; i < count; ++i) {
+				const f32 t{ XMVectorGetX(XMVector4Dot(XMVectorSubtract(XMVectorMultiply(pixels[i], mask), mean), axis)) };
+				min_t = std::min(min_t, t);
+				max_t = std::max(max_t, t);
+			}
+
+			e0 = XMVectorMultiplyAdd(axis, XMVectorReplicate(min_t), mean);
+			e1 = XMVectorMultiplyAdd(axis, XMVectorReplicate(max_t), mean);
+		}
+
+		f32 select_indices(const XMVECTOR* const pixels, const u8* const pixel_ids, u32 count, const XMVECTOR* const palette, u32 palette_size, FXMVECTOR mask, u8* const indices) {
+			f32 total_error{ 0.f };
+
+			for (u32 i{ 0 }; i < count; ++i) {
+				const u32 pixel{ pixel_ids ? pixel_ids[i] : i };
+				f32 best_error{ FLT_MAX };
+				u8 best_index{ 0 };
+
+				for (u32 j{ 0 }; j < palette_size; ++j) {
+					const XMVECTOR d{ XMVectorMultiply(XMVectorSubtract(pixels[pixel], palette[j]), mask) };
+					const f32 error{ XMVectorGetX(XMVector4LengthSq(d)) };
+
+					if (error < best_error) {
+						best_error = error;
+						best_index = (u8)j;
+					}
+				}
+
+				indices[pixel] = best_index;
+				total_error += best_error;
+			}
+
+			return total_error;
+		}
+
+		// Least squares endpoints for the given index assignment.
+		bool refine_endpoints(const XMVECTOR* const pixels, const u8* const indices, const u32* const weights, FXMVECTOR mask, XMVECTOR& e0, XMVECTOR& e1) {
+			f32 alpha_sq{ 0.f };
+			f32 beta_sq{ 0.f };
+			f32 alpha_beta{ 0.f };
+			XMVECTOR alpha_x{ XMVectorZero() };
+			XMVECTOR beta_x{ XMVectorZero() };
+
+			for (u32 i{ 0 }; i < block_pixels; ++i) {
+				const f32 beta{ (f32)weights[indices[i]] / 64.f };
+				const f32 alpha{ 1.f - beta };
+				alpha_sq += alpha * alpha;
+				beta_sq += beta * beta;
+				alpha_beta += alpha * beta;
+				alpha_x = XMVectorMultiplyAdd(pixels[i], XMVectorReplicate(alpha), alpha_x);
+				beta_x = XMVectorMultiplyAdd(pixels[i], XMVectorReplicate(beta), beta_x);
+			}
+
+			const f32 determinant{ alpha_sq * beta_sq - alpha_beta * alpha_beta };
+			if (fabsf(determinant) < math::EPSILON) return false;
+
+			const f32 inv_determinant{ 1.f / determinant };
+			e0 = XMVectorMultiply(XMVectorScale(XMVectorSubtract(XMVectorScale(alpha_x, beta_sq), XMVectorScale(beta_x, alpha_beta)), inv_determinant), mask);
+			e1 = XMVectorMultiply(XMVectorScale(XMVectorSubtract(XMVectorScale(beta_x, alpha_sq), XMVectorScale(alpha_x, alpha_beta)), inv_determinant), mask);
+
+			return true;
+		}
+
+		u32 quantize(f32 value, f32 scale, u32 max) {
+			return (u32)math::clamp(value * scale + .5f, 0.f, (f32)max);
+		}
+
+		u16 pack_565(FXMVECTOR color) {
+			XMFLOAT4 c;
+			XMStoreFloat4(&c, color);
+			return (u16)((quantize(c.x, 31.f / 255.f, 31) << 11) | (quantize(c.y, 63.f / 255.f, 63) << 5) | quantize(c.z, 31.f / 255.f, 31));
+		}
+
+		XMVECTOR unpack_565(u16 color) {
+			const u32 r{ (color >> 11) & 31 };
+			const u32 g{ (color >> 5) & 63 };
+			const u32 b{ color & 31 };
+
+			return XMVectorSet((f32)((r << 3) | (r >> 2)), (f32)((g << 2) | (g >> 4)), (f32)((b << 3) | (b >> 2)), 255.f);
+		}
+
+		void bc1_palette(u16 c0, u16 c1, XMVECTOR* const palette) {
+			palette[0] = unpack_565(c0);
+			palette[1] = unpack_565(c1);
+
+			if (c0 > c1) {
+				palette[2] = XMVectorScale(XMVectorAdd(XMVectorScale(palette[0], 2.f), palette[1]), 1.f / 3.f);
+				palette[3] = XMVectorScale(XMVectorAdd(palette[0], XMVectorScale(palette[1], 2.f)), 1.f / 3.f);
+			}
+			else {
+				palette[2] = XMVectorScale(XMVectorAdd(palette[0], palette[1]), .5f);
+				palette[3] = XMVectorZero();
+			}
+		}
+
+		void write_bc1(u8* const block, u16 c0, u16 c1, const u8* const indices) {
+			u32 bits{ 0 };
+			for (u32 i{ 0 }; i < block_pixels; ++i) bits |= (u32)indices[i] << (i * 2);
+
+			memcpy(block, &c0, sizeof(u16));
+			memcpy(block + 2, &c1, sizeof(u16));
+			memcpy(block + 4, &bits, sizeof(u32));
+		}
+
+		// 4 color mode fit, c0 > c1 unless both endpoints quantize to the same color.
+		f32 fit_bc1(const XMVECTOR* const pixels, FXMVECTOR e0, FXMVECTOR e1, u16& c0, u16& c1, u8* const indices) {
+			c0 = pack_565(e0);
+			c1 = pack_565(e1);
+			if (c0 < c1) std::swap(c0, c1);
+
+			if (c0 == c1) {
+				memset(indices, 0, block_pixels);
+				const XMVECTOR color{ unpack_565(c0) };
+				f32 error{ 0.f };
+				for (u32 i{ 0 }; i < block_pixels; ++i) error += XMVectorGetX(XMVector4LengthSq(XMVectorMultiply(XMVectorSubtract(pixels[i], color), rgb_mask)));
+				return error;
+			}
+
+			XMVECTOR palette[4];
+			bc1_palette(c0, c1, palette);
+
+			return select_indices(pixels, nullptr, block_pixels, palette, 4, rgb_mask, indices);
+		}
+
+		void encode_bc1(const XMVECTOR* const pixels, u8* const block, Quality::Level quality, f32 alpha_threshold) {
+			u8 opaque_ids[block_pixels];
+			XMVECTOR opaque[block_pixels];
+			u32 opaque_count{ 0 };
+
+			for (u32 i{ 0 }; i < block_pixels; ++i) {
+				if (XMVectorGetW(pixels[i]) >= alpha_threshold) {
+					opaque_ids[opaque_count] = (u8)i;
+					opaque[opaque_count++] = pixels[i];
+				}
+			}
+
+			u8 indices[block_pixels];
+			XMVECTOR e0, e1;
+
+			if (opaque_count < block_pixels) {
+				// 3 color mode, index 3 is transparent black.
+				memset(indices, 3, block_pixels);
+				u16 c0{ 0 };
+				u16 c1{ 0 };
+
+				if (opaque_count) {
+					principal_axis_endpoints(opaque, opaque_count, rgb_mask, e0, e1);
+					c0 = pack_565(e0);
+					c1 = pack_565(e1);
+					if (c0 > c1) std::swap(c0, c1);
+
+					XMVECTOR palette[4];
+					bc1_palette(c0, c1, palette);
+					select_indices(pixels, opaque_ids, opaque_count, palette, 3, rgb_mask, indices);
+				}
+
+				write_bc1(block, c0, c1, indices);
+				return;
+			}
+
+			principal_axis_endpoints(pixels, block_pixels, rgb_mask, e0, e1);
+
+			u16 c0, c1;
+			f32 error{ fit_bc1(pixels, e0, e1, c0, c1, indices) };
+
+			for (u32 i{ 0 }; i < refine_iterations[quality] && c0 != c1; ++i) {
+				if (!refine_endpoints(pixels, indices, bc1_weights, rgb_mask, e0, e1)) break;
+
+				u16 r0, r1;
+				u8 refined_indices[block_pixels];
+				const f32 refined_error{ fit_bc1(pixels, e0, e1, r0, r1, refined_indices) };
+				if (refined_error >= error) break;
+
+				error = refined_error;
+				c0 = r0;
+				c1 = r1;
+				memcpy(indices, refined_indices, block_pixels);
+			}
+
+			write_bc1(block, c0, c1, indices);
+		}
+
+		f32 fit_bc4(const f32* const values, u32 r0, u32 r1, u64& bits) {
+			f32 palette[8]{ (f32)r0, (f32)r1 };
+			for (u32 i{ 2 }; i < 8; ++i) palette[i] = (f32)((8 - i) * r0 + (i - 1) * r1) / 7.f;
+
+			f32 error{ 0.f };
+			bits = 0;
+
+			for (u32 i{ 0 }; i < block_pixels; ++i) {
+				f32 best_error{ FLT_MAX };
+				u64 best_index{ 0 };
+
+				for (u32 j{ 0 }; j < 8; ++j) {
+					const f32 d{ values[i] - palette[j] };
+					if (d * d < best_error) {
+						best_error = d * d;
+						best_index = j;
+					}
+				}
+
+				bits |= best_index << (i * 3);
+				error += best_error;
+			}
+
+			return error;
+		}
+
+		// 8 value mode. Higher quality levels also try pulling the endpoints inwards.
+		void encode_bc4(const f32* const values, u8* const block, Quality::Level quality) {
+			f32 min{ values[0] };
+			f32 max{ values[0] };
+
+			for (u32 i{ 1 }; i < block_pixels; ++i) {
+				min = std::min(min, values[i]);
+				max = std::max(max, values[i]);
+			}
+
+			const u32 max_r0{ quantize(max, 1.f, 255) };
+			const u32 min_r1{ quantize(min, 1.f, 255) };
+			u32 best_r0{ max_r0 };
+			u32 best_r1{ min_r1 };
+			u64 best_bits{ 0 };
+
+			if (max_r0 != min_r1) {
+				const u32 range{ refine_iterations[quality] };
+				f32 best_error{ FLT_MAX };
+
+				for (u32 i0{ 0 }; i0 <= range; ++i0) {
+					for (u32 i1{ 0 }; i1 <= range; ++i1) {
+						const u32 r0{ max_r0 - std::min(i0, max_r0) };
+						const u32 r1{ min_r1 + i1 };
+						if (r0 <= r1) continue;
+
+						u64 bits;
+						const f32 error{ fit_bc4(values, r0, r1, bits) };
+
+						if (error < best_error) {
+							best_error = error;
+							best_r0 = r0;
+							best_r1 = r1;
+							best_bits = bits;
+						}
+					}
+				}
+			}
+
+			block[0] = (u8)best_r0;
+			block[1] = (u8)best_r1;
+			memcpy(block + 2, &best_bits, 6);
+		}
+
+		void encode_bc4_channel(const XMVECTOR* const pixels, u32 channel, u8* const block, Quality::Level quality) {
+			f32 values[block_pixels];
+			for (u32 i{ 0 }; i < block_pixels; ++i) values[i] = XMVectorGetByIndex(pixels[i], channel);
+
+			encode_bc4(values, block, quality);
+		}
+
+		XMVECTOR interpolate(const u32* const a, const u32* const b, u32 weight, u32 channels) {
+			u32 c[4]{};
+			for (u32 i{ 0 }; i < channels; ++i) c[i] = ((64 - weight) * a[i] + weight * b[i] + 32) >> 6;
+
+			return XMVectorSet((f32)c[0], (f32)c[1], (f32)c[2], (f32)c[3]);
+		}
+
+		// RGBA endpoints with 7 bits per channel plus a shared p-bit per endpoint, 4 bit indices.
+		f32 fit_bc7_mode6(const XMVECTOR* const pixels, FXMVECTOR e0, FXMVECTOR e1, BC7Mode6& result) {
+			XMFLOAT4 ends[2];
+			XMStoreFloat4(&ends[0], e0);
+			XMStoreFloat4(&ends[1], e1);
+			result.error = FLT_MAX;
+
+			for (u32 p0{ 0 }; p0 < 2; ++p0) {
+				for (u32 p1{ 0 }; p1 < 2; ++p1) {
+					BC7Mode6 candidate{};
+					candidate.p_bits[0] = p0;
+					candidate.p_bits[1] = p1;
+					u32 expanded[2][4];
+
+					for (u32 e{ 0 }; e < 2; ++e) {
+						const f32* const channels{ &ends[e].x };
+
+						for (u32 c{ 0 }; c < 4; ++c) {
+							candidate.endpoints[e][c] = quantize((channels[c] - (f32)candidate.p_bits[e]) * .5f, 1.f, 127);
+							expanded[e][c] = (candidate.endpoints[e][c] << 1) | candidate.p_bits[e];
+						}
+					}
+
+					XMVECTOR palette[16];
+					for (u32 i{ 0 }; i < 16; ++i) palette[i] = interpolate(expanded[0], expanded[1], bc7_weights[i], 4);
+
+					candidate.error = select_indices(pixels, nullptr, block_pixels, palette, 16, rgba_mask, candidate.indices);
+					if (candidate.error < result.error) result = candidate;
+				}
+			}
+
+			return result.error;
+		}
+
+		void encode_bc7(const XMVECTOR* const pixels, u8* const block, Quality::Level quality) {
+			XMVECTOR e0, e1;
+			principal_axis_endpoints(pixels, block_pixels, rgba_mask, e0, e1);
+
+			BC7Mode6 best;
+			fit_bc7_mode6(pixels, e0, e1, best);
+
+			for (u32 i{ 0 }; i < refine_iterations[quality]; ++i) {
+				if (!refine_endpoints(pixels, best.indices, bc7_weights, rgba_mask, e0, e1)) break;
+
+				BC7Mode6 refined;
+				if (fit_bc7_mode6(pixels, e0, e1, refined) >= best.error) break;
+				best = refined;
+			}
+
+			// The anchor index has an implicit 0 MSB.
+			if (best.indices[0] & 8) {
+				std::swap(best.endpoints[0], best.endpoints[1]);
+				std::swap(best.p_bits[0], best.p_bits[1]);
+				for (u32 i{ 0 }; i < block_pixels; ++i) best.indices[i] = (u8)(15 - best.indices[i]);
+			}
+
+			BitWriter writer{ block };
+			writer.write(1 << 6, 7);
+
+			for (u32 c{ 0 }; c < 4; ++c) {
+				writer.write(best.endpoints[0][c], 7);
+				writer.write(best.endpoints[1][c], 7);
+			}
+
+			writer.write(best.p_bits[0], 1);
+			writer.write(best.p_bits[1], 1);
+			writer.write(best.indices[0], 3);
+			for (u32 i{ 1 }; i < block_pixels; ++i) writer.write(best.indices[i], 4);
+		}
+
+		u32 unquantize_bc6h(u32 value) {
+			if (value == 0) return 0;
+			if (value == 1023) return 0xffff;
+			return (value << 6) + 32;
+		}
+
+		// Single region, 10 bit endpoints without delta encoding, 4 bit indices.
+		f32 fit_bc6h_mode11(const XMVECTOR* const pixels, FXMVECTOR e0, FXMVECTOR e1, BC6HMode11& result) {
+			XMFLOAT4 ends[2];
+			XMStoreFloat4(&ends[0], e0);
+			XMStoreFloat4(&ends[1], e1);
+			u32 unquantized[2][3];
+
+			for (u32 e{ 0 }; e < 2; ++e) {
+				const f32* const channels{ &ends[e].x };
+
+				for (u32 c{ 0 }; c < 3; ++c) {
+					result.endpoints[e][c] = quantize((channels[c] - 32.f) / 64.f, 1.f, 1023);
+					unquantized[e][c] = unquantize_bc6h(result.endpoints[e][c]);
+				}
+			}
+
+			XMVECTOR palette[16];
+			for (u32 i{ 0 }; i < 16; ++i) palette[i] = interpolate(unquantized[0], unquantized[1], bc7_weights[i], 3);
+
+			result.error = select_indices(pixels, nullptr, block_pixels, palette, 16, rgb_mask, result.indices);
+			return result.error;
+		}
+
+		void encode_bc6h(const XMVECTOR* const pixels, u8* const block, Quality::Level quality) {
+			XMVECTOR e0, e1;
+			principal_axis_endpoints(pixels, block_pixels, rgb_mask, e0, e1);
+
+			BC6HMode11 best;
+			fit_bc6h_mode11(pixels, e0, e1, best);
+
+			for (u32 i{ 0 }; i < refine_iterations[quality]; ++i) {
+				if (!refine_endpoints(pixels, best.indices, bc7_weights, rgb_mask, e0, e1)) break;
+
+				BC6HMode11 refined;
+				if (fit_bc6h_mode11(pixels, e0, e1, refined) >= best.error) break;
+				best = refined;
+			}
+
+			if (best.indices[0] & 8) {
+				std::swap(best.endpoints[0], best.endpoints[1]);
+				for (u32 i{ 0 }; i < block_pixels; ++i) best.indices[i] = (u8)(15 - best.indices[i]);
+			}
+
+			BitWriter writer{ block };
+			writer.write(0x03, 5);
+
+			for (u32 e{ 0 }; e < 2; ++e) {
+				for (u32 c{ 0 }; c < 3; ++c) writer.write(best.endpoints[e][c], 10);
+			}
+
+			writer.write(best.indices[0], 3);
+			for (u32 i{ 1 }; i < block_pixels; ++i) writer.write(best.indices[i], 4);
+		}
+
+		void compress_block_row(const SourceImage& source, const BlockImage& target, u32 block_y, Format::Type format, Quality::Level quality, f32 alpha_threshold) {
+			const u32 blocks_x{ (source.width + block_dim - 1) / block_dim };
+			const u32 size{ block_size(format) };
+			u8* block{ target.blocks + (u64)block_y * target.row_pitch };
+			XMVECTOR pixels[block_pixels];
+
+			for (u32 block_x{ 0 }; block_x < blocks_x; ++block_x, block += size) {
+				if (format == Format::BC6H) load_rgba16f_block(source, block_x, block_y, pixels);
+				else load_rgba8_block(source, block_x, block_y, pixels);
+
+				switch (format) {
+				case Format::BC1: encode_bc1(pixels, block, quality, alpha_threshold); break;
+				case Format::BC3:
+					encode_bc4_channel(pixels, 3, block, quality);
+					encode_bc1(pixels, block + 8, quality, 0.f);
+					break;
+				case Format::BC4: encode_bc4_channel(pixels, 0, block, quality); break;
+				case Format::BC5:
+					encode_bc4_channel(pixels, 0, block, quality);
+					encode_bc4_channel(pixels, 1, block + 8, quality);
+					break;
+				case Format::BC6H: encode_bc6h(pixels, block, quality); break;
+				case Format::BC7: encode_bc7(pixels, block, quality); break;
+				default: assert(false);
+				}
+			}
+		}
+	}
+
+	void compress(const SourceImage* const sources, const BlockImage* const targets, u32 image_count, Format::Type format, Quality::Level quality, f32 alpha_threshold) {
+		assert(sources && targets && image_count);
+		assert(format < Format::count && quality < Quality::count);
+
+		util::vector<thread_pool::RowJob> jobs{};
+		thread_pool::split_rows(image_count, block_rows_per_job, [sources](u32 i) { return (sources[i].height + block_dim - 1) / block_dim; }, jobs);
+
+		const u32 job_count{ (u32)jobs.size() };
+		const f32 threshold{ alpha_threshold * 255.f };
+
+		thread_pool::parallel_for(job_count, [&](u32 i) {
+			const thread_pool::RowJob& job{ jobs[i] };
+
+			for (u32 row{ job.first_row }; row < job.last_row; ++row) {
+				compress_block_row(sources[job.item], targets[job.item], row, format, quality, threshold);
+			}
+		});
+	}
+}
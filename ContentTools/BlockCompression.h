@@ -0,0 +1,49 @@
+#pragma once
+#include "ToolsCommon.h"
+
+namespace lightning::tools::bc {
+
+	struct Format {
+		enum Type : u32 {
+			BC1,
+			BC3,
+			BC4,
+			BC5,
+			BC6H,
+			BC7,
+
+			count
+		};
+	};
+
+	struct Quality {
+		enum Level : u32 {
+			FAST,
+			NORMAL,
+			HIGH,
+
+			count
+		};
+	};
+
+	// RGBA8 pixels for BC1-BC5 and BC7, RGBA16F pixels for BC6H (unsigned).
+	struct SourceImage {
+		const u8* pixels;
+		u32 width;
+		u32 height;
+		u32 row_pitch;
+	};
+
+	struct BlockImage {
+		u8* blocks;
+		u32 row_pitch;
+	};
+
+	[[nodiscard]] constexpr u32 block_size(Format::Type format) {
+		return format == Format::BC1 || format == Format::BC4 ? 8 : 16;
+	}
+
+	// Splits the images into rows of 4x4 blocks and encodes them on all available cores.
+	// Alpha below alpha_threshold (0 - 1) makes BC1 pixels transparent.
+	void compress(const SourceImage* const sources, const BlockImage* const targets, u32 image_count, Format::Type format, Quality::Level quality, f32 alpha_threshold);
+}
@@ -0,0 +1,254 @@
+#include "ContentCache.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+namespace lightning::tools::content_cache {
+	namespace {
+
+		namespace fs = std::filesystem;
+
+		struct BlobHeader {
+			constexpr static u32 magic_value{ 0x4343454c }; // LECC
+			u32 magic;
+			u32 version;
+			u64 key;
+			u64 size;
+		};
+
+		struct CacheEntry {
+			u64 size;
+			u64 last_access;
+		};
+
+		std::mutex cache_mutex;
+		fs::path cache_directory;
+		std::unordered_map<u64, CacheEntry> entries;
+		CacheStats stats{};
+		u64 access_clock{ 0 };
+
+		fs::path entry_path(u64 key) {
+			char name[32];
+			sprintf_s(name, "%016llx.blob", key);
+			return cache_directory / name;
+		}
+
+		void remove_entry(u64 key) {
+			auto it{ entries.find(key) };
+			if (it == entries.end()) return;
+
+			std::error_code ec;
+			fs::remove(entry_path(key), ec);
+
+			stats.size -= it->second.size;
+			entries.erase(it);
+			stats.entry_count = entries.size();
+		}
+
+		void evict(u64 budget) {
+			while (stats.size > budget && !entries.empty()) {
+				auto oldest{ entries.begin() };
+				for (auto it{ entries.begin() }; it != entries.end(); ++it) {
+					if (it->second.last_access < oldest->second.last_access) oldest = it;
+				}
+
+				remove_entry(oldest->first);
+				++stats.evictions;
+			}
+		}
+
+		void scan_directory() {
+			struct ScannedEntry {
+				fs::file_time_type time;
+				u64 key;
+				u64 size;
+			};
+
+			util::vector<ScannedEntry> scanned;
+			std::error_code ec;
+
+			for (const auto& file : fs::directory_iterator{ cache_directory, ec }) {
+				if (!file.is_regular_file() || file.path().extension() != ".blob") continue;
+
+				const std::string name{ file.path().stem().string() };
+				char* end{ nullptr };
+				const u64 key{ strtoull(name.c_str(), &end, 16) };
+				if (!end || *end != '\0') continue;
+
+				scanned.emplace_back(ScannedEntry{ file.last_write_time(ec), key, file.file_size(ec) });
+			}
+
+			// Last write time doubles as last access time, so the LRU order survives tool restarts.
+			std::sort(scanned.begin(), scanned.end(), [](const ScannedEntry& a, const ScannedEntry& b) { return a.time < b.time; });
+
+			for (const auto& entry : scanned) {
+				entries[entry.key] = { entry.size, ++access_clock };
+				stats.size += entry.size;
+			}
+
+			stats.entry_count = entries.size();
+		}
+
+		constexpr u64 fnv_prime{ 0x100000001b3ull };
+	}
+
+	KeyBuilder::KeyBuilder(u32 asset_type) {
+		add(tool_version);
+		add(asset_type);
+	}
+
+	void KeyBuilder::add(const void* const data, u64 size) {
+		const u8* at{ (const u8*)data };
+		const u8* const end{ at + size };
+		u64 hash{ _hash };
+
+		while (at < end) {
+			hash = (hash ^ *at) * fnv_prime;
+			++at;
+		}
+
+		_hash = hash;
+	}
+
+	bool KeyBuilder::add_file(const char* file) {
+		std::ifstream stream{ file, std::ios::in | std::ios::binary };
+		if (!stream) return false;
+
+		constexpr u64 chunk_size{ 1 << 20 };
+		std::unique_ptr<u8[]> chunk{ std::make_unique<u8[]>(chunk_size) };
+
+		while (stream) {
+			stream.read((char*)chunk.get(), chunk_size);
+			const u64 read{ (u64)stream.gcount() };
+			if (read) add(chunk.get(), read);
+		}
+
+		return stream.eof();
+	}
+
+	bool is_enabled() {
+		std::lock_guard lock{ cache_mutex };
+		return !cache_directory.empty();
+	}
+
+	bool load(u64 key, util::vector<u8>& data) {
+		fs::path path;
+		{
+			std::lock_guard lock{ cache_mutex };
+			if (cache_directory.empty()) return false;
+
+			auto it{ entries.find(key) };
+			if (it == entries.end()) {
+				++stats.misses;
+				return false;
+			}
+
+			it->second.last_access = ++access_clock;
+			path = entry_path(key);
+		}
+
+		std::ifstream file{ path, std::ios::in | std::ios::binary };
+		BlobHeader header{};
+		bool valid{ file && file.read((char*)&header, sizeof(BlobHeader)) && header.magic == BlobHeader::magic_value && header.version == tool_version && header.key == key };
+
+		if (valid) {
+			data.resize(header.size);
+			valid = header.size == 0 || (bool)file.read((char*)data.data(), header.size);
+		}
+
+		file.close();
+
+		std::lock_guard lock{ cache_mutex };
+
+		if (!valid) {
+			remove_entry(key);
+			++stats.misses;
+			return false;
+		}
+
+		std::error_code ec;
+		fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+		++stats.hits;
+
+		return true;
+	}
+
+	void store(u64 key, const void* const data, u64 size) {
+		assert(data && size);
+		fs::path path;
+		{
+			std::lock_guard lock{ cache_mutex };
+			if (cache_directory.empty()) return;
+			path = entry_path(key);
+		}
+
+		fs::path temp_path{ path };
+		temp_path += ".tmp" + std::to_string(GetCurrentThreadId());
+
+		{
+			std::ofstream file{ temp_path, std::ios::out | std::ios::binary | std::ios::trunc };
+			const BlobHeader header{ BlobHeader::magic_value, tool_version, key, size };
+
+			if (!file || !file.write((const char*)&header, sizeof(BlobHeader)) || !file.write((const char*)data, size)) {
+				file.close();
+				std::error_code ec;
+				fs::remove(temp_path, ec);
+				return;
+			}
+		}
+
+		std::lock_guard lock{ cache_mutex };
+		std::error_code ec;
+		fs::rename(temp_path, path, ec);
+
+		if (ec) {
+			fs::remove(temp_path, ec);
+			return;
+		}
+
+		const u64 entry_size{ sizeof(BlobHeader) + size };
+		auto it{ entries.find(key) };
+		if (it != entries.end()) stats.size -= it->second.size;
+
+		entries[key] = { entry_size, ++access_clock };
+		stats.size += entry_size;
+		stats.entry_count = entries.size();
+		++stats.stores;
+
+		evict(stats.max_size);
+	}
+
+	EDITOR_INTERFACE void set_content_cache(const char* directory, u64 max_size) {
+		std::lock_guard lock{ cache_mutex };
+
+		entries.clear();
+		stats = {};
+		access_clock = 0;
+		cache_directory.clear();
+
+		if (!directory || !directory[0]) return;
+
+		std::error_code ec;
+		fs::create_directories(directory, ec);
+		if (ec) return;
+
+		cache_directory = directory;
+		stats.max_size = max_size;
+		scan_directory();
+		evict(max_size);
+	}
+
+	EDITOR_INTERFACE void get_content_cache_stats(CacheStats* const out_stats) {
+		assert(out_stats);
+		std::lock_guard lock{ cache_mutex };
+		*out_stats = stats;
+	}
+
+	EDITOR_INTERFACE void clear_content_cache() {
+		std::lock_guard lock{ cache_mutex };
+
+		while (!entries.empty()) {
+			remove_entry(entries.begin()->first);
+		}
+	}
+}
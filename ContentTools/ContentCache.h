@@ -0,0 +1,37 @@
+#pragma once
+#include "ToolsCommon.h"
+
+namespace lightning::tools::content_cache {
+
+	// Bump whenever a change in the import pipeline makes previously cached blobs stale.
+	constexpr u32 tool_version{ 6 };
+
+	struct CacheStats {
+		u64 hits;
+		u64 misses;
+		u64 stores;
+		u64 evictions;
+		u64 entry_count;
+		u64 size;
+		u64 max_size;
+	};
+
+	class KeyBuilder {
+		public:
+			explicit KeyBuilder(u32 asset_type);
+
+			void add(const void* const data, u64 size);
+			bool add_file(const char* file);
+			template<typename T> void add(const T& value) { add(&value, sizeof(T)); }
+
+			// 64-bit FNV-1a of everything added. 0 means "no key" to the importers, so it's never returned.
+			[[nodiscard]] constexpr u64 key() const { return _hash ? _hash : 1; }
+
+		private:
+			u64 _hash{ 0xcbf29ce484222325ull };
+	};
+
+	[[nodiscard]] bool is_enabled();
+	[[nodiscard]] bool load(u64 key, util::vector<u8>& data);
+	void store(u64 key, const void* const data, u64 size);
+}
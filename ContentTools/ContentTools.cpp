@@ -1,4 +1,5 @@
 #include "ToolsCommon.h"
+#include "ThreadPool.h"
 
 namespace lightning::tools {
 	extern void shutdown_texture_tools();
@@ -8,4 +9,5 @@ EDITOR_INTERFACE void shutdown_content_tools() {
 	using namespace lightning::tools;
 
 	shutdown_texture_tools();
+	thread_pool::shutdown();
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "ToolsCommon.h"
+#include "ThreadPool.h"
 #include <DirectXTex.h>
 #include <dxgi1_6.h>
 
@@ -25,65 +26,396 @@ namespace lightning::tools {
 			private:
 		};
 
-		math::v3 get_sample_direction_equirectangular(u32 face, f32 u, f32 v) {
-			math::v3 directions[6]{
-				{ -u, 1.f, -v },	// x+ left
-				{ u, -1.f, -v },	// x- right
-				{ v, u, 1.f },		// y+ bottom
-				{ -v, u, -1.f },	// y- top
-				{ 1.f, u, -v },		// z+ front
-				{ -1.f, -u, -v },	// z- back
-			};
+		struct FaceBasis {
+			math::v3 u_axis;
+			math::v3 v_axis;
+			math::v3 normal;
+		};
 
-			XMVECTOR dir{ XMLoadFloat3(&directions[face]) };
-			dir = XMVector3Normalize(dir);
-			math::v3 normalized_dir;
-			XMStoreFloat3(&normalized_dir, dir);
+		// Sample direction of a cube face texel is u * u_axis + v * v_axis + normal.
+		const FaceBasis face_bases[6]{
+			{ { -1.f, 0.f, 0.f }, { 0.f, 0.f, -1.f }, { 0.f, 1.f, 0.f } },		// x+ left
+			{ { 1.f, 0.f, 0.f }, { 0.f, 0.f, -1.f }, { 0.f, -1.f, 0.f } },		// x- right
+			{ { 0.f, 1.f, 0.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f, 1.f } },		// y+ bottom
+			{ { 0.f, 1.f, 0.f }, { -1.f, 0.f, 0.f }, { 0.f, 0.f, -1.f } },		// y- top
+			{ { 0.f, 1.f, 0.f }, { 0.f, 0.f, -1.f }, { 1.f, 0.f, 0.f } },		// z+ front
+			{ { 0.f, -1.f, 0.f }, { 0.f, 0.f, -1.f }, { -1.f, 0.f, 0.f } },		// z- back
+		};
 
-			return normalized_dir;
-		}
+		constexpr u32 bytes_per_pixel{ sizeof(f32) * 4 };
+		constexpr f32 sample_offset{ .5f };
+		constexpr u32 cube_face_rows_per_job{ 16 };
 
-		math::v2 direction_to_equirectangular(const math::v3& dir) {
-			const f32 phi{ atan2f(dir.y, dir.x) };
-			const f32 theta{ XMScalarACos(dir.z) };
-			const f32 s{ phi * math::INV_TWO_PI + .5f };
-			const f32 t{ theta * math::INV_PI };
+		XMVECTOR load_pixel(const Image& image, u32 x, u32 y) {
+			return XMLoadFloat4((const XMFLOAT4*)&image.pixels[image.rowPitch * y + x * bytes_per_pixel]);
+		}
 
-			return { s, t };
+		XMVECTOR sample_bilinear(const Image& env_map, f32 s, f32 t) {
+			const u32 width{ (u32)env_map.width };
+			const u32 height{ (u32)env_map.height };
+			const f32 pos_x{ s * width - sample_offset };
+			const f32 pos_y{ math::clamp(t * height - sample_offset, 0.f, (f32)(height - 1)) };
+			const f32 floor_x{ floorf(pos_x) };
+			const f32 floor_y{ floorf(pos_y) };
+			const f32 frac_x{ pos_x - floor_x };
+			const f32 frac_y{ pos_y - floor_y };
+
+			// Equirectangular maps wrap around horizontally and clamp at the poles.
+			const u32 x0{ (u32)((s32)floor_x + (s32)width) % width };
+			const u32 x1{ (x0 + 1) % width };
+			const u32 y0{ (u32)floor_y };
+			const u32 y1{ std::min(y0 + 1, height - 1) };
+
+			const XMVECTOR top{ XMVectorLerp(load_pixel(env_map, x0, y0), load_pixel(env_map, x1, y0), frac_x) };
+			const XMVECTOR bottom{ XMVectorLerp(load_pixel(env_map, x0, y1), load_pixel(env_map, x1, y1), frac_x) };
+
+			return XMVectorLerp(top, bottom, frac_y);
 		}
 
-		void sample_cube_face(const Image& env_map, const Image& cube_face, u32 face_index, bool mirror) {
-			assert(cube_face.width == cube_face.height);
+		// Converts four texels of a row per iteration, using the polynomial estimates of atan2 and acos.
+		void sample_cube_face(const Image& env_map, const Image& cube_face, u32 face_index, u32 first_row, u32 last_row, bool mirror, bool bilinear) {
+			assert(cube_face.width == cube_face.height && face_index < 6);
+			assert(last_row <= cube_face.height);
 
-			const f32 inv_width{ 1.f / (f32)cube_face.height };
-			const f32 inv_height{ 1.f / (f32)cube_face.width };
+			const u32 size{ (u32)cube_face.width };
+			const f32 scale{ 2.f / (f32)size };
 			const u32 row_pitch{ (u32)cube_face.rowPitch };
-			const u32 env_width{ (u32)env_map.width -1 };
-			const u32 env_height{ (u32)env_map.height - 1 };
-			const u32 env_row_pitch{ (u32)env_map.rowPitch };
+			const f32 env_width{ (f32)(env_map.width - 1) };
+			const f32 env_height{ (f32)(env_map.height - 1) };
+			const FaceBasis& basis{ face_bases[face_index] };
+
+			const XMVECTOR lane_offsets{ XMVectorSet(0.f, 1.f, 2.f, 3.f) };
+			const XMVECTOR u_scale{ XMVectorReplicate(scale) };
+			const XMVECTOR u_bias{ XMVectorReplicate(sample_offset * scale - 1.f) };
+			const XMVECTOR u_axis_x{ XMVectorReplicate(basis.u_axis.x) };
+			const XMVECTOR u_axis_y{ XMVectorReplicate(basis.u_axis.y) };
+			const XMVECTOR u_axis_z{ XMVectorReplicate(basis.u_axis.z) };
+			const XMVECTOR inv_two_pi{ XMVectorReplicate(math::INV_TWO_PI) };
+			const XMVECTOR inv_pi{ XMVectorReplicate(math::INV_PI) };
+			const XMVECTOR half{ XMVectorReplicate(.5f) };
+
+			for (u32 y{ first_row }; y < last_row; ++y) {
+				const f32 v{ (y + sample_offset) * scale - 1.f };
+				const XMVECTOR row_x{ XMVectorReplicate(v * basis.v_axis.x + basis.normal.x) };
+				const XMVECTOR row_y{ XMVectorReplicate(v * basis.v_axis.y + basis.normal.y) };
+				const XMVECTOR row_z{ XMVectorReplicate(v * basis.v_axis.z + basis.normal.z) };
+				u8* const dst_row{ &cube_face.pixels[row_pitch * y] };
+
+				for (u32 x{ 0 }; x < size; x += 4) {
+					const XMVECTOR u{ XMVectorMultiplyAdd(XMVectorAdd(XMVectorReplicate((f32)x), lane_offsets), u_scale, u_bias) };
+					XMVECTOR dir_x{ XMVectorMultiplyAdd(u, u_axis_x, row_x) };
+					XMVECTOR dir_y{ XMVectorMultiplyAdd(u, u_axis_y, row_y) };
+					XMVECTOR dir_z{ XMVectorMultiplyAdd(u, u_axis_z, row_z) };
+
+					const XMVECTOR length_sq{ XMVectorMultiplyAdd(dir_x, dir_x, XMVectorMultiplyAdd(dir_y, dir_y, XMVectorMultiply(dir_z, dir_z))) };
+					const XMVECTOR inv_length{ XMVectorReciprocalSqrt(length_sq) };
+					dir_x = XMVectorMultiply(dir_x, inv_length);
+					dir_y = XMVectorMultiply(dir_y, inv_length);
+					dir_z = XMVectorClamp(XMVectorMultiply(dir_z, inv_length), g_XMNegativeOne, g_XMOne);
+
+					const XMVECTOR phi{ XMVectorATan2Est(dir_y, dir_x) };
+					const XMVECTOR theta{ XMVectorACosEst(dir_z) };
+					XMVECTOR s{ XMVectorSaturate(XMVectorMultiplyAdd(phi, inv_two_pi, half)) };
+					const XMVECTOR t{ XMVectorSaturate(XMVectorMultiply(theta, inv_pi)) };
+
+					if (mirror) s = XMVectorSubtract(g_XMOne, s);
+
+					XMFLOAT4 s_lanes;
+					XMFLOAT4 t_lanes;
+					XMStoreFloat4(&s_lanes, s);
+					XMStoreFloat4(&t_lanes, t);
+
+					const f32* const s_values{ &s_lanes.x };
+					const f32* const t_values{ &t_lanes.x };
+					const u32 lane_count{ std::min(4u, size - x) };
+
+					for (u32 i{ 0 }; i < lane_count; ++i) {
+						u8* const dst_pixel{ dst_row + (x + i) * bytes_per_pixel };
+
+						if (bilinear) {
+							XMStoreFloat4((XMFLOAT4*)dst_pixel, sample_bilinear(env_map, s_values[i], t_values[i]));
+						}
+						else {
+							const u32 pos_x{ (u32)(s_values[i] * env_width) };
+							const u32 pos_y{ (u32)(t_values[i] * env_height) };
+							memcpy(dst_pixel, &env_map.pixels[env_map.rowPitch * pos_y + pos_x * bytes_per_pixel], bytes_per_pixel);
+						}
+					}
+				}
+			}
+		}
+
+		constexpr u32 specular_sample_count{ 512 };
+		constexpr u32 sh_coefficient_count{ 9 };
+
+		// Faces in face_bases whose normal points along +/- x, y and z.
+		constexpr u32 major_axis_faces[3][2]{ { 4, 5 }, { 0, 1 }, { 2, 3 } };
 
-			constexpr u32 bytes_per_pixel{ sizeof(f32) * 4 };
+		struct SpecularSample {
+			math::v3 direction;
+			f32 n_dot_l;
+			f32 mip;
+		};
+
+		struct SHCoefficients {
+			XMVECTOR c[sh_coefficient_count];
+		};
 
-			for (u32 y{ 0 }; y < cube_face.height; ++y) {
-				const f32 v{ (y * inv_height) * 2.f - 1.f };
+		XMVECTOR texel_direction(u32 face, f32 u, f32 v) {
+			const FaceBasis& basis{ face_bases[face] };
+			const XMVECTOR dir{ XMVectorMultiplyAdd(XMVectorReplicate(u), XMLoadFloat3(&basis.u_axis), XMVectorMultiplyAdd(XMVectorReplicate(v), XMLoadFloat3(&basis.v_axis), XMLoadFloat3(&basis.normal))) };
+			return XMVector3Normalize(dir);
+		}
+
+		// Inverse of texel_direction, u and v are in [-1, 1].
+		u32 direction_to_cube_face(FXMVECTOR direction, f32& u, f32& v) {
+			math::v3 dir;
+			XMStoreFloat3(&dir, direction);
+			const f32 abs_x{ fabsf(dir.x) };
+			const f32 abs_y{ fabsf(dir.y) };
+			const f32 abs_z{ fabsf(dir.z) };
+
+			u32 face{ 0 };
+			f32 major{ 0.f };
+
+			if (abs_x >= abs_y && abs_x >= abs_z) {
+				face = major_axis_faces[0][dir.x < 0.f];
+				major = abs_x;
+			}
+			else if (abs_y >= abs_z) {
+				face = major_axis_faces[1][dir.y < 0.f];
+				major = abs_y;
+			}
+			else {
+				face = major_axis_faces[2][dir.z < 0.f];
+				major = abs_z;
+			}
+
+			const FaceBasis& basis{ face_bases[face] };
+			const f32 inv_major{ 1.f / major };
+			u = (dir.x * basis.u_axis.x + dir.y * basis.u_axis.y + dir.z * basis.u_axis.z) * inv_major;
+			v = (dir.x * basis.v_axis.x + dir.y * basis.v_axis.y + dir.z * basis.v_axis.z) * inv_major;
+
+			return face;
+		}
+
+		XMVECTOR sample_cube_face_bilinear(const Image& face, f32 u, f32 v) {
+			const u32 size{ (u32)face.width };
+			const f32 pos_x{ math::clamp((u * .5f + .5f) * size - sample_offset, 0.f, (f32)(size - 1)) };
+			const f32 pos_y{ math::clamp((v * .5f + .5f) * size - sample_offset, 0.f, (f32)(size - 1)) };
+			const u32 x0{ (u32)pos_x };
+			const u32 y0{ (u32)pos_y };
+			const u32 x1{ std::min(x0 + 1, size - 1) };
+			const u32 y1{ std::min(y0 + 1, size - 1) };
+			const f32 frac_x{ pos_x - (f32)x0 };
+			const f32 frac_y{ pos_y - (f32)y0 };
+
+			const XMVECTOR top{ XMVectorLerp(load_pixel(face, x0, y0), load_pixel(face, x1, y0), frac_x) };
+			const XMVECTOR bottom{ XMVectorLerp(load_pixel(face, x0, y1), load_pixel(face, x1, y1), frac_x) };
+
+			return XMVectorLerp(top, bottom, frac_y);
+		}
 
-				for (u32 x{ 0 }; x < cube_face.width; ++x) {
-					const f32 u{ (x * inv_width) * 2.f - 1.f };
-					const math::v3 sample_direction{ get_sample_direction_equirectangular(face_index, u, v) };
-					math::v2 uv{ direction_to_equirectangular(sample_direction) };
+		// Trilinear sample of one cube in a mip mapped cube array.
+		XMVECTOR sample_cube(const ScratchImage& cubes, u32 cube, FXMVECTOR direction, f32 mip) {
+			const u32 max_mip{ (u32)cubes.GetMetadata().mipLevels - 1 };
+			f32 u, v;
+			const u32 face{ direction_to_cube_face(direction, u, v) };
+			const u32 item{ cube * 6 + face };
 
-					assert(uv.x >= 0.f && uv.x <= 1.f && uv.y >= 0.f && uv.y <= 1.f);
+			mip = math::clamp(mip, 0.f, (f32)max_mip);
+			const u32 mip0{ (u32)mip };
+			const u32 mip1{ std::min(mip0 + 1, max_mip) };
+			const XMVECTOR sample0{ sample_cube_face_bilinear(*cubes.GetImage(mip0, item, 0), u, v) };
 
-					if (mirror) uv.x = 1.f - uv.x;
-					const f32 pos_x{ uv.x * env_width };
-					const f32 pos_y{ uv.y * env_height };
-					u8* dst_pixel{ &cube_face.pixels[row_pitch * y + x * bytes_per_pixel] };
-					u8* const src_pixel{ &env_map.pixels[env_row_pitch * (u32)pos_y + (u32)pos_x * bytes_per_pixel] };
-					memcpy(dst_pixel, src_pixel, bytes_per_pixel);
+			if (mip0 == mip1) return sample0;
+
+			const XMVECTOR sample1{ sample_cube_face_bilinear(*cubes.GetImage(mip1, item, 0), u, v) };
+			return XMVectorLerp(sample0, sample1, mip - (f32)mip0);
+		}
+
+		f32 radical_inverse(u32 bits) {
+			bits = (bits << 16u) | (bits >> 16u);
+			bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+			bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+			bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+			bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+
+			return (f32)bits * 2.3283064365386963e-10f;
+		}
+
+		// Tangent space GGX importance samples with N = V, shared by every texel of a roughness level.
+		// Each sample reads a source mip matching its solid angle (filtered importance sampling).
+		f32 get_specular_samples(f32 roughness, u32 source_size, util::vector<SpecularSample>& samples) {
+			const f32 alpha{ roughness * roughness };
+			const f32 alpha_sq{ alpha * alpha };
+			const f32 texel_solid_angle{ 4.f * math::PI / (6.f * source_size * source_size) };
+			f32 total_weight{ 0.f };
+
+			samples.clear();
+			samples.reserve(specular_sample_count);
+
+			for (u32 i{ 0 }; i < specular_sample_count; ++i) {
+				const f32 xi_x{ (f32)i / (f32)specular_sample_count };
+				const f32 xi_y{ radical_inverse(i) };
+				const f32 phi{ math::TWO_PI * xi_x };
+				const f32 cos_theta{ sqrtf((1.f - xi_y) / (1.f + (alpha_sq - 1.f) * xi_y)) };
+				const f32 sin_theta{ sqrtf(1.f - cos_theta * cos_theta) };
+				const math::v3 h{ sin_theta * cosf(phi), sin_theta * sinf(phi), cos_theta };
+				const f32 n_dot_l{ 2.f * h.z * h.z - 1.f };
+
+				if (n_dot_l <= 0.f) continue;
+
+				const f32 d_denom{ h.z * h.z * (alpha_sq - 1.f) + 1.f };
+				const f32 d{ alpha_sq / (math::PI * d_denom * d_denom) };
+				const f32 pdf{ d * .25f };
+				const f32 sample_solid_angle{ 1.f / ((f32)specular_sample_count * pdf + math::EPSILON) };
+				const f32 mip{ std::max(.5f * log2f(sample_solid_angle / texel_solid_angle) + 1.f, 0.f) };
+
+				samples.emplace_back(SpecularSample{ { 2.f * h.z * h.x, 2.f * h.z * h.y, n_dot_l }, n_dot_l, mip });
+				total_weight += n_dot_l;
+			}
+
+			return total_weight > 0.f ? 1.f / total_weight : 0.f;
+		}
+
+		void prefilter_specular_rows(const ScratchImage& source, const Image& dst, u32 cube, u32 face, u32 first_row, u32 last_row, const util::vector<SpecularSample>& samples, f32 inv_total_weight, f32 base_mip) {
+			const u32 size{ (u32)dst.width };
+			const f32 scale{ 2.f / (f32)size };
+			const XMVECTOR up_z{ g_XMIdentityR2 };
+			const XMVECTOR up_x{ g_XMIdentityR0 };
+
+			for (u32 y{ first_row }; y < last_row; ++y) {
+				const f32 v{ (y + sample_offset) * scale - 1.f };
+				XMFLOAT4* const dst_row{ (XMFLOAT4*)&dst.pixels[dst.rowPitch * y] };
+
+				for (u32 x{ 0 }; x < size; ++x) {
+					const f32 u{ (x + sample_offset) * scale - 1.f };
+					const XMVECTOR n{ texel_direction(face, u, v) };
+
+					if (samples.empty()) {
+						XMStoreFloat4(&dst_row[x], sample_cube(source, cube, n, base_mip));
+						continue;
+					}
+
+					const XMVECTOR up{ fabsf(XMVectorGetZ(n)) < .999f ? up_z : up_x };
+					const XMVECTOR tangent{ XMVector3Normalize(XMVector3Cross(up, n)) };
+					const XMVECTOR bitangent{ XMVector3Cross(n, tangent) };
+					XMVECTOR color{ XMVectorZero() };
+
+					for (const auto& sample : samples) {
+						const XMVECTOR l{ XMVectorMultiplyAdd(tangent, XMVectorReplicate(sample.direction.x), XMVectorMultiplyAdd(bitangent, XMVectorReplicate(sample.direction.y), XMVectorScale(n, sample.direction.z))) };
+						color = XMVectorMultiplyAdd(sample_cube(source, cube, l, sample.mip), XMVectorReplicate(sample.n_dot_l), color);
+					}
+
+					XMStoreFloat4(&dst_row[x], XMVectorScale(color, inv_total_weight));
 				}
 			}
 		}
 
+		f32 area_element(f32 x, f32 y) {
+			return atan2f(x * y, sqrtf(x * x + y * y + 1.f));
+		}
+
+		f32 texel_solid_angle(f32 u, f32 v, f32 inv_size) {
+			const f32 x0{ u - inv_size };
+			const f32 y0{ v - inv_size };
+			const f32 x1{ u + inv_size };
+			const f32 y1{ v + inv_size };
+
+			return area_element(x0, y0) - area_element(x0, y1) - area_element(x1, y0) + area_element(x1, y1);
+		}
+
+		void sh_basis(FXMVECTOR dir, f32 (&basis)[sh_coefficient_count]) {
+			math::v3 d;
+			XMStoreFloat3(&d, dir);
+
+			basis[0] = .282095f;
+			basis[1] = .488603f * d.y;
+			basis[2] = .488603f * d.z;
+			basis[3] = .488603f * d.x;
+			basis[4] = 1.092548f * d.x * d.y;
+			basis[5] = 1.092548f * d.y * d.z;
+			basis[6] = .315392f * (3.f * d.z * d.z - 1.f);
+			basis[7] = 1.092548f * d.x * d.z;
+			basis[8] = .546274f * (d.x * d.x - d.y * d.y);
+		}
+
+		void project_sh_rows(const Image& face_image, u32 face, u32 first_row, u32 last_row, SHCoefficients& sh) {
+			const u32 size{ (u32)face_image.width };
+			const f32 scale{ 2.f / (f32)size };
+			const f32 inv_size{ 1.f / (f32)size };
+			f32 basis[sh_coefficient_count];
+
+			for (u32 i{ 0 }; i < sh_coefficient_count; ++i) sh.c[i] = XMVectorZero();
+
+			for (u32 y{ first_row }; y < last_row; ++y) {
+				const f32 v{ (y + sample_offset) * scale - 1.f };
+
+				for (u32 x{ 0 }; x < size; ++x) {
+					const f32 u{ (x + sample_offset) * scale - 1.f };
+					const XMVECTOR radiance{ XMVectorScale(load_pixel(face_image, x, y), texel_solid_angle(u, v, inv_size)) };
+					sh_basis(texel_direction(face, u, v), basis);
+
+					for (u32 i{ 0 }; i < sh_coefficient_count; ++i) {
+						sh.c[i] = XMVectorMultiplyAdd(radiance, XMVectorReplicate(basis[i]), sh.c[i]);
+					}
+				}
+			}
+		}
+
+		// Stores irradiance / PI, so shaders only need to multiply by albedo.
+		void evaluate_irradiance_rows(const SHCoefficients& sh, const Image& dst, u32 face, u32 first_row, u32 last_row) {
+			constexpr f32 band_factors[sh_coefficient_count]{ 1.f, 2.f / 3.f, 2.f / 3.f, 2.f / 3.f, .25f, .25f, .25f, .25f, .25f };
+			const u32 size{ (u32)dst.width };
+			const f32 scale{ 2.f / (f32)size };
+			f32 basis[sh_coefficient_count];
+
+			for (u32 y{ first_row }; y < last_row; ++y) {
+				const f32 v{ (y + sample_offset) * scale - 1.f };
+				XMFLOAT4* const dst_row{ (XMFLOAT4*)&dst.pixels[dst.rowPitch * y] };
+
+				for (u32 x{ 0 }; x < size; ++x) {
+					const f32 u{ (x + sample_offset) * scale - 1.f };
+					sh_basis(texel_direction(face, u, v), basis);
+					XMVECTOR irradiance{ XMVectorZero() };
+
+					for (u32 i{ 0 }; i < sh_coefficient_count; ++i) {
+						irradiance = XMVectorMultiplyAdd(sh.c[i], XMVectorReplicate(basis[i] * band_factors[i]), irradiance);
+					}
+
+					irradiance = XMVectorMax(irradiance, XMVectorZero());
+					XMStoreFloat4(&dst_row[x], XMVectorSelect(g_XMOne, irradiance, g_XMSelect1110));
+				}
+			}
+		}
+
+		HRESULT get_f32_source_mips(const ScratchImage& cubemaps, ScratchImage& source_mips) {
+			const TexMetadata& metadata{ cubemaps.GetMetadata() };
+			assert(metadata.IsCubemap());
+			HRESULT hr{ S_OK };
+
+			ScratchImage f32_cubemaps{};
+			const ScratchImage* cubes{ &cubemaps };
+
+			if (metadata.format != DXGI_FORMAT_R32G32B32A32_FLOAT) {
+				hr = Convert(cubemaps.GetImages(), cubemaps.GetImageCount(), metadata, DXGI_FORMAT_R32G32B32A32_FLOAT, TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, f32_cubemaps);
+				if (FAILED(hr)) return hr;
+				cubes = &f32_cubemaps;
+			}
+
+			return GenerateMipMaps(cubes->GetImages(), cubes->GetImageCount(), cubes->GetMetadata(), TEX_FILTER_BOX, 0, source_mips);
+		}
+
+		HRESULT convert_to_source_format(ScratchImage& working_scratch, DXGI_FORMAT format, ScratchImage& prefiltered) {
+			if (format == DXGI_FORMAT_R32G32B32A32_FLOAT) {
+				prefiltered = std::move(working_scratch);
+				return S_OK;
+			}
+
+			return Convert(working_scratch.GetImages(), working_scratch.GetImageCount(), working_scratch.GetMetadata(), format, TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, prefiltered);
+		}
+
 		void reset_d3d11_context(ID3D11DeviceContext* ctx) {
 			u8 zero_mem_block[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT * sizeof(void*)];
 			memset(&zero_mem_block, 0, sizeof(zero_mem_block));
@@ -191,7 +523,7 @@ namespace lightning::tools {
 		}
  	}
 
-	HRESULT equirectangular_to_cubemap(const Image* env_maps, u32 env_map_count, u32 cubemap_size, bool use_prefilter_size, bool mirror_cubemap, ScratchImage& cube_maps) {
+	HRESULT equirectangular_to_cubemap(const Image* env_maps, u32 env_map_count, u32 cubemap_size, bool use_prefilter_size, bool mirror_cubemap, bool bilinear, ScratchImage& cube_maps) {
 		if (use_prefilter_size) {
 			cubemap_size = prefiltered_specular_cubemap_size;
 		}
@@ -207,6 +539,8 @@ namespace lightning::tools {
 			return hr;
 		}
 
+		util::vector<thread_pool::RowJob> jobs{};
+
 		for (u32 i{ 0 }; i < env_map_count; ++i) {
 			const Image& env_map{ env_maps[i] };
 
@@ -228,20 +562,14 @@ namespace lightning::tools {
 			assert(f32_env_map.GetImageCount() == 1);
 
 			const Image* dst_images{ &working_scratch.GetImages()[i * 6] };
-			const Image& env_map_image{ f32_env_map.GetImages()[i] };
+			const Image& env_map_image{ f32_env_map.GetImages()[0] };
 			const bool mirror{ mirror_cubemap };
 
-			std::thread threads[]{
-				std::thread { [&] { sample_cube_face(env_map_image, dst_images[0], 0, mirror); } },
-				std::thread { [&] { sample_cube_face(env_map_image, dst_images[1], 1, mirror); } },
-				std::thread { [&] { sample_cube_face(env_map_image, dst_images[2], 2, mirror); } },
-				std::thread { [&] { sample_cube_face(env_map_image, dst_images[3], 3, mirror); } },
-				std::thread { [&] { sample_cube_face(env_map_image, dst_images[4], 4, mirror); } },
-			};
-
-			sample_cube_face(f32_env_map.GetImages()[i], dst_images[5], 5, mirror);
-
-			for (u32 face{ 0 }; face < 5; ++face) threads[face].join();
+			thread_pool::split_rows(6, cube_face_rows_per_job, [cubemap_size](u32) { return cubemap_size; }, jobs);
+			thread_pool::parallel_for((u32)jobs.size(), [&](u32 job_index) {
+				const thread_pool::RowJob& job{ jobs[job_index] };
+				sample_cube_face(env_map_image, dst_images[job.item], job.item, job.first_row, job.last_row, mirror, bilinear);
+			});
 		}
 
 		if (env_maps[0].format != DXGI_FORMAT_R32G32B32A32_FLOAT) {
@@ -386,4 +714,94 @@ namespace lightning::tools {
 
 		return download_texture_2d(ctx.Get(), cubemap_size, cubemap_size, array_size, 1, format, true, cubemaps.Get(), cubemaps_cpu.Get(), cubemaps_out);
 	}
+
+	// Mip i holds the GGX prefiltered environment for roughness i / (roughness_mip_levels - 1).
+	HRESULT prefilter_specular(const ScratchImage& cubemaps, ScratchImage& prefiltered) {
+		const TexMetadata& metadata{ cubemaps.GetMetadata() };
+		const u32 cube_count{ (u32)metadata.arraySize / 6 };
+		const u32 source_size{ (u32)metadata.width };
+		constexpr u32 size{ prefiltered_specular_cubemap_size };
+
+		ScratchImage source{};
+		HRESULT hr{ get_f32_source_mips(cubemaps, source) };
+		if (FAILED(hr)) return hr;
+
+		ScratchImage working_scratch{};
+		hr = working_scratch.InitializeCube(DXGI_FORMAT_R32G32B32A32_FLOAT, size, size, cube_count, roughness_mip_levels);
+		if (FAILED(hr)) return hr;
+
+		util::vector<SpecularSample> samples[roughness_mip_levels]{};
+		f32 inv_total_weights[roughness_mip_levels]{};
+
+		for (u32 mip{ 1 }; mip < roughness_mip_levels; ++mip) {
+			inv_total_weights[mip] = get_specular_samples((f32)mip / (f32)(roughness_mip_levels - 1), source_size, samples[mip]);
+		}
+
+		const f32 base_mip{ std::max(log2f((f32)source_size / (f32)size), 0.f) };
+		// One item per face of every mip: item = mip * face_count + cube * 6 + face.
+		const u32 face_count{ cube_count * 6 };
+		util::vector<thread_pool::RowJob> jobs{};
+		thread_pool::split_rows(face_count * roughness_mip_levels, cube_face_rows_per_job, [face_count](u32 item) { return std::max(size >> (item / face_count), 1u); }, jobs);
+
+		thread_pool::parallel_for((u32)jobs.size(), [&](u32 i) {
+			const thread_pool::RowJob& job{ jobs[i] };
+			const u32 mip{ job.item / face_count };
+			const u32 slice{ job.item % face_count };
+			const Image& dst{ *working_scratch.GetImage(mip, slice, 0) };
+			prefilter_specular_rows(source, dst, slice / 6, slice % 6, job.first_row, job.last_row, samples[mip], inv_total_weights[mip], base_mip);
+		});
+
+		return convert_to_source_format(working_scratch, metadata.format, prefiltered);
+	}
+
+	HRESULT prefilter_diffuse(const ScratchImage& cubemaps, ScratchImage& prefiltered) {
+		const TexMetadata& metadata{ cubemaps.GetMetadata() };
+		const u32 cube_count{ (u32)metadata.arraySize / 6 };
+		constexpr u32 size{ prefiltered_diffuse_cubemap_size };
+
+		ScratchImage source{};
+		HRESULT hr{ get_f32_source_mips(cubemaps, source) };
+		if (FAILED(hr)) return hr;
+
+		// SH projection is band limited, so the first mip not larger than the output is plenty.
+		const u32 source_mip_count{ (u32)source.GetMetadata().mipLevels };
+		u32 source_mip{ 0 };
+		while (source_mip + 1 < source_mip_count && (metadata.width >> source_mip) > size) ++source_mip;
+
+		ScratchImage working_scratch{};
+		hr = working_scratch.InitializeCube(DXGI_FORMAT_R32G32B32A32_FLOAT, size, size, cube_count, 1);
+		if (FAILED(hr)) return hr;
+
+		// One item per face: item = cube * 6 + face.
+		const u32 source_size{ std::max((u32)metadata.width >> source_mip, 1u) };
+		util::vector<thread_pool::RowJob> projection_jobs{};
+		thread_pool::split_rows(cube_count * 6, cube_face_rows_per_job, [source_size](u32) { return source_size; }, projection_jobs);
+
+		util::vector<SHCoefficients> partial_sh(projection_jobs.size());
+		thread_pool::parallel_for((u32)projection_jobs.size(), [&](u32 i) {
+			const thread_pool::RowJob& job{ projection_jobs[i] };
+			project_sh_rows(*source.GetImage(source_mip, job.item, 0), job.item % 6, job.first_row, job.last_row, partial_sh[i]);
+		});
+
+		// Reduce in job order, so the result doesn't depend on thread scheduling.
+		util::vector<SHCoefficients> cube_sh(cube_count);
+		for (auto& sh : cube_sh) {
+			for (u32 c{ 0 }; c < sh_coefficient_count; ++c) sh.c[c] = XMVectorZero();
+		}
+
+		for (u32 i{ 0 }; i < projection_jobs.size(); ++i) {
+			SHCoefficients& sh{ cube_sh[projection_jobs[i].item / 6] };
+			for (u32 c{ 0 }; c < sh_coefficient_count; ++c) sh.c[c] = XMVectorAdd(sh.c[c], partial_sh[i].c[c]);
+		}
+
+		util::vector<thread_pool::RowJob> jobs{};
+		thread_pool::split_rows(cube_count * 6, cube_face_rows_per_job, [](u32) { return size; }, jobs);
+
+		thread_pool::parallel_for((u32)jobs.size(), [&](u32 i) {
+			const thread_pool::RowJob& job{ jobs[i] };
+			evaluate_irradiance_rows(cube_sh[job.item / 6], *working_scratch.GetImage(0, job.item, 0), job.item % 6, job.first_row, job.last_row);
+		});
+
+		return convert_to_source_format(working_scratch, metadata.format, prefiltered);
+	}
 }
\ No newline at end of file
@@ -8,11 +8,13 @@ namespace lightning::tools {
 	struct Scene;
 	struct Mesh;
 	struct GeometryImportSettings;
+	class ScenePackStream;
 
 	class FbxContext {
 		public:
-			FbxContext(const char* file, Scene* scene, SceneData* data, Progression* const progression) : _scene{ scene }, _scene_data{ data }, _progression{ progression } {
-				assert(file && _scene && _scene_data && _progression);
+			FbxContext(const char* file, Scene* scene, SceneData* data, Progression* const progression) : _scene{ scene }, _progression{ progression } {
+				assert(file && _scene && data && _progression);
+				_settings = data->settings;
 				if (initialize_fbx()) {
 					load_fbx_file(file);
 					assert(is_valid());
@@ -26,22 +28,40 @@ namespace lightning::tools {
 			}
 
 			void get_scene(FbxNode* root = nullptr);
+			void stream_scene(ScenePackStream& stream);
 
 			constexpr bool is_valid() const { return _fbx_manager && _fbx_scene; }
 			constexpr f32 scene_scale() const { return _scene_scale; }
 			constexpr Progression* get_progression() const { return _progression; }
+			// The caller's settings, with calculated normals or tangents when get_scene() found meshes without them.
+			constexpr const GeometryImportSettings& settings() const { return _settings; }
 
 		private:
 
+			struct MeshSource {
+				FbxMesh* fbx_mesh;
+				u32 lod_id;
+				f32 lod_threshold;
+				FbxAMatrix transform;	// baked into the verticies
+				FbxAMatrix placement;	// kept as the mesh transform, so identical geometry can be shared
+				bool has_normals;
+			};
+
+			struct LodSource {
+				std::string name;
+				util::vector<MeshSource> meshes;
+			};
+
 			bool initialize_fbx();
 			void load_fbx_file(const char* file);
-			void get_meshes(FbxNode* node, util::vector<Mesh>& meshes, u32 lod_id, f32 lod_threshold);
-			void get_mesh(FbxNodeAttribute* attribute, util::vector<Mesh>& meshes, u32 lod_id, f32 lod_treshold);
-			void get_lod_group(FbxNodeAttribute* attribute);
-			bool get_mesh_data(FbxMesh* fbx_mesh, Mesh& m);
+			bool prepare_mesh(MeshSource& source);
+			bool get_mesh_data(const MeshSource& source, Mesh& m, bool& has_normals, bool& has_tangents) const;
+			void extract_meshes(util::vector<LodSource>& lods, u32 first_lod, u32 lod_count, util::vector<util::vector<Mesh>>& meshes, bool& has_normals, bool& has_tangents);
+			void get_mesh_sources(FbxNode* node, util::vector<LodSource>& lods, LodSource& lod, u32 lod_id, f32 lod_threshold);
+			void get_lod_group_sources(FbxNodeAttribute* attribute, util::vector<LodSource>& lods);
 
 			Scene* _scene{ nullptr };
-			SceneData* _scene_data{ nullptr };
+			GeometryImportSettings _settings{};
 			FbxManager* _fbx_manager{ nullptr };
 			FbxScene* _fbx_scene{ nullptr };
 			Progression* _progression{ nullptr };
@@ -1,5 +1,8 @@
 #include "FBXImporter.h"
 #include "Geometry.h"
+#include "ContentCache.h"
+#include "ThreadPool.h"
+#include <filesystem>
 
 #if _DEBUG
 #pragma comment (lib, "../packages/FBX SDK/lib/x64/debug/libfbxsdk-md.lib")
@@ -16,6 +19,45 @@ namespace lightning::tools {
 	
 		std::mutex fbx_mutex{};
 
+		u64 get_cache_key(const char* file, const GeometryImportSettings& settings) {
+			if (!content_cache::is_enabled()) return 0;
+
+			content_cache::KeyBuilder builder{ content::AssetType::MESH };
+			if (!builder.add_file(file)) return 0;
+			builder.add(settings);
+
+			return builder.key();
+		}
+
+		bool load_from_cache(u64 key, SceneData& data) {
+			util::vector<u8> blob;
+			if (!key || !content_cache::load(key, blob)) return false;
+
+			data.buffer_size = (u32)blob.size();
+			data.buffer = (u8*)CoTaskMemAlloc(blob.size());
+			assert(data.buffer);
+			memcpy(data.buffer, blob.data(), blob.size());
+
+			return true;
+		}
+
+		void store_in_cache(u64 key, const SceneData& data) {
+			if (key && data.buffer && data.buffer_size) {
+				content_cache::store(key, data.buffer, data.buffer_size);
+			}
+		}
+
+		constexpr u32 stream_batch_size{ 256 };
+
+		// The FBX scene only has the name the importer gave it, so scenes are named after their file.
+		std::string get_scene_name(const char* file) {
+			return std::filesystem::path{ file }.stem().string();
+		}
+
+		const char* get_mesh_name(FbxMesh* fbx_mesh) {
+			FbxNode* const node{ fbx_mesh->GetNode() };
+			return (node->GetName()[0] != '\0') ? node->GetName() : fbx_mesh->GetName();
+		}
 	}
 
 	bool FbxContext::initialize_fbx() {
@@ -48,48 +90,217 @@ namespace lightning::tools {
 			if (!root) return;
 		}
 
+		// Only record where the meshes are, the extraction of all of them runs in parallel afterwards.
+		util::vector<LodSource> lods;
+		LodSource combined{};
+		const bool coalesce{ _settings.coalesce_meshes != 0 };
 		const s32 num_nodes{ root->GetChildCount() };
 
-		if (_scene_data->settings.coalesce_meshes) {
-			LodGroup lod{};
-
-			for (s32 i{ 0 }; i < num_nodes; ++i) {
-				FbxNode* node{ root->GetChild(i) };
-				
-				if (!node) continue;
+		for (s32 i{ 0 }; i < num_nodes; ++i) {
+			FbxNode* node{ root->GetChild(i) };
+			if (!node) continue;
 
-				get_meshes(node, lod.meshes, 0, -1.f);
+			if (coalesce) {
+				get_mesh_sources(node, lods, combined, 0, -1.f);
+				continue;
 			}
 
-			if (lod.meshes.size()) {
-				lod.name = lod.meshes[0].name;
+			LodSource lod{};
+			get_mesh_sources(node, lods, lod, 0, -1.f);
+			if (lod.meshes.size()) lods.emplace_back(lod);
+		}
+
+		if (combined.meshes.size()) lods.emplace_back(combined);
+
+		util::vector<util::vector<Mesh>> meshes;
+		bool has_normals{ true };
+		bool has_tangents{ true };
+		extract_meshes(lods, 0, (u32)lods.size(), meshes, has_normals, has_tangents);
+
+		// Normals and tangents are calculated for the whole scene when any mesh is missing them.
+		if (!has_normals) _settings.calculate_normals = true;
+		if (!has_tangents) _settings.calculate_tangents = true;
+
+		u32 num_meshes{ 0 };
+		for (const auto& lod_meshes : meshes) num_meshes += (u32)lod_meshes.size();
+		_progression->callback(_progression->value(), _progression->max_value() + num_meshes);
+
+		for (u32 i{ 0 }; i < lods.size(); ++i) {
+			if (meshes[i].empty()) continue;
+
+			LodGroup lod{};
+			lod.meshes = std::move(meshes[i]);
+			lod.name = lods[i].name.empty() ? lod.meshes[0].name : lods[i].name;
+
+			if (coalesce && i == lods.size() - 1 && combined.meshes.size()) {
 				Mesh combined_mesh{};
 
 				if (coalesce_meshes(lod, combined_mesh, _progression)) {
 					lod.meshes.clear();
 					lod.meshes.emplace_back(combined_mesh);
 				}
-
-				_scene->lod_groups.emplace_back(lod);
 			}
 
+			_scene->lod_groups.emplace_back(lod);
+		}
+	}
+
+	// Everything that modifies or evaluates the FBX scene runs here, the SDK isn't thread safe.
+	bool FbxContext::prepare_mesh(MeshSource& source) {
+		FbxMesh* fbx_mesh{ source.fbx_mesh };
+		assert(fbx_mesh);
+
+		if (fbx_mesh->RemoveBadPolygons() < 0) return false;
+
+		FbxGeometryConverter gc{ _fbx_manager };
+		fbx_mesh = (FbxMesh*)gc.Triangulate(fbx_mesh, true);
+		if (!fbx_mesh || fbx_mesh->RemoveBadPolygons() < 0) return false;
+
+		source.fbx_mesh = fbx_mesh;
+		source.has_normals = !_settings.calculate_normals && fbx_mesh->GenerateNormals();
+		if (!_settings.calculate_tangents) fbx_mesh->GenerateTangentsData();
+
+		FbxNode* const node{ fbx_mesh->GetNode() };
+		FbxAMatrix geometric_transform;
+
+		geometric_transform.SetT(node->GetGeometricTranslation(FbxNode::eSourcePivot));
+		geometric_transform.SetR(node->GetGeometricRotation(FbxNode::eSourcePivot));
+		geometric_transform.SetS(node->GetGeometricScaling(FbxNode::eSourcePivot));
+
+		// Coalesced meshes are merged into one, so they can only be baked into scene space.
+		if (_settings.coalesce_meshes) {
+			source.transform = node->EvaluateGlobalTransform() * geometric_transform;
+			source.placement.SetIdentity();
 		}
 		else {
-			for (s32 i{ 0 }; i < num_nodes; ++i) {
-				FbxNode* node{ root->GetChild(i) };
-				if (!node) continue;
-
-				LodGroup lod{};
-				get_meshes(node, lod.meshes, 0, -1.f);
-				if (lod.meshes.size()) {
-					lod.name = lod.meshes[0].name;
-					_scene->lod_groups.emplace_back(lod);
-				}
+			source.transform = geometric_transform;
+			source.placement = node->EvaluateGlobalTransform();
+		}
+
+		return true;
+	}
+
+	void FbxContext::extract_meshes(util::vector<LodSource>& lods, u32 first_lod, u32 lod_count, util::vector<util::vector<Mesh>>& meshes, bool& has_normals, bool& has_tangents) {
+		assert(first_lod + lod_count <= lods.size());
+
+		struct ExtractedMesh {
+			Mesh mesh;
+			const MeshSource* source;
+			u32 lod;
+			bool is_valid;
+			bool has_normals;
+			bool has_tangents;
+		};
+
+		u32 num_meshes{ 0 };
+		for (u32 i{ first_lod }; i < first_lod + lod_count; ++i) num_meshes += (u32)lods[i].meshes.size();
+
+		util::vector<ExtractedMesh> extracted(num_meshes);
+		u32 index{ 0 };
+
+		for (u32 i{ first_lod }; i < first_lod + lod_count; ++i) {
+			for (auto& source : lods[i].meshes) {
+				ExtractedMesh& item{ extracted[index++] };
+				item.source = &source;
+				item.lod = i - first_lod;
+				item.is_valid = prepare_mesh(source);
 			}
 		}
+
+		thread_pool::parallel_for(num_meshes, [&](u32 i) {
+			ExtractedMesh& item{ extracted[i] };
+			if (!item.is_valid) return;
+
+			item.is_valid = get_mesh_data(*item.source, item.mesh, item.has_normals, item.has_tangents);
+		});
+
+		// Merged in traversal order, so the result doesn't depend on scheduling.
+		meshes.clear();
+		meshes.resize(lod_count);
+
+		// Source lod ids count the recorded meshes, which includes the ones that failed to extract.
+		// Every LOD level is numbered by the index of its first extracted mesh instead.
+		util::vector<u32> source_lod_ids(lod_count, u32_invalid_id);
+		util::vector<u32> lod_ids(lod_count, u32_invalid_id);
+
+		for (auto& item : extracted) {
+			if (!item.is_valid) continue;
+
+			has_normals = has_normals && item.has_normals;
+			has_tangents = has_tangents && item.has_tangents;
+
+			util::vector<Mesh>& lod_meshes{ meshes[item.lod] };
+			if (source_lod_ids[item.lod] != item.source->lod_id) {
+				source_lod_ids[item.lod] = item.source->lod_id;
+				lod_ids[item.lod] = (u32)lod_meshes.size();
+			}
+
+			item.mesh.lod_id = lod_ids[item.lod];
+			lod_meshes.emplace_back(std::move(item.mesh));
+		}
 	}
 
-	void FbxContext::get_meshes(FbxNode* node, util::vector<Mesh>& meshes, u32 lod_id, f32 lod_threshold) {
+	void FbxContext::stream_scene(ScenePackStream& stream) {
+		assert(is_valid());
+		FbxNode* const root{ _fbx_scene->GetRootNode() };
+		if (!root) return;
+
+		// First pass only records where the meshes are, so nothing is extracted until it can be packed right away.
+		util::vector<LodSource> lods;
+		const s32 num_nodes{ root->GetChildCount() };
+
+		for (s32 i{ 0 }; i < num_nodes; ++i) {
+			FbxNode* node{ root->GetChild(i) };
+			if (!node) continue;
+
+			LodSource lod{};
+			get_mesh_sources(node, lods, lod, 0, -1.f);
+			if (lod.meshes.size()) {
+				lod.name = get_mesh_name(lod.meshes[0].fbx_mesh);
+				lods.emplace_back(lod);
+			}
+		}
+
+		u32 num_meshes{ 0 };
+		for (const auto& lod : lods) num_meshes += (u32)lod.meshes.size();
+		_progression->callback(0, num_meshes);
+
+		// LODs are extracted in batches, large enough to keep all threads busy and small enough to keep memory low.
+		// The settings can't change once the first batch is packed, so meshes without normals or tangents
+		// get them calculated on their own when they're packed, instead of switching the whole scene over.
+		util::vector<util::vector<Mesh>> meshes;
+		bool has_normals{ true };
+		bool has_tangents{ true };
+		u32 first_lod{ 0 };
+
+		while (first_lod < lods.size()) {
+			u32 lod_count{ 0 };
+			u32 batch_meshes{ 0 };
+
+			while (first_lod + lod_count < lods.size() && batch_meshes < stream_batch_size) {
+				batch_meshes += (u32)lods[first_lod + lod_count].meshes.size();
+				++lod_count;
+			}
+
+			extract_meshes(lods, first_lod, lod_count, meshes, has_normals, has_tangents);
+
+			for (u32 i{ 0 }; i < lod_count; ++i) {
+				const LodSource& lod{ lods[first_lod + i] };
+				stream.begin_lod(lod.name);
+
+				for (auto& m : meshes[i]) stream.add_mesh(m);
+
+				const u32 failed{ (u32)(lod.meshes.size() - meshes[i].size()) };
+				if (failed) _progression->callback(_progression->value(), _progression->max_value() - failed);
+
+				stream.end_lod();
+			}
+
+			first_lod += lod_count;
+		}
+	}
+
+	void FbxContext::get_mesh_sources(FbxNode* node, util::vector<LodSource>& lods, LodSource& lod, u32 lod_id, f32 lod_threshold) {
 		assert(node && lod_id != u32_invalid_id);
 		bool is_lod_group{ false };
 
@@ -99,10 +310,10 @@ namespace lightning::tools {
 				const FbxNodeAttribute::EType attribute_type{ attribute->GetAttributeType() };
 
 				if (attribute_type == FbxNodeAttribute::eMesh) {
-					get_mesh(attribute, meshes, lod_id, lod_threshold);
+					lod.meshes.emplace_back(MeshSource{ (FbxMesh*)attribute, lod_id, lod_threshold });
 				}
 				else if (attribute_type == FbxNodeAttribute::eLODGroup) {
-					get_lod_group(attribute);
+					get_lod_group_sources(attribute, lods);
 					is_lod_group = true;
 				}
 			}
@@ -111,40 +322,18 @@ namespace lightning::tools {
 		if (!is_lod_group) {
 			if (const s32 num_children{ node->GetChildCount() }) {
 				for (s32 i{ 0 }; i < num_children; ++i) {
-					get_meshes(node->GetChild(i), meshes, lod_id, lod_threshold);
+					get_mesh_sources(node->GetChild(i), lods, lod, lod_id, lod_threshold);
 				}
 			}
 		}
 	}
 
-	void FbxContext::get_mesh(FbxNodeAttribute* attribute, util::vector<Mesh>& meshes, u32 lod_id, f32 lod_treshold) {
-		assert(attribute);
-
-		FbxMesh* fbx_mesh{ (FbxMesh*)attribute };
-		if (fbx_mesh->RemoveBadPolygons() < 0) return;
-
-		FbxGeometryConverter gc{ _fbx_manager };
-		fbx_mesh = (FbxMesh*)gc.Triangulate(fbx_mesh, true);
-		if (!fbx_mesh || fbx_mesh->RemoveBadPolygons() < 0) return;
-
-		FbxNode* const node{ fbx_mesh->GetNode() };
-
-		Mesh m;
-		m.lod_id = lod_id;
-		m.lod_threshold = lod_treshold;
-		m.name = (node->GetName()[0] != '\0') ? node->GetName() : fbx_mesh->GetName();
-		if (get_mesh_data(fbx_mesh, m)) {
-			meshes.emplace_back(m);
-			_progression->callback(_progression->value(), _progression->max_value() + 1);
-		}
-	}
-
-	void FbxContext::get_lod_group(FbxNodeAttribute* attribute) {
+	void FbxContext::get_lod_group_sources(FbxNodeAttribute* attribute, util::vector<LodSource>& lods) {
 		assert(attribute);
 
 		FbxLODGroup* lod_grp{ (FbxLODGroup*)attribute };
 		FbxNode* const node{ lod_grp->GetNode() };
-		LodGroup lod{};
+		LodSource lod{};
 		lod.name = (node->GetName()[0] != '\0' ? node->GetName() : lod_grp->GetName());
 
 		const s32 num_nodes{ node->GetChildCount() };
@@ -158,25 +347,33 @@ namespace lightning::tools {
 				lod_grp->GetThreshold(i - 1, threshold);
 				lod_threshold = threshold.value() * _scene_scale;
 			}
-			get_meshes(node->GetChild(i), lod.meshes, (u32)lod.meshes.size(), lod_threshold);
+			get_mesh_sources(node->GetChild(i), lods, lod, (u32)lod.meshes.size(), lod_threshold);
 		}
 
-		if (lod.meshes.size()) _scene->lod_groups.emplace_back(lod);
+		if (lod.meshes.size()) lods.emplace_back(lod);
 	}
 
-	bool FbxContext::get_mesh_data(FbxMesh* fbx_mesh, Mesh& m) {
+	bool FbxContext::get_mesh_data(const MeshSource& source, Mesh& m, bool& has_normals, bool& has_tangents) const {
+		FbxMesh* const fbx_mesh{ source.fbx_mesh };
 		assert(fbx_mesh);
 
-		FbxNode* const node{ fbx_mesh->GetNode() };
-		FbxAMatrix geometric_transform;
-
-		geometric_transform.SetT(node->GetGeometricTranslation(FbxNode::eSourcePivot));
-		geometric_transform.SetR(node->GetGeometricRotation(FbxNode::eSourcePivot));
-		geometric_transform.SetS(node->GetGeometricScaling(FbxNode::eSourcePivot));
+		m.lod_id = source.lod_id;
+		m.lod_threshold = source.lod_threshold;
+		m.name = get_mesh_name(fbx_mesh);
 
-		FbxAMatrix transform{ node->EvaluateGlobalTransform() * geometric_transform };
+		const FbxAMatrix& transform{ source.transform };
 		FbxAMatrix inverse_transpose{ transform.Inverse().Transpose() };
 
+		for (u32 row{ 0 }; row < 4; ++row) {
+			for (u32 column{ 0 }; column < 4; ++column) {
+				m.transform.m[row][column] = (f32)source.placement.Get(row, column);
+			}
+		}
+
+		m.transform._41 *= _scene_scale;
+		m.transform._42 *= _scene_scale;
+		m.transform._43 *= _scene_scale;
+
 		const s32 num_polys{ fbx_mesh->GetPolygonCount() };
 		if (num_polys <= 0) return false;
 
@@ -218,13 +415,15 @@ namespace lightning::tools {
 			}
 		}
 
-		const bool import_normals{ !_scene_data->settings.calculate_normals };
-		const bool import_tangents{ !_scene_data->settings.calculate_tangents };
+		const bool import_normals{ !_settings.calculate_normals };
+		const bool import_tangents{ !_settings.calculate_tangents };
+		has_normals = true;
+		has_tangents = true;
 
 		if (import_normals) {
 			FbxArray<FbxVector4> normals;
 
-			if (fbx_mesh->GenerateNormals() && fbx_mesh->GetPolygonVertexNormals(normals) && normals.Size() > 0) {
+			if (source.has_normals && fbx_mesh->GetPolygonVertexNormals(normals) && normals.Size() > 0) {
 				const s32 num_normals{ normals.Size() };
 				for (s32 i{ 0 }; i < num_normals; ++i) {
 					FbxVector4 n{ inverse_transpose.MultT(normals[i]) };
@@ -233,13 +432,12 @@ namespace lightning::tools {
 				}
 			}
 			else {
-				_scene_data->settings.calculate_normals = true;
+				has_normals = false;
 			}
 		}
 
 		if (import_tangents) {
 			FbxLayerElementArrayTemplate<FbxVector4>* tangents{ nullptr };
-			fbx_mesh->GenerateTangentsData();
 
 			if (fbx_mesh->GetTangents(&tangents) && tangents && tangents->GetCount() == m.raw_indicies.size()) {
 				const s32 num_tangents{ tangents->GetCount() };
@@ -253,7 +451,7 @@ namespace lightning::tools {
 				}
 			}
 			else {
-				_scene_data->settings.calculate_tangents = true;
+				has_tangents = false;
 			}
 		}
 
@@ -278,8 +476,15 @@ namespace lightning::tools {
 
 	EDITOR_INTERFACE void import_fbx(const char* file, SceneData* data, Progression::progress_callback callback) {
 		assert(file && data);
+
+		const u64 cache_key{ get_cache_key(file, data->settings) };
+		if (load_from_cache(cache_key, *data)) return;
+
 		Scene scene{};
+		scene.name = get_scene_name(file);
 		Progression progression{ callback };
+		// The caller's settings stay as they are, so a cache hit returns the same settings as an import.
+		GeometryImportSettings settings{ data->settings };
 
 		{
 			std::lock_guard lock{ fbx_mutex };
@@ -287,6 +492,7 @@ namespace lightning::tools {
 			FbxContext fbx_context{ file, &scene, data, &progression };
 			if (fbx_context.is_valid()) {
 				fbx_context.get_scene();
+				settings = fbx_context.settings();
 			}
 		}
 		
@@ -294,7 +500,37 @@ namespace lightning::tools {
 			return;
 		}
 
-		process_scene(scene, data->settings, &progression);
+		process_scene(scene, settings, &progression);
 		pack_data(scene, *data);
+		store_in_cache(cache_key, *data);
+	}
+
+	EDITOR_INTERFACE void import_fbx_streaming(const char* file, SceneData* data, Progression::progress_callback callback) {
+		assert(file && data);
+
+		// Coalescing needs every mesh of a LOD at once, which defeats streaming.
+		if (data->settings.coalesce_meshes) {
+			import_fbx(file, data, callback);
+			return;
+		}
+
+		const u64 cache_key{ get_cache_key(file, data->settings) };
+		if (load_from_cache(cache_key, *data)) return;
+
+		Scene scene{};
+		scene.name = get_scene_name(file);
+		Progression progression{ callback };
+		{
+			std::lock_guard lock{ fbx_mutex };
+
+			FbxContext fbx_context{ file, &scene, data, &progression };
+			if (!fbx_context.is_valid()) return;
+
+			ScenePackStream stream{ scene.name, *data, &progression };
+			fbx_context.stream_scene(stream);
+			stream.finish();
+		}
+
+		store_in_cache(cache_key, *data);
 	}
 }
\ No newline at end of file
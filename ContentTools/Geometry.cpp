@@ -1,6 +1,9 @@
 #include "Geometry.h"
+#include "ContentCache.h"
 #include "../packages/MikkTSpace/mikktspace.h"
 #include "Utilities/IOStream.h"
+#include <DirectXPackedVector.h>
+#include <DirectXCollision.h>
 
 namespace lightning::tools {
 	namespace {
@@ -8,6 +11,10 @@ namespace lightning::tools {
 		using namespace math;
 		using namespace DirectX;
 
+		static_assert((u32)elements::ElementsType::QUANTIZED_POSITION == (u32)content::ElementsFlags::QUANTIZED_POSITION);
+		static_assert((u32)elements::ElementsType::HALF_UV == (u32)content::ElementsFlags::HALF_UV);
+		static_assert(sizeof(elements::QuantizedPosition) == sizeof(u16) * 4);
+
 		s32 mikk_get_num_faces(const SMikkTSpaceContext* context) {
 			const Mesh& m{ *(Mesh*)(context->m_pUserData) };
 			return (s32)m.indicies.size() / 3;
@@ -291,9 +298,10 @@ namespace lightning::tools {
 		u64 get_vertex_elements_size(elements::ElementsType::Type elements_type) {
 			using namespace elements;
 
-			switch (elements_type) {
+			switch (elements_type & ElementsType::LAYOUT_MASK) {
 				case ElementsType::STATIC_NORMAL: return sizeof(StaticNormal);
 				case ElementsType::STATIC_NORMAL_TEXTURE: return sizeof(StaticNormalTexture);
+				case ElementsType::STATIC_NORMAL_TEXTURE_HALF_UV: return sizeof(StaticNormalTextureHalfUV);
 				case ElementsType::STATIC_COLOR: return sizeof(StaticColor);
 				case ElementsType::SKELETAL: return sizeof(Skeletal);
 				case ElementsType::SKELETAL_COLOR: return sizeof(SkeletalColor);
@@ -301,6 +309,8 @@ namespace lightning::tools {
 				case ElementsType::SKELETAL_NORMAL_COLOR: return sizeof(SkeletalNormalColor);
 				case ElementsType::SKELETAL_NORMAL_TEXTURE: return sizeof(SkeletalNormalTexture);
 				case ElementsType::SKELETAL_NORMAL_TEXTURE_COLOR: return sizeof(SkeletalNormalTextureColor);
+				case ElementsType::SKELETAL_NORMAL_TEXTURE_HALF_UV: return sizeof(SkeletalNormalTextureHalfUV);
+				case ElementsType::SKELETAL_NORMAL_TEXTURE_COLOR_HALF_UV: return sizeof(SkeletalNormalTextureColorHalfUV);
 				default: return 0;
 			}
 		}
@@ -309,11 +319,35 @@ namespace lightning::tools {
 			const u32 num_verticies{ (u32)m.verticies.size() };
 			assert(num_verticies);
 
-			m.position_buffer.resize(sizeof(math::v3) * num_verticies);
-			math::v3* const position_buffer{ (math::v3* const)m.position_buffer.data() };
+			m.position_buffer.resize(content::get_position_buffer_size(m.elements_type, num_verticies));
 
-			for (u32 i{ 0 }; i < num_verticies; ++i) {
-				position_buffer[i] = m.verticies[i].position;
+			if (m.elements_type & elements::ElementsType::QUANTIZED_POSITION) {
+				const XMVECTOR center{ XMLoadFloat3(&m.bounds.aabb_center) };
+				const XMVECTOR half_extent{ XMLoadFloat3(&m.bounds.aabb_extents) };
+				const XMVECTOR min{ XMVectorSubtract(center, half_extent) };
+				const XMVECTOR extent{ XMVectorAdd(half_extent, half_extent) };
+				// NOTE: flat axes get a zero scale, so every vertex decodes to min on that axis.
+				const XMVECTOR inv_extent{ XMVectorSelect(XMVectorReciprocal(extent), XMVectorZero(), XMVectorLessOrEqual(extent, XMVectorReplicate(EPSILON))) };
+
+				content::QuantizedPositionHeader* const header{ (content::QuantizedPositionHeader* const)m.position_buffer.data() };
+				*header = {};
+				XMStoreFloat3(&header->min, min);
+				XMStoreFloat3(&header->extent, extent);
+
+				elements::QuantizedPosition* const position_buffer{ (elements::QuantizedPosition* const)&header[1] };
+				for (u32 i{ 0 }; i < num_verticies; ++i) {
+					const XMVECTOR p{ XMVectorSaturate(XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&m.verticies[i].position), min), inv_extent)) };
+					v3 unit{};
+					XMStoreFloat3(&unit, p);
+					position_buffer[i] = { (u16)pack_unit_float<16>(unit.x), (u16)pack_unit_float<16>(unit.y), (u16)pack_unit_float<16>(unit.z), 0 };
+				}
+			}
+			else {
+				math::v3* const position_buffer{ (math::v3* const)m.position_buffer.data() };
+
+				for (u32 i{ 0 }; i < num_verticies; ++i) {
+					position_buffer[i] = m.verticies[i].position;
+				}
 			}
 
 			struct u16v2 { u16 x, y; };
@@ -323,6 +357,15 @@ namespace lightning::tools {
 			util::vector<u16v2> normals{ num_verticies };
 			util::vector<u16v2> tangents{ num_verticies };
 			util::vector<u8v3> joint_weights{ num_verticies };
+			util::vector<u16v2> half_uvs{};
+
+			if (m.elements_type & elements::ElementsType::HALF_UV) {
+				half_uvs.resize(num_verticies);
+				for (u32 i{ 0 }; i < num_verticies; ++i) {
+					const v2& uv{ m.verticies[i].uv };
+					half_uvs[i] = { PackedVector::XMConvertFloatToHalf(uv.x), PackedVector::XMConvertFloatToHalf(uv.y) };
+				}
+			}
 
 			if (m.elements_type & elements::ElementsType::STATIC_NORMAL) {
 				for (u32 i{ 0 }; i < num_verticies; ++i) {
@@ -361,7 +404,7 @@ namespace lightning::tools {
 
 			using namespace elements;
 
-			switch (m.elements_type) {
+			switch (m.elements_type & ElementsType::LAYOUT_MASK) {
 				case ElementsType::STATIC_COLOR: {
 					StaticColor* const element_buffer{ (StaticColor* const)m.element_buffer.data() };
 					for (u32 i{ 0 }; i < num_verticies; ++i) {
@@ -395,6 +438,21 @@ namespace lightning::tools {
 				}
 				break;
 
+				case ElementsType::STATIC_NORMAL_TEXTURE_HALF_UV: {
+					StaticNormalTextureHalfUV* const element_buffer{ (StaticNormalTextureHalfUV* const)m.element_buffer.data() };
+					for (u32 i{ 0 }; i < num_verticies; ++i) {
+						Vertex& v{ m.verticies[i] };
+						element_buffer[i] = {
+							{ v.red, v.green, v.blue },
+							t_signs[i],
+							{ normals[i].x, normals[i].y },
+							{ tangents[i].x, tangents[i].y },
+							{ half_uvs[i].x, half_uvs[i].y }
+						};
+					}
+				}
+				break;
+
 				case ElementsType::SKELETAL: {
 					Skeletal* const element_buffer{ (Skeletal* const)m.element_buffer.data() };
 					for (u32 i{ 0 }; i < num_verticies; ++i) {
@@ -492,6 +550,42 @@ namespace lightning::tools {
 					}
 				}
 				break;
+
+				case ElementsType::SKELETAL_NORMAL_TEXTURE_HALF_UV: {
+					SkeletalNormalTextureHalfUV* const element_buffer{ (SkeletalNormalTextureHalfUV* const)m.element_buffer.data() };
+					for (u32 i{ 0 }; i < num_verticies; ++i) {
+						Vertex& v{ m.verticies[i] };
+						const u16 indicies[4]{ (u16)v.joint_indicies.x, (u16)v.joint_indicies.y, (u16)v.joint_indicies.z, (u16)v.joint_indicies.w };
+						element_buffer[i] = {
+							{ joint_weights[i].x, joint_weights[i].y, joint_weights[i].z },
+							t_signs[i],
+							{ indicies[0], indicies[1], indicies[2], indicies[3] },
+							{ normals[i].x, normals[i].y },
+							{ tangents[i].x, tangents[i].y },
+							{ half_uvs[i].x, half_uvs[i].y }
+						};
+					}
+				}
+				break;
+
+				case ElementsType::SKELETAL_NORMAL_TEXTURE_COLOR_HALF_UV: {
+					SkeletalNormalTextureColorHalfUV* const element_buffer{ (SkeletalNormalTextureColorHalfUV* const)m.element_buffer.data() };
+					for (u32 i{ 0 }; i < num_verticies; ++i) {
+						Vertex& v{ m.verticies[i] };
+						const u16 indicies[4]{ (u16)v.joint_indicies.x, (u16)v.joint_indicies.y, (u16)v.joint_indicies.z, (u16)v.joint_indicies.w };
+						element_buffer[i] = {
+							{ joint_weights[i].x, joint_weights[i].y, joint_weights[i].z },
+							t_signs[i],
+							{ indicies[0], indicies[1], indicies[2], indicies[3] },
+							{ normals[i].x, normals[i].y },
+							{ tangents[i].x, tangents[i].y },
+							{ half_uvs[i].x, half_uvs[i].y },
+							{ v.red, v.green, v.blue },
+							{}
+						};
+					}
+				}
+				break;
 			}
 		}
 
@@ -517,6 +611,73 @@ namespace lightning::tools {
 			return type;
 		}
 
+		content::GeometryBounds bounds_from_collision(const BoundingBox& box, const BoundingSphere& sphere) {
+			return { box.Center, box.Extents, sphere.Center, sphere.Radius };
+		}
+
+		void calculate_bounds(Mesh& m) {
+			assert(m.verticies.size());
+			BoundingBox box{};
+			BoundingSphere sphere{};
+			BoundingBox::CreateFromPoints(box, m.verticies.size(), &m.verticies[0].position, sizeof(Vertex));
+			BoundingSphere::CreateFromPoints(sphere, m.verticies.size(), &m.verticies[0].position, sizeof(Vertex));
+			m.bounds = bounds_from_collision(box, sphere);
+		}
+
+		// Verticies stay in mesh space, the bounds are moved to where the mesh is placed in the scene.
+		void place_bounds(Mesh& m) {
+			BoundingBox box{ m.bounds.aabb_center, m.bounds.aabb_extents };
+			BoundingSphere sphere{ m.bounds.sphere_center, m.bounds.sphere_radius };
+			const XMMATRIX transform{ XMLoadFloat4x4(&m.transform) };
+			box.Transform(box, transform);
+			sphere.Transform(sphere, transform);
+			m.bounds = bounds_from_collision(box, sphere);
+		}
+
+		void merge_bounds(content::GeometryBounds& bounds, const content::GeometryBounds& other) {
+			BoundingBox box{ bounds.aabb_center, bounds.aabb_extents };
+			BoundingSphere sphere{ bounds.sphere_center, bounds.sphere_radius };
+			BoundingBox::CreateMerged(box, box, BoundingBox{ other.aabb_center, other.aabb_extents });
+			BoundingSphere::CreateMerged(sphere, sphere, BoundingSphere{ other.sphere_center, other.sphere_radius });
+			bounds = bounds_from_collision(box, sphere);
+		}
+
+		void calculate_bounds(LodGroup& lod) {
+			if (lod.meshes.empty()) return;
+
+			lod.bounds = lod.meshes[0].bounds;
+
+			for (u32 i{ 1 }; i < lod.meshes.size(); ++i) {
+				merge_bounds(lod.bounds, lod.meshes[i].bounds);
+			}
+		}
+
+		template<typename T> void release_vector(util::vector<T>& v) {
+			util::vector<T> empty{};
+			v.swap(empty);
+		}
+
+		// Source streams are baked into m.verticies by now and nothing reads them after this point.
+		void release_source_data(Mesh& m) {
+			release_vector(m.positions);
+			release_vector(m.normals);
+			release_vector(m.tangents);
+			release_vector(m.colors);
+			release_vector(m.uv_sets);
+			release_vector(m.material_indicies);
+			release_vector(m.raw_indicies);
+		}
+
+		elements::ElementsType::Type apply_vertex_compression(elements::ElementsType::Type type, const GeometryImportSettings& settings) {
+			using namespace elements;
+
+			u32 flags{ type };
+			if (settings.quantize_positions) flags |= ElementsType::QUANTIZED_POSITION;
+			if (settings.half_precision_uvs && (type & ElementsType::STATIC_NORMAL_TEXTURE) == ElementsType::STATIC_NORMAL_TEXTURE) flags |= ElementsType::HALF_UV;
+
+			return (ElementsType::Type)flags;
+		}
+
 		void process_verticies(Mesh& m, const GeometryImportSettings& settings) {
 			assert((m.raw_indicies.size() % 3) == 0);
 			if (settings.calculate_normals || m.normals.empty()) {
@@ -537,35 +698,51 @@ namespace lightning::tools {
 				process_tangents(m);
 			}
 
-			m.elements_type = determine_elements_type(m);
+			m.elements_type = apply_vertex_compression(determine_elements_type(m), settings);
+			calculate_bounds(m);
+			release_source_data(m);
 			pack_verticies(m);
+			place_bounds(m);
 		}
-		u64 get_mesh_size(const Mesh& m) {
+		u64 get_geometry_size(const Mesh& m) {
 			const u64 num_verticies{ m.verticies.size() };
 			const u64 position_buffer_size{ m.position_buffer.size() };
-			assert(position_buffer_size == sizeof(math::v3) * num_verticies);
+			assert(position_buffer_size == content::get_position_buffer_size(m.elements_type, (u32)num_verticies));
 			const u64 element_buffer_size{ m.element_buffer.size() };
 			assert(element_buffer_size == get_vertex_elements_size(m.elements_type) * num_verticies);
 			const u64 index_size{ (num_verticies < (1 << 16)) ? sizeof(u16) : sizeof(u32) };
 			const u64 index_buffer_size{ index_size * m.indicies.size() };
 			constexpr u64 su32{ sizeof(u32) };
 			const u64 size{
-				su32 +					// name length
-				m.name.size() +			// mesh name string size
-				su32 +					// lod id
 				su32 +					// vertex element size
 				su32 +					// element type enum
 				su32 +					// number of verticies
 				su32 +					// index size (16 bit || 32 bit)
 				su32 +					// number of indicies
-				sizeof(f32) +			// LOD threshold
-				position_buffer_size +	// room for vertex positions
+				position_buffer_size +	// room for vertex positions (plus decode header when quantized)
 				element_buffer_size +	// room for vertex elements
 				index_buffer_size		// room for indicies
 			};
 			return size;
 		}
 
+		u64 get_mesh_size(const Mesh& m) {
+			constexpr u64 su32{ sizeof(u32) };
+			u64 size{
+				su32 +					// name length
+				m.name.size() +			// mesh name string size
+				su32 +					// lod id
+				su32 +					// source mesh (u32_invalid_id when the geometry follows)
+				sizeof(math::m4x4) +	// placement of the mesh in the scene
+				sizeof(f32) +			// LOD threshold
+				sizeof(content::GeometryBounds)	// AABB and bounding sphere, in scene space
+			};
+
+			if (m.source_mesh == u32_invalid_id) size += get_geometry_size(m);
+
+			return size;
+		}
+
 		u64 get_scene_size(const Scene& scene) {
 			constexpr u64 su32{ sizeof(u32) };
 			u64 size{
@@ -578,7 +755,8 @@ namespace lightning::tools {
 				u64 lod_size{
 					su32 +				// LOD name length
 					lod.name.size() +	// LOD name string size
-					su32				// number of mashes in this LOD
+					su32 +				// number of mashes in this LOD
+					sizeof(content::GeometryBounds)	// LOD AABB and bounding sphere
 				};
 
 				for (const auto& m : lod.meshes) {
@@ -589,12 +767,7 @@ namespace lightning::tools {
 			return size;
 		}
 
-		void pack_mesh_data(const Mesh& m, util::BlobStreamWriter& blob) {
-
-			blob.write((u32)m.name.size());
-			blob.write(m.name.c_str(), m.name.size());
-			blob.write(m.lod_id);
-
+		void pack_geometry_data(const Mesh& m, util::BlobStreamWriter& blob) {
 			const u32 elements_size{ (u32)get_vertex_elements_size(m.elements_type) };
 			blob.write(elements_size);
 			blob.write((u32)m.elements_type);
@@ -608,9 +781,7 @@ namespace lightning::tools {
 			const u32 num_indicies{ (u32)m.indicies.size() };
 			blob.write(num_indicies);
 
-			blob.write(m.lod_threshold);
-
-			assert(m.position_buffer.size() == sizeof(math::v3) * num_verticies);
+			assert(m.position_buffer.size() == content::get_position_buffer_size(m.elements_type, num_verticies));
 			blob.write(m.position_buffer.data(), m.position_buffer.size());
 
 			assert(m.element_buffer.size() == elements_size * num_verticies);
@@ -627,10 +798,81 @@ namespace lightning::tools {
 			blob.write(data, index_buffer_size);
 		}
 
+		void pack_mesh_data(const Mesh& m, util::BlobStreamWriter& blob) {
+
+			blob.write((u32)m.name.size());
+			blob.write(m.name.c_str(), m.name.size());
+			blob.write(m.lod_id);
+			blob.write(m.source_mesh);
+			blob.write((const u8*)&m.transform, sizeof(math::m4x4));
+			blob.write(m.lod_threshold);
+			blob.write((const u8*)&m.bounds, sizeof(content::GeometryBounds));
+
+			if (m.source_mesh == u32_invalid_id) pack_geometry_data(m, blob);
+		}
+
+		u64 get_geometry_key(const Mesh& m) {
+			content_cache::KeyBuilder builder{ content::AssetType::MESH };
+			builder.add((u32)m.elements_type);
+			builder.add((u32)m.verticies.size());
+			builder.add(m.position_buffer.data(), m.position_buffer.size());
+			builder.add(m.element_buffer.data(), m.element_buffer.size());
+			builder.add(m.indicies.data(), m.indicies.size() * sizeof(u32));
+
+			return builder.key();
+		}
+
+		template<typename T> bool is_equal_pod(const util::vector<T>& a, const util::vector<T>& b) {
+			return a.size() == b.size() && (a.empty() || !memcmp(a.data(), b.data(), a.size() * sizeof(T)));
+		}
+
+		bool has_same_geometry(const Mesh& a, const Mesh& b) {
+			return a.elements_type == b.elements_type && a.verticies.size() == b.verticies.size() &&
+				is_equal_pod(a.position_buffer, b.position_buffer) && is_equal_pod(a.element_buffer, b.element_buffer) && is_equal_pod(a.indicies, b.indicies);
+		}
+
+		// Meshes with the same packed geometry are stored once, the others only keep their placement.
+		void share_identical_geometry(Scene& scene) {
+			struct UniqueGeometry {
+				const Mesh* mesh;
+				u32 index;
+			};
+
+			std::unordered_multimap<u64, UniqueGeometry> geometries;
+			u32 mesh_index{ 0 };
+
+			for (auto& lod : scene.lod_groups) {
+				for (auto& m : lod.meshes) {
+					const u64 key{ get_geometry_key(m) };
+					const auto range{ geometries.equal_range(key) };
+
+					for (auto it{ range.first }; it != range.second; ++it) {
+						if (has_same_geometry(m, *it->second.mesh)) {
+							m.source_mesh = it->second.index;
+							break;
+						}
+					}
+
+					if (m.source_mesh == u32_invalid_id) {
+						geometries.emplace(key, UniqueGeometry{ &m, mesh_index });
+					}
+					else {
+						release_vector(m.verticies);
+						release_vector(m.indicies);
+						release_vector(m.position_buffer);
+						release_vector(m.element_buffer);
+					}
+
+					++mesh_index;
+				}
+			}
+		}
+
 		bool split_meshes_by_material(u32 material_idx, const Mesh& m, Mesh& submesh) {
 			submesh.name = m.name;
 			submesh.lod_threshold = m.lod_threshold;
 			submesh.lod_id = m.lod_id;
+			submesh.transform = m.transform;
 			submesh.material_used.emplace_back(material_idx);
 			submesh.uv_sets.resize(m.uv_sets.size());
 
@@ -671,6 +913,21 @@ namespace lightning::tools {
 			return !submesh.raw_indicies.empty();
 		}
 
+		void split_meshes_by_material(Mesh& m, util::vector<Mesh>& new_meshes) {
+			const u32 num_materials{ (u32)m.material_used.size() };
+			if (num_materials > 1) {
+				for (u32 i{ 0 }; i < num_materials; ++i) {
+					Mesh submesh{};
+					if (split_meshes_by_material(m.material_used[i], m, submesh)) {
+						new_meshes.emplace_back(std::move(submesh));
+					}
+				}
+			}
+			else {
+				new_meshes.emplace_back(std::move(m));
+			}
+		}
+
 		void split_meshes_by_material(Scene& scene, Progression* const progression) {
 			assert(progression);
 			progression->callback(0, 0);
@@ -678,19 +935,8 @@ namespace lightning::tools {
 			for (auto& lod : scene.lod_groups) {
 				util::vector<Mesh> new_meshes;
 
-				for (const auto& m : lod.meshes) {
-					const u32 num_materials{ (u32)m.material_used.size() };
-					if (num_materials > 1) {
-						for (u32 i{ 0 }; i < num_materials; ++i) {
-							Mesh submesh{};
-							if (split_meshes_by_material(m.material_used[i], m, submesh)) {
-								new_meshes.emplace_back(submesh);
-							}
-						}
-					}
-					else {
-						new_meshes.emplace_back(m);
-					}
+				for (auto& m : lod.meshes) {
+					split_meshes_by_material(m, new_meshes);
 				}
 				progression->callback(progression->value(), progression->max_value() + (u32)new_meshes.size());
 				new_meshes.swap(lod.meshes);
@@ -715,6 +961,21 @@ namespace lightning::tools {
 				process_verticies(m, settings);
 				progression->callback(progression->value() + 1, progression->max_value());
 			}
+			calculate_bounds(lod);
+		}
+
+		share_identical_geometry(scene);
+	}
+
+	void process_prebuilt_scene(Scene& scene, const GeometryImportSettings& settings) {
+		for (auto& lod : scene.lod_groups) {
+			for (auto& m : lod.meshes) {
+				assert(m.verticies.size() && m.indicies.size());
+				m.elements_type = apply_vertex_compression(elements::ElementsType::STATIC_NORMAL_TEXTURE, settings);
+				calculate_bounds(m);
+				pack_verticies(m);
+			}
+			calculate_bounds(lod);
 		}
 	}
 
@@ -736,6 +997,7 @@ namespace lightning::tools {
 			blob.write(lod.name.c_str(), lod.name.size());
 
 			blob.write((u32)lod.meshes.size());
+			blob.write((const u8*)&lod.bounds, sizeof(content::GeometryBounds));
 
 			for (const auto& m : lod.meshes) {
 				pack_mesh_data(m, blob);
@@ -744,6 +1006,141 @@ namespace lightning::tools {
 		assert(scene_size == blob.offset());
 	}
 
+	ScenePackStream::ScenePackStream(const std::string& scene_name, SceneData& data, Progression* const progression) : _data{ data }, _progression{ progression } {
+		assert(_progression);
+		const u64 size{ sizeof(u32) + scene_name.size() + sizeof(u32) };
+		util::BlobStreamWriter blob{ reserve(size), size };
+
+		blob.write((u32)scene_name.size());
+		blob.write(scene_name.c_str(), scene_name.size());
+		blob.write(0u);		// number of LODs, patched in finish()
+	}
+
+	ScenePackStream::~ScenePackStream() {
+		if (_buffer) CoTaskMemFree(_buffer);
+	}
+
+	u8* ScenePackStream::reserve(u64 size) {
+		if (_size + size > _capacity) {
+			u64 new_capacity{ std::max(_capacity + (_capacity >> 1), _size + size) };
+			new_capacity = std::max(new_capacity, (u64)(1 << 20));
+			_buffer = (u8*)CoTaskMemRealloc(_buffer, new_capacity);
+			assert(_buffer);
+			_capacity = new_capacity;
+		}
+
+		u8* const at{ &_buffer[_size] };
+		_size += size;
+		return at;
+	}
+
+	void ScenePackStream::begin_lod(const std::string& name) {
+		assert(!_lod_open);
+		_lod_open = true;
+		_lod_offset = _size;
+		_lod_mesh_count = 0;
+		_lod_bounds = {};
+
+		const u64 size{ sizeof(u32) + name.size() + sizeof(u32) + sizeof(content::GeometryBounds) };
+		util::BlobStreamWriter blob{ reserve(size), size };
+
+		blob.write((u32)name.size());
+		blob.write(name.c_str(), name.size());
+		blob.write(0u);		// number of meshes, patched in end_lod()
+		blob.skip(sizeof(content::GeometryBounds));
+	}
+
+	void ScenePackStream::add_mesh(Mesh& m) {
+		assert(_lod_open);
+		util::vector<Mesh> meshes;
+		split_meshes_by_material(m, meshes);
+		m = {};
+
+		if (meshes.size() > 1) {
+			_progression->callback(_progression->value(), _progression->max_value() + (u32)meshes.size() - 1);
+		}
+
+		for (auto& submesh : meshes) {
+			process_verticies(submesh, _data.settings);
+
+			const u64 key{ get_geometry_key(submesh) };
+			const u64 mesh_offset{ _size };
+			const u64 size{ get_mesh_size(submesh) };
+			util::BlobStreamWriter blob{ reserve(size), size };
+			pack_mesh_data(submesh, blob);
+			assert(blob.offset() == size);
+
+			// Identical geometry that was already packed is referenced instead of stored again.
+			const u64 geometry_size{ get_geometry_size(submesh) };
+			const u64 geometry_offset{ mesh_offset + size - geometry_size };
+			const auto range{ _geometries.equal_range(key) };
+			auto match{ range.second };
+
+			for (auto it{ range.first }; it != range.second; ++it) {
+				if (it->second.size == geometry_size && !memcmp(&_buffer[it->second.offset], &_buffer[geometry_offset], geometry_size)) {
+					match = it;
+					break;
+				}
+			}
+
+			if (match != range.second) {
+				_size = mesh_offset;
+				submesh.source_mesh = match->second.mesh_index;
+				const u64 instance_size{ get_mesh_size(submesh) };
+				util::BlobStreamWriter instance_blob{ reserve(instance_size), instance_size };
+				pack_mesh_data(submesh, instance_blob);
+				assert(instance_blob.offset() == instance_size);
+			}
+			else {
+				_geometries.emplace(key, PackedGeometry{ geometry_offset, geometry_size, _mesh_count });
+			}
+			++_mesh_count;
+
+			if (_lod_mesh_count) merge_bounds(_lod_bounds, submesh.bounds);
+			else _lod_bounds = submesh.bounds;
+			++_lod_mesh_count;
+
+			submesh = {};
+			_progression->callback(_progression->value() + 1, _progression->max_value());
+		}
+	}
+
+	void ScenePackStream::end_lod() {
+		assert(_lod_open);
+		_lod_open = false;
+
+		if (!_lod_mesh_count) {
+			_size = _lod_offset;
+			return;
+		}
+
+		util::BlobStreamReader reader{ &_buffer[_lod_offset] };
+		reader.skip(reader.read<u32>());
+		const u64 count_offset{ _lod_offset + reader.offset() };
+		memcpy(&_buffer[count_offset], &_lod_mesh_count, sizeof(u32));
+		memcpy(&_buffer[count_offset + sizeof(u32)], &_lod_bounds, sizeof(content::GeometryBounds));
+		++_lod_count;
+	}
+
+	void ScenePackStream::finish() {
+		assert(!_lod_open);
+
+		if (!_lod_count) {
+			CoTaskMemFree(_buffer);
+			_buffer = nullptr;
+			return;
+		}
+
+		util::BlobStreamReader reader{ _buffer };
+		reader.skip(reader.read<u32>());
+		memcpy(&_buffer[reader.offset()], &_lod_count, sizeof(u32));
+
+		_data.buffer = (u8*)CoTaskMemRealloc(_buffer, _size);
+		_data.buffer_size = (u32)_size;
+		assert(_data.buffer);
+		_buffer = nullptr;
+	}
+
 	bool coalesce_meshes(const LodGroup& lod, Mesh& combined_mesh, Progression* const progression) {
 		assert(lod.meshes.size());
 		const Mesh& first_mesh{ lod.meshes[0] };
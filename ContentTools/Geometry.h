@@ -1,5 +1,6 @@
 #pragma once
 #include "ToolsCommon.h"
+#include "Content/ContentToEngine.h"
 
 namespace lightning::tools {
 
@@ -28,7 +29,17 @@ namespace lightning::tools {
 				SKELETAL_NORMAL = SKELETAL | STATIC_NORMAL,
 				SKELETAL_NORMAL_COLOR = SKELETAL_NORMAL | STATIC_COLOR,
 				SKELETAL_NORMAL_TEXTURE = SKELETAL | STATIC_NORMAL_TEXTURE,
-				SKELETAL_NORMAL_TEXTURE_COLOR = SKELETAL_NORMAL_TEXTURE | STATIC_COLOR
+				SKELETAL_NORMAL_TEXTURE_COLOR = SKELETAL_NORMAL_TEXTURE | STATIC_COLOR,
+
+				// Modifier bits, these can be combined with any of the layouts above.
+				QUANTIZED_POSITION = 0x10,
+				HALF_UV = 0x20,
+
+				STATIC_NORMAL_TEXTURE_HALF_UV = STATIC_NORMAL_TEXTURE | HALF_UV,
+				SKELETAL_NORMAL_TEXTURE_HALF_UV = SKELETAL_NORMAL_TEXTURE | HALF_UV,
+				SKELETAL_NORMAL_TEXTURE_COLOR_HALF_UV = SKELETAL_NORMAL_TEXTURE_COLOR | HALF_UV,
+
+				LAYOUT_MASK = ~(u32)QUANTIZED_POSITION,
 			};
 		};
 
@@ -51,6 +62,14 @@ namespace lightning::tools {
 			math::v2 uv;
 		};
 
+		struct StaticNormalTextureHalfUV {
+			u8 color[3];
+			u8 t_sign;
+			u16 normal[2];
+			u16 tangent[2];
+			u16 uv[2];
+		};
+
 		struct Skeletal {
 			u8 joint_weights[3];
 			u8 pad;
@@ -100,6 +119,31 @@ namespace lightning::tools {
 			u8 color[3];
 			u8 pad;
 		};
+
+		struct SkeletalNormalTextureHalfUV {
+			u8 joint_weights[3];
+			u8 t_sign;
+			u16 joint_indicies[4];
+			u16 normal[2];
+			u16 tangent[2];
+			u16 uv[2];
+		};
+
+		struct SkeletalNormalTextureColorHalfUV {
+			u8 joint_weights[3];
+			u8 t_sign;
+			u16 joint_indicies[4];
+			u16 normal[2];
+			u16 tangent[2];
+			u16 uv[2];
+			u8 color[3];
+			u8 pad;
+		};
+
+		struct QuantizedPosition {
+			u16 x, y, z;
+			u16 pad;
+		};
 	}
 
 	struct Mesh {
@@ -119,13 +163,17 @@ namespace lightning::tools {
 		elements::ElementsType::Type elements_type;
 		util::vector<u8> position_buffer;
 		util::vector<u8> element_buffer;
+		content::GeometryBounds bounds{};
+		math::m4x4 transform{ 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
 		f32 lod_threshold{ -1.f };
 		u32 lod_id{ u32_invalid_id };
+		u32 source_mesh{ u32_invalid_id };	// index (in scene order) of the mesh whose geometry this one uses
 	};
 
 	struct LodGroup {
 		std::string name;
 		util::vector<Mesh> meshes;
+		content::GeometryBounds bounds{};
 	};
 
 	struct Scene {
@@ -141,6 +189,8 @@ namespace lightning::tools {
 		u8 import_embeded_textures;
 		u8 import_animations;
 		u8 coalesce_meshes;
+		u8 quantize_positions;
+		u8 half_precision_uvs;
 	};
 
 	struct SceneData {
@@ -149,7 +199,46 @@ namespace lightning::tools {
 		GeometryImportSettings settings;
 	};
 
+	// Processes and packs meshes one at a time straight into SceneData, so only a single
+	// unpacked mesh is alive at any point. Produces the same layout as pack_data, including
+	// references to identical geometry packed earlier.
+	class ScenePackStream {
+		public:
+			ScenePackStream(const std::string& scene_name, SceneData& data, Progression* const progression);
+			~ScenePackStream();
+			DISABLE_COPY_AND_MOVE(ScenePackStream);
+
+			void begin_lod(const std::string& name);
+			void add_mesh(Mesh& m);
+			void end_lod();
+			void finish();
+
+		private:
+			struct PackedGeometry {
+				u64 offset;
+				u64 size;
+				u32 mesh_index;
+			};
+
+			u8* reserve(u64 size);
+
+			SceneData& _data;
+			Progression* const _progression;
+			u8* _buffer{ nullptr };
+			u64 _capacity{ 0 };
+			u64 _size{ 0 };
+			u64 _lod_offset{ 0 };
+			std::unordered_multimap<u64, PackedGeometry> _geometries;
+			content::GeometryBounds _lod_bounds{};
+			u32 _lod_count{ 0 };
+			u32 _mesh_count{ 0 };
+			u32 _lod_mesh_count{ 0 };
+			bool _lod_open{ false };
+	};
+
 	void process_scene(Scene& scene, const GeometryImportSettings& settings, Progression* const progression);
+	// For meshes that already have final verticies and indicies with analytic normals, tangents and uvs.
+	void process_prebuilt_scene(Scene& scene, const GeometryImportSettings& settings);
 	void pack_data(const Scene& scene, SceneData& data);
 	bool coalesce_meshes(const LodGroup& lod, Mesh& combined_mesh, Progression* const progression);
 }
\ No newline at end of file
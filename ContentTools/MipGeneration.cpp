@@ -0,0 +1,319 @@
+#include "MipGeneration.h"
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+namespace lightning::tools::mips {
+	namespace {
+
+		constexpr u32 rows_per_job{ 32 };
+		constexpr u32 coverage_search_steps{ 12 };
+		constexpr f32 max_coverage_scale{ 4.f };
+		constexpr f32 kaiser_alpha{ 4.f };
+		constexpr f32 kaiser_width{ 3.f };
+		constexpr f32 lanczos_width{ 3.f };
+
+		struct Tap {
+			u32 index;
+			f32 weight;
+		};
+
+		struct Contributor {
+			u32 first_tap;
+			u32 tap_count;
+		};
+
+		struct FilterKernel {
+			util::vector<Contributor> contributors;
+			util::vector<Tap> taps;
+		};
+
+		f32 sinc(f32 x) {
+			if (fabsf(x) < math::EPSILON) return 1.f;
+			x *= math::PI;
+			return sinf(x) / x;
+		}
+
+		f32 bessel_i0(f32 x) {
+			const f32 half_x_sq{ x * x * .25f };
+			f32 sum{ 1.f };
+			f32 term{ 1.f };
+
+			for (u32 k{ 1 }; k < 16; ++k) {
+				term *= half_x_sq / (f32)(k * k);
+				sum += term;
+			}
+
+			return sum;
+		}
+
+		f32 filter_support(Filter::Type filter) {
+			switch (filter) {
+			case Filter::LINEAR: return 1.f;
+			case Filter::KAISER: return kaiser_width;
+			case Filter::LANCZOS: return lanczos_width;
+			}
+
+			return .5f;
+		}
+
+		f32 evaluate_filter(Filter::Type filter, f32 x) {
+			x = fabsf(x);
+
+			switch (filter) {
+			case Filter::LINEAR:
+				return x < 1.f ? 1.f - x : 0.f;
+			case Filter::KAISER: {
+				if (x >= kaiser_width) return 0.f;
+				const f32 t{ x / kaiser_width };
+				return sinc(x) * bessel_i0(kaiser_alpha * sqrtf(1.f - t * t)) / bessel_i0(kaiser_alpha);
+			}
+			case Filter::LANCZOS:
+				return x < lanczos_width ? sinc(x) * sinc(x / lanczos_width) : 0.f;
+			}
+
+			return x <= .5f ? 1.f : 0.f;
+		}
+
+		// Normalized taps for every destination texel, the filter is stretched by the downsampling factor.
+		void build_kernel(u32 src_size, u32 dst_size, Filter::Type filter, FilterKernel& kernel) {
+			const f32 scale{ (f32)src_size / (f32)dst_size };
+			const f32 stretch{ std::max(scale, 1.f) };
+			const f32 support{ filter_support(filter) * stretch };
+
+			kernel.contributors.clear();
+			kernel.taps.clear();
+
+			for (u32 d{ 0 }; d < dst_size; ++d) {
+				const f32 center{ (d + .5f) * scale };
+				const s32 first{ (s32)floorf(center - support) };
+				const s32 last{ (s32)ceilf(center + support) };
+				Contributor contributor{ (u32)kernel.taps.size(), 0 };
+				f32 total_weight{ 0.f };
+
+				for (s32 s{ first }; s <= last; ++s) {
+					const f32 weight{ evaluate_filter(filter, ((f32)s + .5f - center) / stretch) };
+					if (weight == 0.f) continue;
+
+					kernel.taps.emplace_back(Tap{ (u32)math::clamp(s, 0, (s32)src_size - 1), weight });
+					++contributor.tap_count;
+					total_weight += weight;
+				}
+
+				if (!contributor.tap_count || fabsf(total_weight) < math::EPSILON) {
+					kernel.taps.resize(contributor.first_tap);
+					kernel.taps.emplace_back(Tap{ std::min((u32)center, src_size - 1), 1.f });
+					contributor.tap_count = 1;
+					total_weight = 1.f;
+				}
+
+				const f32 inv_total_weight{ 1.f / total_weight };
+				for (u32 i{ 0 }; i < contributor.tap_count; ++i) kernel.taps[contributor.first_tap + i].weight *= inv_total_weight;
+
+				kernel.contributors.emplace_back(contributor);
+			}
+		}
+
+		void filter_rows(const Image& src, XMFLOAT4* const temp, u32 dst_width, const FilterKernel& kernel, u32 first_row, u32 last_row) {
+			for (u32 y{ first_row }; y < last_row; ++y) {
+				const XMFLOAT4* const src_row{ (const XMFLOAT4*)&src.pixels[src.rowPitch * y] };
+				XMFLOAT4* const dst_row{ temp + (u64)y * dst_width };
+
+				for (u32 x{ 0 }; x < dst_width; ++x) {
+					const Contributor& contributor{ kernel.contributors[x] };
+					const Tap* const taps{ &kernel.taps[contributor.first_tap] };
+					XMVECTOR sum{ XMVectorZero() };
+
+					for (u32 i{ 0 }; i < contributor.tap_count; ++i) {
+						sum = XMVectorMultiplyAdd(XMLoadFloat4(&src_row[taps[i].index]), XMVectorReplicate(taps[i].weight), sum);
+					}
+
+					XMStoreFloat4(&dst_row[x], sum);
+				}
+			}
+		}
+
+		void filter_columns(const XMFLOAT4* const temp, const Image& dst, const FilterKernel& kernel, u32 first_row, u32 last_row, bool renormalize, bool is_hdr) {
+			const u32 width{ (u32)dst.width };
+			const XMVECTOR max_value{ is_hdr ? g_XMFltMax : g_XMOne };
+
+			for (u32 y{ first_row }; y < last_row; ++y) {
+				const Contributor& contributor{ kernel.contributors[y] };
+				const Tap* const taps{ &kernel.taps[contributor.first_tap] };
+				XMFLOAT4* const dst_row{ (XMFLOAT4*)&dst.pixels[dst.rowPitch * y] };
+
+				// Accumulate whole source rows, so every tap reads memory sequentially.
+				memset(dst_row, 0, width * sizeof(XMFLOAT4));
+
+				for (u32 i{ 0 }; i < contributor.tap_count; ++i) {
+					const XMFLOAT4* const src_row{ temp + (u64)taps[i].index * width };
+					const XMVECTOR weight{ XMVectorReplicate(taps[i].weight) };
+
+					for (u32 x{ 0 }; x < width; ++x) {
+						XMStoreFloat4(&dst_row[x], XMVectorMultiplyAdd(XMLoadFloat4(&src_row[x]), weight, XMLoadFloat4(&dst_row[x])));
+					}
+				}
+
+				for (u32 x{ 0 }; x < width; ++x) {
+					XMVECTOR color{ XMVectorClamp(XMLoadFloat4(&dst_row[x]), XMVectorZero(), max_value) };
+
+					if (renormalize) {
+						const XMVECTOR n{ XMVector3Normalize(XMVectorMultiplyAdd(color, g_XMTwo, g_XMNegativeOne)) };
+						color = XMVectorSelect(color, XMVectorMultiplyAdd(n, g_XMOneHalf, g_XMOneHalf), g_XMSelect1110);
+					}
+
+					XMStoreFloat4(&dst_row[x], color);
+				}
+			}
+		}
+
+		f32 alpha_coverage(const Image& image, f32 threshold, f32 scale) {
+			u64 covered{ 0 };
+
+			for (u32 y{ 0 }; y < image.height; ++y) {
+				const XMFLOAT4* const row{ (const XMFLOAT4*)&image.pixels[image.rowPitch * y] };
+
+				for (u32 x{ 0 }; x < image.width; ++x) {
+					if (row[x].w * scale > threshold) ++covered;
+				}
+			}
+
+			return (f32)covered / (f32)(image.width * image.height);
+		}
+
+		// Binary search for the alpha scale that keeps the fraction of texels passing the alpha test.
+		void scale_alpha_to_coverage(const Image& image, f32 threshold, f32 target_coverage) {
+			f32 low{ 0.f };
+			f32 high{ max_coverage_scale };
+
+			for (u32 i{ 0 }; i < coverage_search_steps; ++i) {
+				const f32 mid{ (low + high) * .5f };
+				if (alpha_coverage(image, threshold, mid) > target_coverage) high = mid;
+				else low = mid;
+			}
+
+			const f32 scale{ (low + high) * .5f };
+
+			for (u32 y{ 0 }; y < image.height; ++y) {
+				XMFLOAT4* const row{ (XMFLOAT4*)&image.pixels[image.rowPitch * y] };
+				for (u32 x{ 0 }; x < image.width; ++x) row[x].w = std::min(row[x].w * scale, 1.f);
+			}
+		}
+
+		u32 get_max_mip_count(u32 width, u32 height) {
+			u32 mip_levels{ 1 };
+
+			while (width > 1 || height > 1) {
+				width >>= 1;
+				height >>= 1;
+				++mip_levels;
+			}
+
+			return mip_levels;
+		}
+	}
+
+	HRESULT generate_mip_chain(const ScratchImage& source, const MipSettings& settings, ScratchImage& mip_chain) {
+		const TexMetadata& metadata{ source.GetMetadata() };
+		assert(metadata.dimension != TEX_DIMENSION_TEXTURE3D && settings.filter < Filter::count);
+
+		const u32 item_count{ (u32)metadata.arraySize };
+		const u32 max_mip_count{ get_max_mip_count((u32)metadata.width, (u32)metadata.height) };
+		const u32 mip_levels{ settings.mip_levels ? std::min(settings.mip_levels, max_mip_count) : max_mip_count };
+		const bool is_hdr{ FormatDataType(metadata.format) == FORMAT_TYPE_FLOAT };
+		HRESULT hr{ S_OK };
+
+		// Normal maps are filtered as stored, without the sRGB curve.
+		TexMetadata stored_metadata{ metadata };
+		if (settings.renormalize && IsSRGB(metadata.format)) stored_metadata.format = MakeTypelessUNORM(MakeTypeless(metadata.format));
+
+		util::vector<Image> top_images(item_count);
+		for (u32 item{ 0 }; item < item_count; ++item) {
+			top_images[item] = *source.GetImage(0, item, 0);
+			top_images[item].format = stored_metadata.format;
+		}
+
+		stored_metadata.mipLevels = 1;
+		ScratchImage f32_top{};
+
+		if (stored_metadata.format != DXGI_FORMAT_R32G32B32A32_FLOAT) {
+			hr = Convert(top_images.data(), item_count, stored_metadata, DXGI_FORMAT_R32G32B32A32_FLOAT, TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, f32_top);
+			if (FAILED(hr)) return hr;
+		}
+
+		TexMetadata working_metadata{ stored_metadata };
+		working_metadata.format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+		working_metadata.mipLevels = mip_levels;
+
+		ScratchImage working_scratch{};
+		hr = working_scratch.Initialize(working_metadata);
+		if (FAILED(hr)) return hr;
+
+		// DirectXTex picks the default filter once, from the size of the top level.
+		const bool is_pow2{ !(metadata.width & (metadata.width - 1)) && !(metadata.height & (metadata.height - 1)) };
+		const Filter::Type filter{ settings.filter != Filter::DEFAULT ? settings.filter : is_pow2 ? Filter::BOX : Filter::LINEAR };
+
+		util::vector<f32> target_coverage(item_count);
+		const bool preserve_coverage{ settings.preserve_alpha_coverage && !is_hdr };
+
+		for (u32 item{ 0 }; item < item_count; ++item) {
+			const Image& src{ f32_top.GetImageCount() ? *f32_top.GetImage(0, item, 0) : top_images[item] };
+			const Image& dst{ *working_scratch.GetImage(0, item, 0) };
+
+			for (u32 y{ 0 }; y < dst.height; ++y) {
+				memcpy(&dst.pixels[dst.rowPitch * y], &src.pixels[src.rowPitch * y], dst.width * sizeof(XMFLOAT4));
+			}
+
+			if (preserve_coverage) target_coverage[item] = alpha_coverage(dst, settings.alpha_threshold, 1.f);
+		}
+
+		f32_top.Release();
+
+		FilterKernel horizontal{};
+		FilterKernel vertical{};
+		util::vector<XMFLOAT4> local_temp{};
+		util::vector<XMFLOAT4>& temp{ settings.scratch_buffer ? *settings.scratch_buffer : local_temp };
+		util::vector<thread_pool::RowJob> jobs{};
+
+		for (u32 mip{ 1 }; mip < mip_levels; ++mip) {
+			const Image& src_dims{ *working_scratch.GetImage(mip - 1, 0, 0) };
+			const Image& dst_dims{ *working_scratch.GetImage(mip, 0, 0) };
+			const u32 src_height{ (u32)src_dims.height };
+			const u32 dst_width{ (u32)dst_dims.width };
+			const u64 temp_item_size{ (u64)src_height * dst_width };
+
+			build_kernel((u32)src_dims.width, dst_width, filter, horizontal);
+			build_kernel(src_height, (u32)dst_dims.height, filter, vertical);
+			temp.resize(temp_item_size * item_count);
+
+			thread_pool::split_rows(item_count, rows_per_job, [src_height](u32) { return src_height; }, jobs);
+			thread_pool::parallel_for((u32)jobs.size(), [&](u32 i) {
+				const thread_pool::RowJob& job{ jobs[i] };
+				filter_rows(*working_scratch.GetImage(mip - 1, job.item, 0), &temp[temp_item_size * job.item], dst_width, horizontal, job.first_row, job.last_row);
+			});
+
+			const u32 dst_height{ (u32)dst_dims.height };
+			thread_pool::split_rows(item_count, rows_per_job, [dst_height](u32) { return dst_height; }, jobs);
+			thread_pool::parallel_for((u32)jobs.size(), [&](u32 i) {
+				const thread_pool::RowJob& job{ jobs[i] };
+				filter_columns(&temp[temp_item_size * job.item], *working_scratch.GetImage(mip, job.item, 0), vertical, job.first_row, job.last_row, settings.renormalize, is_hdr);
+			});
+
+			if (preserve_coverage) {
+				thread_pool::parallel_for(item_count, [&](u32 item) {
+					scale_alpha_to_coverage(*working_scratch.GetImage(mip, item, 0), settings.alpha_threshold, target_coverage[item]);
+				});
+			}
+		}
+
+		if (stored_metadata.format == DXGI_FORMAT_R32G32B32A32_FLOAT) {
+			mip_chain = std::move(working_scratch);
+			return hr;
+		}
+
+		hr = Convert(working_scratch.GetImages(), working_scratch.GetImageCount(), working_scratch.GetMetadata(), stored_metadata.format, TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, mip_chain);
+		if (SUCCEEDED(hr) && stored_metadata.format != metadata.format) mip_chain.OverrideFormat(metadata.format);
+
+		return hr;
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "ToolsCommon.h"
+#include <DirectXTex.h>
+
+namespace lightning::tools::mips {
+
+	struct Filter {
+		enum Type : u32 {
+			DEFAULT,		// same as DirectXTex's TEX_FILTER_DEFAULT: box for power of two sizes, linear otherwise
+			BOX,
+			LINEAR,
+			KAISER,
+			LANCZOS,
+
+			count
+		};
+	};
+
+	struct MipSettings {
+		u32 mip_levels;				// 0 generates the full chain
+		Filter::Type filter;
+		f32 alpha_threshold;
+		bool preserve_alpha_coverage;
+		bool renormalize;
+		util::vector<DirectX::XMFLOAT4>* scratch_buffer;	// optional, keeps the filter buffer alive between calls
+	};
+
+	// Filters 2D, array and cube textures in linear space, each mip from the previous one.
+	[[nodiscard]] HRESULT generate_mip_chain(const DirectX::ScratchImage& source, const MipSettings& settings, DirectX::ScratchImage& mip_chain);
+}
@@ -14,100 +14,225 @@ namespace lightning::tools {
 		constexpr f32 max_avg_length_threshold{ 1.1f };
 		constexpr f32 min_avg_z_threshold{ .8f };
 		constexpr f32 vector_length_sq_rejection_threshold{ min_avg_length_threshold * min_avg_length_threshold };
-		constexpr f32 rejection_ratio_threshold{ .33f };
-
-		struct Color {
-			f32 r, g, b, a;
-			bool is_transparent() const { return a < .001f; }
-			bool is_black() const { return r < .001f && g < .001f && b < .001f; }
-
-			Color operator+(Color c) {
-				r += c.r;
-				g += c.g;
-				b += c.b;
-				a += c.a;
+		constexpr f32 min_accepted_ratio{ .75f };
+		constexpr f32 min_unit_length_ratio{ .6f };
+		constexpr f32 max_length_std_deviation{ .15f };
+		constexpr f32 confidence_threshold{ .5f };
+
+		constexpr u32 histogram_bins{ 32 };
+		constexpr f32 max_vector_length{ 1.7320508f };	// length of (1, 1, 1)
+		constexpr f32 min_unit_length{ .8f };
+		constexpr f32 max_unit_length{ 1.15f };
+
+		// Images above this are classified from a stratified set of tiles.
+		constexpr u32 full_evaluation_pixel_count{ 1024 * 1024 };
+		constexpr u32 stratified_grid_size{ 32 };
+		constexpr u32 stratified_tile_size{ 16 };
+
+		struct NormalStatistics {
+			u32 z_histogram[histogram_bins];
+			u32 length_histogram[histogram_bins];
+			u64 valid;
+			u64 accepted;
+			f64 sum_x;
+			f64 sum_y;
+			f64 sum_z;
+			f64 sum_length;
+			f64 sum_length_sq;
+		};
 
-				return *this;
-			}
+		struct NormalMapClassification {
+			f32 confidence;
+			f32 accepted_ratio;
+			f32 unit_length_ratio;
+			f32 facing_ratio;
+			f32 average_length;
+			f32 average_z;
+			f32 length_std_deviation;
+		};
 
-			Color operator+=(Color c) { return (*this) + c; }
+		f32 horizontal_sum(FXMVECTOR v) {
+			XMFLOAT4 f;
+			XMStoreFloat4(&f, v);
+			return f.x + f.y + f.z + f.w;
+		}
 
-			Color operator*(f32 s) {
-				r *= s;
-				g *= s;
-				b *= s;
-				a *= s;
+		// Evaluates four RGBA8 (or BGRA8) pixels per iteration. Black or transparent pixels are ignored,
+		// the rest are binned and accepted if they point out of the surface and are close to unit length.
+		void evaluate_span(const u8* const pixels, u32 pixel_count, bool is_bgr, NormalStatistics& stats) {
+			const __m128i byte_mask{ _mm_set1_epi32(0xff) };
+			const __m128i rgb_mask{ _mm_set1_epi32(0x00ffffff) };
+			const __m128i zero{ _mm_setzero_si128() };
+			const XMVECTOR scale{ XMVectorReplicate(2.f * inv_255) };
+			const XMVECTOR rejection_threshold{ XMVectorReplicate(vector_length_sq_rejection_threshold) };
+			const XMVECTOR z_bin_scale{ XMVectorReplicate(histogram_bins * .5f) };
+			const XMVECTOR length_bin_scale{ XMVectorReplicate(histogram_bins / max_vector_length) };
+			const XMVECTOR max_bin{ XMVectorReplicate((f32)(histogram_bins - 1)) };
+
+			XMVECTOR valid_count{ XMVectorZero() };
+			XMVECTOR accepted_count{ XMVectorZero() };
+			XMVECTOR sum_x{ XMVectorZero() };
+			XMVECTOR sum_y{ XMVectorZero() };
+			XMVECTOR sum_z{ XMVectorZero() };
+			XMVECTOR sum_length{ XMVectorZero() };
+			XMVECTOR sum_length_sq{ XMVectorZero() };
+
+			for (u32 i{ 0 }; i < pixel_count; i += 4) {
+				__m128i px;
+
+				if (i + 4 <= pixel_count) {
+					px = _mm_loadu_si128((const __m128i*)&pixels[i * 4]);
+				}
+				else {
+					// Zero padded pixels are black and get ignored.
+					u32 tail[4]{};
+					memcpy(tail, &pixels[i * 4], (pixel_count - i) * 4);
+					px = _mm_loadu_si128((const __m128i*)tail);
+				}
 
-				return *this;
+				XMVECTOR r{ _mm_cvtepi32_ps(_mm_and_si128(px, byte_mask)) };
+				const XMVECTOR g{ _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), byte_mask)) };
+				XMVECTOR b{ _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), byte_mask)) };
+				if (is_bgr) std::swap(r, b);
+
+				const __m128i is_black{ _mm_cmpeq_epi32(_mm_and_si128(px, rgb_mask), zero) };
+				const __m128i is_transparent{ _mm_cmpeq_epi32(_mm_srli_epi32(px, 24), zero) };
+				const XMVECTOR valid{ _mm_castsi128_ps(_mm_andnot_si128(_mm_or_si128(is_black, is_transparent), _mm_cmpeq_epi32(zero, zero))) };
+
+				const XMVECTOR x{ XMVectorMultiplyAdd(r, scale, g_XMNegativeOne) };
+				const XMVECTOR y{ XMVectorMultiplyAdd(g, scale, g_XMNegativeOne) };
+				const XMVECTOR z{ XMVectorMultiplyAdd(b, scale, g_XMNegativeOne) };
+				const XMVECTOR length_sq{ XMVectorMultiplyAdd(x, x, XMVectorMultiplyAdd(y, y, XMVectorMultiply(z, z))) };
+				const XMVECTOR length{ XMVectorSqrt(length_sq) };
+				const XMVECTOR normalized_z{ XMVectorDivide(z, XMVectorMax(length, g_XMEpsilon)) };
+
+				const XMVECTOR accepted{ XMVectorAndInt(valid, XMVectorAndInt(XMVectorGreaterOrEqual(z, XMVectorZero()), XMVectorGreaterOrEqual(length_sq, rejection_threshold))) };
+
+				valid_count = XMVectorAdd(valid_count, XMVectorSelect(XMVectorZero(), g_XMOne, valid));
+				accepted_count = XMVectorAdd(accepted_count, XMVectorSelect(XMVectorZero(), g_XMOne, accepted));
+				sum_x = XMVectorAdd(sum_x, XMVectorSelect(XMVectorZero(), x, accepted));
+				sum_y = XMVectorAdd(sum_y, XMVectorSelect(XMVectorZero(), y, accepted));
+				sum_z = XMVectorAdd(sum_z, XMVectorSelect(XMVectorZero(), z, accepted));
+				sum_length = XMVectorAdd(sum_length, XMVectorSelect(XMVectorZero(), length, accepted));
+				sum_length_sq = XMVectorAdd(sum_length_sq, XMVectorSelect(XMVectorZero(), length_sq, accepted));
+
+				const u32 valid_lanes{ (u32)_mm_movemask_ps(valid) };
+				if (!valid_lanes) continue;
+
+				const XMVECTOR z_bins{ XMVectorClamp(XMVectorMultiply(XMVectorAdd(normalized_z, g_XMOne), z_bin_scale), XMVectorZero(), max_bin) };
+				const XMVECTOR length_bins{ XMVectorClamp(XMVectorMultiply(length, length_bin_scale), XMVectorZero(), max_bin) };
+				alignas(16) s32 z_bin[4];
+				alignas(16) s32 length_bin[4];
+				_mm_store_si128((__m128i*)z_bin, _mm_cvttps_epi32(z_bins));
+				_mm_store_si128((__m128i*)length_bin, _mm_cvttps_epi32(length_bins));
+
+				for (u32 lane{ 0 }; lane < 4; ++lane) {
+					if (!(valid_lanes & (1 << lane))) continue;
+					++stats.z_histogram[z_bin[lane]];
+					++stats.length_histogram[length_bin[lane]];
+				}
 			}
 
-			Color operator*=(f32 s) { return (*this) * s; }
-			Color operator/=(f32 s) { return (*this) * (1.f / s); }
-		};
-
-		using sampler = Color(*)(const u8* const);
-
-		Color sample_pixel_rgb(const u8* const pixel) {
-			Color c{ (f32)pixel[0], (f32)pixel[1], (f32)pixel[2], (f32)pixel[3] };
-			return c * inv_255;
+			stats.valid += (u64)horizontal_sum(valid_count);
+			stats.accepted += (u64)horizontal_sum(accepted_count);
+			stats.sum_x += horizontal_sum(sum_x);
+			stats.sum_y += horizontal_sum(sum_y);
+			stats.sum_z += horizontal_sum(sum_z);
+			stats.sum_length += horizontal_sum(sum_length);
+			stats.sum_length_sq += horizontal_sum(sum_length_sq);
 		}
 
-		Color sample_pixel_bgr(const u8* const pixel) {
-			Color c{ (f32)pixel[2], (f32)pixel[1], (f32)pixel[0], (f32)pixel[3] };
-			return c * inv_255;
+		// Deterministic scatter of the tile inside its grid cell.
+		u32 tile_offset(u32 cell, u32 range) {
+			if (!range) return 0;
+			u32 h{ cell * 0x9e3779b9u };
+			h ^= h >> 16;
+			h *= 0x85ebca6bu;
+			h ^= h >> 13;
+			return h % (range + 1);
 		}
 
-		s32 evaluate_color(Color c) {
-			if (c.is_black() || c.is_transparent()) return 0;
+		// Returns the number of evaluated pixels.
+		u64 gather_statistics(const Image* const image, bool is_bgr, NormalStatistics& stats) {
+			const u32 width{ (u32)image->width };
+			const u32 height{ (u32)image->height };
+			constexpr u32 min_stratified_size{ stratified_grid_size * stratified_tile_size };
 
-			math::v3 v{ c.r * 2.f - 1.f, c.g * 2.f - 1.f, c.b * 2.f - 1.f };
-			const f32 v_length_sq{ v.x * v.x + v.y * v.y + v.z * v.z };
+			if ((u64)width * height <= full_evaluation_pixel_count || width < min_stratified_size || height < min_stratified_size) {
+				for (u32 y{ 0 }; y < height; ++y) {
+					evaluate_span(&image->pixels[image->rowPitch * y], width, is_bgr, stats);
+				}
 
-			return (v.z < 0.f || v_length_sq < vector_length_sq_rejection_threshold) ? -1 : 1;
-		}
+				return (u64)width * height;
+			}
 
-		bool evaluate_image(const Image* const image, sampler sample) {
-			constexpr u32 sample_count{ 4096 };
-			const size_t image_size{ image->slicePitch };
-			const size_t sample_interval{ std::max(image_size / sample_count, (size_t)4) };
-			const u32 min_sample_count{ std::max((u32)(image_size / sample_interval) >> 2, (u32)1) };
-			const u8* const pixels{ image->pixels };
+			const u32 cell_width{ width / stratified_grid_size };
+			const u32 cell_height{ height / stratified_grid_size };
 
-			u32 accepted_samples{ 0 };
-			u32 rejected_samples{ 0 };
-			Color average_color{};
+			for (u32 cell_y{ 0 }; cell_y < stratified_grid_size; ++cell_y) {
+				for (u32 cell_x{ 0 }; cell_x < stratified_grid_size; ++cell_x) {
+					const u32 cell{ cell_y * stratified_grid_size + cell_x };
+					const u32 x{ cell_x * cell_width + tile_offset(cell, cell_width - stratified_tile_size) };
+					const u32 y{ cell_y * cell_height + tile_offset(cell ^ 0x5bd1e995u, cell_height - stratified_tile_size) };
 
-			size_t offset{ sample_interval };
+					for (u32 row{ y }; row < y + stratified_tile_size; ++row) {
+						evaluate_span(&image->pixels[image->rowPitch * row + x * 4], stratified_tile_size, is_bgr, stats);
+					}
+				}
+			}
 
-			while (offset < image_size) {
-				const Color c{ sample(&pixels[offset]) };
-				const s32 result{ evaluate_color(c) };
+			return (u64)min_stratified_size * min_stratified_size;
+		}
 
-				if (result < 0) {
-					++rejected_samples;
-				}
-				else if (result > 0) {
-					++accepted_samples;
-					average_color += c;
-				}
+		f32 ramp(f32 value, f32 threshold, f32 width) {
+			return math::clamp((value - threshold) / width + .5f, 0.f, 1.f);
+		}
 
-				offset += sample_interval;
-			}
+		// Each criterion maps to a 0-1 score that crosses .5 at its threshold, confidence is the weakest one.
+		NormalMapClassification classify(const NormalStatistics& stats, u64 evaluated) {
+			NormalMapClassification result{};
+			const u64 min_valid{ std::max(evaluated >> 2, (u64)1) };
 
-			if (accepted_samples >= min_sample_count) {
-				const f32 rejection_ratio{ (f32)rejected_samples / (f32)accepted_samples };
+			if (stats.valid < min_valid || !stats.accepted) return result;
 
-				if (rejection_ratio > rejection_ratio_threshold) return false;
+			const f64 inv_accepted{ 1.0 / (f64)stats.accepted };
+			const math::v3 average{ (f32)(stats.sum_x * inv_accepted), (f32)(stats.sum_y * inv_accepted), (f32)(stats.sum_z * inv_accepted) };
+			const f32 mean_length{ (f32)(stats.sum_length * inv_accepted) };
+			const f32 length_variance{ std::max((f32)(stats.sum_length_sq * inv_accepted) - mean_length * mean_length, 0.f) };
 
-				average_color /= (f32)accepted_samples;
-				math::v3 v{ average_color.r * 2.f - 1.f, average_color.g * 2.f - 1.f,average_color.b * 2.f - 1.f };
-				const f32 avg_length{ sqrt(v.x * v.x + v.y * v.y + v.z * v.z) };
-				const f32 avg_normalized_z{ v.z / avg_length };
+			u64 unit_length_count{ 0 };
+			u64 facing_count{ 0 };
 
-				return avg_length >= min_avg_length_threshold && avg_length <= max_avg_length_threshold && avg_normalized_z >= min_avg_z_threshold;
+			for (u32 i{ 0 }; i < histogram_bins; ++i) {
+				const f32 length_bin_center{ (i + .5f) * max_vector_length / histogram_bins };
+				if (length_bin_center >= min_unit_length && length_bin_center <= max_unit_length) unit_length_count += stats.length_histogram[i];
+				if (i >= histogram_bins / 2) facing_count += stats.z_histogram[i];
 			}
 
-			return false;
+			result.accepted_ratio = (f32)stats.accepted / (f32)stats.valid;
+			result.unit_length_ratio = (f32)unit_length_count / (f32)stats.valid;
+			result.facing_ratio = (f32)facing_count / (f32)stats.valid;
+			result.average_length = sqrtf(average.x * average.x + average.y * average.y + average.z * average.z);
+			result.average_z = result.average_length > 0.f ? average.z / result.average_length : 0.f;
+			result.length_std_deviation = sqrtf(length_variance);
+
+			f32 confidence{ ramp(result.accepted_ratio, min_accepted_ratio, .2f) };
+			confidence = std::min(confidence, ramp(result.facing_ratio, min_accepted_ratio, .2f));
+			confidence = std::min(confidence, ramp(result.unit_length_ratio, min_unit_length_ratio, .4f));
+			confidence = std::min(confidence, ramp(result.average_z, min_avg_z_threshold, .2f));
+			confidence = std::min(confidence, ramp(result.average_length, min_avg_length_threshold, .2f));
+			confidence = std::min(confidence, ramp(-result.average_length, -max_avg_length_threshold, .2f));
+			confidence = std::min(confidence, ramp(-result.length_std_deviation, -max_length_std_deviation, .2f));
+			result.confidence = confidence;
+
+			return result;
+		}
+
+		NormalMapClassification evaluate_image(const Image* const image, bool is_bgr) {
+			NormalStatistics stats{};
+			const u64 evaluated{ gather_statistics(image, is_bgr, stats) };
+
+			return classify(stats, evaluated);
 		}
 	}
 
@@ -116,6 +241,6 @@ namespace lightning::tools {
 
 		if (BitsPerPixel(image_format) != 32 || BitsPerColor(image_format) != 8) return false;
 
-		return evaluate_image(image, IsBGR(image_format) ? sample_pixel_bgr : sample_pixel_rgb);
+		return evaluate_image(image, IsBGR(image_format)).confidence >= confidence_threshold;
 	}
-}
\ No newline at end of file
+}
@@ -1,18 +1,19 @@
 #include "PrimitiveMesh.h"
 #include "Geometry.h"
+#include "ThreadPool.h"
 
 namespace lightning::tools {
 	namespace {
 		using namespace math;
 		using namespace DirectX;
-		using primitive_mesh_creator = void(*)(Scene&, const PrimitiveInitInfo& info);
+		using primitive_mesh_creator = Mesh(*)(const PrimitiveInitInfo& info);
 
-		void create_plane(Scene& scene, const PrimitiveInitInfo& info);
-		void create_cube(Scene& scene, const PrimitiveInitInfo& info);
-		void create_uv_sphere(Scene& scene, const PrimitiveInitInfo& info);
-		void create_ico_sphere(Scene& scene, const PrimitiveInitInfo& info);
-		void create_cylinder(Scene& scene, const PrimitiveInitInfo& info);
-		void create_capsule(Scene& scene, const PrimitiveInitInfo& info);
+		Mesh create_plane(const PrimitiveInitInfo& info);
+		Mesh create_cube(const PrimitiveInitInfo& info);
+		Mesh create_uv_sphere(const PrimitiveInitInfo& info);
+		Mesh create_ico_sphere(const PrimitiveInitInfo& info);
+		Mesh create_cylinder(const PrimitiveInitInfo& info);
+		Mesh create_capsule(const PrimitiveInitInfo& info);
 
 		primitive_mesh_creator creators[]{
 			create_plane,
@@ -33,64 +34,173 @@ namespace lightning::tools {
 			};
 		};
 
-		Mesh create_plane(const PrimitiveInitInfo& info, u32 horizontal_index = Axis::x, u32 vertical_index = Axis::z, bool flip_winding = false, v3 offset = { -.5f, 0.f, -.5f }, v2 u_range = { 0.f, 1.f }, v2 v_range = { 0.f, 1.f }) {
-			assert(horizontal_index < 3 && vertical_index < 3);
-			assert(horizontal_index != vertical_index);
+		constexpr u32 max_lod_count{ 8 };
+		constexpr f32 lod_distance_factor{ 10.f };
 
-			const u32 horizontal_count{ clamp(info.segments[horizontal_index], 1u, 10u) };
-			const u32 vertical_count{ clamp(info.segments[vertical_index], 1u, 10u) };
-			const f32 horizontal_step{ 1.f / horizontal_count };
-			const f32 vertical_step{ 1.f / vertical_count };
-			const f32 u_step{ (u_range.y - u_range.x) / horizontal_count };
-			const f32 v_step{ (v_range.y - v_range.x) / vertical_count };
+		// Analytic surface frame, bitangent points along increasing uv.y.
+		struct PrimitiveVertex {
+			v3 position;
+			v3 normal;
+			v3 tangent;
+			v3 bitangent;
+			v2 uv;
+		};
 
-			Mesh m{};
-			util::vector<v2> uvs;
-
-			for (u32 i{ 0 }; i <= vertical_count; ++i) {
-				for (u32 j{ 0 }; j <= horizontal_count; ++j) {
-					v3 position{ offset };
-					f32* const as_array{ &position.x };
-					as_array[horizontal_index] += j * horizontal_step;
-					as_array[vertical_index] += i * vertical_step;
-					m.positions.emplace_back(position.x * info.size.x, position.y * info.size.y, position.z * info.size.z);
-
-					v2 uv{ u_range.x, 1.f - v_range.x };
-					uv.x += j * u_step;
-					uv.y += i * v_step;
-					uvs.emplace_back(uv);
-				}
-			}
+		PrimitiveVertex transform(const PrimitiveVertex& v, v3 scale, v3 offset = {}) {
+			const XMVECTOR s{ XMLoadFloat3(&scale) };
+			const XMVECTOR safe_s{ XMVectorSelect(s, XMVectorSplatOne(), XMVectorEqual(s, XMVectorZero())) };
+
+			PrimitiveVertex result{};
+			XMStoreFloat3(&result.position, XMVectorMultiplyAdd(XMLoadFloat3(&v.position), s, XMLoadFloat3(&offset)));
+			XMStoreFloat3(&result.normal, XMVector3Normalize(XMVectorDivide(XMLoadFloat3(&v.normal), safe_s)));
+			XMStoreFloat3(&result.tangent, XMVector3Normalize(XMVectorMultiply(XMLoadFloat3(&v.tangent), safe_s)));
+			XMStoreFloat3(&result.bitangent, XMVectorMultiply(XMLoadFloat3(&v.bitangent), safe_s));
+			result.uv = v.uv;
+
+			return result;
+		}
 
-			assert(m.positions.size() == (((u64)horizontal_count + 1) * ((u64)vertical_count + 1)));
+		u32 add_vertex(Mesh& m, const PrimitiveVertex& pv) {
+			const XMVECTOR n{ XMLoadFloat3(&pv.normal) };
+			const XMVECTOR t{ XMLoadFloat3(&pv.tangent) };
+			const f32 handedness{ XMVectorGetX(XMVector3Dot(XMVector3Cross(n, t), XMLoadFloat3(&pv.bitangent))) < 0.f ? -1.f : 1.f };
 
-			const u32 row_length{ horizontal_count + 1 };
+			Vertex v{};
+			v.position = pv.position;
+			v.normal = pv.normal;
+			v.tangent = { pv.tangent.x, pv.tangent.y, pv.tangent.z, handedness };
+			v.uv = pv.uv;
 
-			for (u32 i{ 0 }; i < vertical_count; ++i) {
-				for (u32 j{ 0 }; j < horizontal_count; ++j) {
+			m.verticies.emplace_back(v);
+			return (u32)m.verticies.size() - 1;
+		}
+
+		// Winding follows the vertex normals and triangles collapsed at poles or disc centers are dropped.
+		void add_triangle(Mesh& m, u32 a, u32 b, u32 c) {
+			const Vertex& va{ m.verticies[a] };
+			const Vertex& vb{ m.verticies[b] };
+			const Vertex& vc{ m.verticies[c] };
+			const XMVECTOR pa{ XMLoadFloat3(&va.position) };
+			const XMVECTOR e1{ XMVectorSubtract(XMLoadFloat3(&vb.position), pa) };
+			const XMVECTOR e2{ XMVectorSubtract(XMLoadFloat3(&vc.position), pa) };
+			const XMVECTOR face_normal{ XMVector3Cross(e1, e2) };
+
+			if (XMVectorGetX(XMVector3LengthSq(face_normal)) <= 1e-10f * XMVectorGetX(XMVector3LengthSq(e1)) * XMVectorGetX(XMVector3LengthSq(e2))) return;
+
+			const XMVECTOR normal_sum{ XMVectorAdd(XMVectorAdd(XMLoadFloat3(&va.normal), XMLoadFloat3(&vb.normal)), XMLoadFloat3(&vc.normal)) };
+			const bool flip{ XMVectorGetX(XMVector3Dot(face_normal, normal_sum)) < 0.f };
+
+			m.indicies.emplace_back(a);
+			m.indicies.emplace_back(flip ? c : b);
+			m.indicies.emplace_back(flip ? b : c);
+		}
+
+		template<typename F> void add_grid(Mesh& m, u32 columns, u32 rows, F vertex_at) {
+			const u32 first{ (u32)m.verticies.size() };
+			const u32 row_length{ columns + 1 };
+
+			for (u32 row{ 0 }; row <= rows; ++row) {
+				for (u32 column{ 0 }; column <= columns; ++column) {
+					add_vertex(m, vertex_at(column, row));
+				}
+			}
+
+			for (u32 row{ 0 }; row < rows; ++row) {
+				for (u32 column{ 0 }; column < columns; ++column) {
 					const u32 index[4]{
-						j + i * row_length,
-						j + (i + 1) * row_length,
-						(j + 1) + i * row_length,
-						(j + 1) + (i + 1) * row_length
+						first + column + row * row_length,
+						first + (column + 1) + row * row_length,
+						first + column + (row + 1) * row_length,
+						first + (column + 1) + (row + 1) * row_length
 					};
-					m.raw_indicies.emplace_back(index[0]);
-					m.raw_indicies.emplace_back(index[flip_winding ? 2 : 1]);
-					m.raw_indicies.emplace_back(index[flip_winding ? 1 : 2]);
 
-					m.raw_indicies.emplace_back(index[2]);
-					m.raw_indicies.emplace_back(index[flip_winding ? 3 : 1]);
-					m.raw_indicies.emplace_back(index[flip_winding ? 1 : 3]);
+					add_triangle(m, index[0], index[2], index[1]);
+					add_triangle(m, index[1], index[2], index[3]);
+				}
+			}
+		}
+
+		void remove_unused_verticies(Mesh& m) {
+			util::vector<u32> remap(m.verticies.size(), u32_invalid_id);
+			util::vector<Vertex> verticies;
+
+			for (auto& index : m.indicies) {
+				if (remap[index] == u32_invalid_id) {
+					remap[index] = (u32)verticies.size();
+					verticies.emplace_back(m.verticies[index]);
 				}
+				index = remap[index];
 			}
 
-			const u32 num_indicies{ 3 * 2 * horizontal_count * vertical_count };
-			assert(m.raw_indicies.size() == num_indicies);
+			verticies.swap(m.verticies);
+		}
+
+		PrimitiveVertex sphere_vertex(f32 theta, f32 phi, v2 uv) {
+			f32 sin_theta, cos_theta, sin_phi, cos_phi;
+			XMScalarSinCos(&sin_theta, &cos_theta, theta);
+			XMScalarSinCos(&sin_phi, &cos_phi, phi);
 
-			m.uv_sets.resize(1);
+			PrimitiveVertex v{};
+			v.normal = { sin_theta * cos_phi, cos_theta, -sin_theta * sin_phi };
+			v.position = v.normal;
+			v.tangent = { -sin_phi, 0.f, -cos_phi };
+			v.bitangent = { cos_theta * cos_phi, -sin_theta, -cos_theta * sin_phi };
+			v.uv = uv;
 
-			for (u32 i{ 0 }; i < num_indicies; ++i) {
-				m.uv_sets[0].emplace_back(uvs[m.raw_indicies[i]]);
+			return v;
+		}
+
+		Mesh create_plane(const PrimitiveInitInfo& info) {
+			const u32 horizontal_count{ clamp(info.segments[Axis::x], 1u, 10u) };
+			const u32 vertical_count{ clamp(info.segments[Axis::z], 1u, 10u) };
+
+			Mesh m{};
+			m.name = "plane";
+
+			add_grid(m, horizontal_count, vertical_count, [&](u32 column, u32 row) {
+				const f32 u{ (f32)column / horizontal_count };
+				const f32 v{ (f32)row / vertical_count };
+				return transform({ { u - .5f, 0.f, v - .5f }, { 0.f, 1.f, 0.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f, 1.f }, { u, v } }, info.size);
+			});
+
+			return m;
+		}
+
+		Mesh create_cube(const PrimitiveInitInfo& info) {
+			struct Face {
+				v3 normal;
+				v3 tangent;
+				v3 bitangent;
+				u32 u_axis;
+				u32 v_axis;
+			};
+
+			const Face faces[6]{
+				{ {  1.f, 0.f, 0.f }, { 0.f, 0.f,  1.f }, { 0.f, -1.f, 0.f }, Axis::z, Axis::y },
+				{ { -1.f, 0.f, 0.f }, { 0.f, 0.f, -1.f }, { 0.f, -1.f, 0.f }, Axis::z, Axis::y },
+				{ { 0.f,  1.f, 0.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f, -1.f }, Axis::x, Axis::z },
+				{ { 0.f, -1.f, 0.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f,  1.f }, Axis::x, Axis::z },
+				{ { 0.f, 0.f,  1.f }, { -1.f, 0.f, 0.f }, { 0.f, -1.f, 0.f }, Axis::x, Axis::y },
+				{ { 0.f, 0.f, -1.f }, {  1.f, 0.f, 0.f }, { 0.f, -1.f, 0.f }, Axis::x, Axis::y },
+			};
+
+			Mesh m{};
+			m.name = "cube";
+
+			for (const Face& face : faces) {
+				const u32 u_count{ clamp(info.segments[face.u_axis], 1u, 10u) };
+				const u32 v_count{ clamp(info.segments[face.v_axis], 1u, 10u) };
+				const XMVECTOR n{ XMLoadFloat3(&face.normal) };
+				const XMVECTOR t{ XMLoadFloat3(&face.tangent) };
+				const XMVECTOR b{ XMLoadFloat3(&face.bitangent) };
+
+				add_grid(m, u_count, v_count, [&](u32 column, u32 row) {
+					const f32 u{ (f32)column / u_count };
+					const f32 v{ (f32)row / v_count };
+					PrimitiveVertex pv{ {}, face.normal, face.tangent, face.bitangent, { u, v } };
+					XMStoreFloat3(&pv.position, XMVectorAdd(XMVectorScale(n, .5f), XMVectorAdd(XMVectorScale(t, u - .5f), XMVectorScale(b, v - .5f))));
+					return transform(pv, info.size);
+				});
 			}
 
 			return m;
@@ -99,151 +209,240 @@ namespace lightning::tools {
 		Mesh create_uv_sphere(const PrimitiveInitInfo& info) {
 			const u32 phi_count{ clamp(info.segments[Axis::x], 3u, 64u) };
 			const u32 theta_count{ clamp(info.segments[Axis::y], 2u, 64u) };
-			const f32 theta_step{ PI / theta_count };
-			const f32 phi_step{ TWO_PI / phi_count };
-			const u32 num_indicies{ 2 * 3 * phi_count + 2 * 3 * phi_count * (theta_count - 2) };
-			const u32 num_verticies{ 2 + phi_count + (theta_count - 1) };
 
 			Mesh m{};
 			m.name = "uv_sphere";
-			m.positions.resize(num_verticies);
 
-			u32 c{ 0 };
-			m.positions[c++] = { 0.f, info.size.y, 0.f };
+			add_grid(m, phi_count, theta_count, [&](u32 column, u32 row) {
+				const f32 u{ (f32)column / phi_count };
+				const f32 v{ (f32)row / theta_count };
+				return transform(sphere_vertex(v * PI, u * TWO_PI, { u, v }), info.size);
+			});
 
-			for (u32 i{ 1 }; i <= (theta_count - 1); ++i) {
-				const f32 theta{ i * theta_step };
+			remove_unused_verticies(m);
 
-				for (u32 j{ 0 }; j < phi_count; ++j) {
-					const f32 phi{ j * phi_step };
-					m.positions[c++] = {
-						info.size.x * XMScalarSin(theta) * XMScalarCos(phi),
-						info.size.y * XMScalarCos(theta),
-						-info.size.z * XMScalarSin(theta) * XMScalarSin(phi)
-					};
-				}
+			return m;
+		}
+
+		Mesh create_ico_sphere(const PrimitiveInitInfo& info) {
+			const u32 subdivisions{ clamp(info.segments[Axis::x], 1u, 7u) - 1 };
+			constexpr f32 g{ 1.618033989f };
+
+			util::vector<v3> positions{};
+			for (const v3& p : {
+				v3{ -1.f, g, 0.f }, v3{ 1.f, g, 0.f }, v3{ -1.f, -g, 0.f }, v3{ 1.f, -g, 0.f },
+				v3{ 0.f, -1.f, g }, v3{ 0.f, 1.f, g }, v3{ 0.f, -1.f, -g }, v3{ 0.f, 1.f, -g },
+				v3{ g, 0.f, -1.f }, v3{ g, 0.f, 1.f }, v3{ -g, 0.f, -1.f }, v3{ -g, 0.f, 1.f } }) {
+				v3 n{};
+				XMStoreFloat3(&n, XMVector3Normalize(XMLoadFloat3(&p)));
+				positions.emplace_back(n);
 			}
-			m.positions[c++] = { 0.f, -info.size.y, 0.f };
-			assert(c == num_verticies);
-
-			c = 0;
-			m.raw_indicies.resize(num_indicies);
-			util::vector<v2> uvs(num_indicies);
-			const f32 inv_theta_count{ 1.f / theta_count };
-			const f32 inv_phi_count{ 1.f / phi_count };
-
-			for (u32 i{ 0 }; i < phi_count - 1; ++i) {
-				uvs[c] = { (2 * i + 1) * .5f * inv_phi_count, 1.f };
-				m.raw_indicies[c++] = 0;
-				uvs[c] = { i * inv_phi_count, 1.f - inv_theta_count };
-				m.raw_indicies[c++] = i + 1;
-				uvs[c] = { (i + 1) * inv_phi_count, 1.f - inv_theta_count };
-				m.raw_indicies[c++] = i + 2;
+
+			constexpr u32 icosahedron[]{
+				0, 11, 5,	0, 5, 1,	0, 1, 7,	0, 7, 10,	0, 10, 11,
+				1, 5, 9,	5, 11, 4,	11, 10, 2,	10, 7, 6,	7, 1, 8,
+				3, 9, 4,	3, 4, 2,	3, 2, 6,	3, 6, 8,	3, 8, 9,
+				4, 9, 5,	2, 4, 11,	6, 2, 10,	8, 6, 7,	9, 8, 1
+			};
+
+			util::vector<u32> triangles{};
+			for (u32 index : icosahedron) triangles.emplace_back(index);
+
+			for (u32 level{ 0 }; level < subdivisions; ++level) {
+				std::unordered_map<u64, u32> midpoints;
+				auto midpoint = [&](u32 a, u32 b) {
+					const u64 key{ a < b ? ((u64)a << 32) | b : ((u64)b << 32) | a };
+					auto it{ midpoints.find(key) };
+					if (it != midpoints.end()) return it->second;
+
+					v3 p{};
+					XMStoreFloat3(&p, XMVector3Normalize(XMVectorAdd(XMLoadFloat3(&positions[a]), XMLoadFloat3(&positions[b]))));
+					positions.emplace_back(p);
+					midpoints[key] = (u32)positions.size() - 1;
+					return (u32)positions.size() - 1;
+				};
+
+				util::vector<u32> new_triangles{};
+				new_triangles.reserve(triangles.size() * 4);
+
+				for (u32 i{ 0 }; i < triangles.size(); i += 3) {
+					const u32 a{ triangles[i] }, b{ triangles[i + 1] }, c{ triangles[i + 2] };
+					const u32 ab{ midpoint(a, b) }, bc{ midpoint(b, c) }, ca{ midpoint(c, a) };
+
+					for (u32 index : { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca }) {
+						new_triangles.emplace_back(index);
+					}
+				}
+
+				triangles.swap(new_triangles);
 			}
 
-			uvs[c] = { 1.f - .5f * inv_phi_count, 1.f };
-			m.raw_indicies[c++] = 0;
-			uvs[c] = { 1.f - inv_phi_count, 1.f - inv_theta_count};
-			m.raw_indicies[c++] = phi_count;
-			uvs[c] = { 1.f, 1.f - inv_theta_count };
-			m.raw_indicies[c++] = 1;
+			Mesh m{};
+			m.name = "ico_sphere";
+
+			// Spherical uvs need duplicated verticies along the u seam and at the poles.
+			std::unordered_map<u64, u32> vertex_map;
+			auto add_sphere_vertex = [&](u32 index, f32 u, bool unique) {
+				const u64 key{ ((u64)index << 32) | (u64)(u >= 1.f) };
+				if (!unique) {
+					auto it{ vertex_map.find(key) };
+					if (it != vertex_map.end()) return it->second;
+				}
 
-			for (u32 i{ 0 }; i < theta_count - 2; ++i) {
-				for (u32 j{ 0 }; j < (phi_count - 1); ++j) {
-					const u32 index[4]{
-						1 + j + i * phi_count,
-						1 + j + (i + 1) * phi_count,
-						1 + (j + 1) + (i + 1) * phi_count,
-						1 + (j + 1) + i * phi_count,
-					};
+				const v3& p{ positions[index] };
+				const f32 theta{ XMScalarACos(clamp(p.y, -1.f, 1.f)) };
+				const u32 vertex{ add_vertex(m, transform(sphere_vertex(theta, u * TWO_PI, { u, theta * INV_PI }), info.size)) };
+				if (!unique) vertex_map[key] = vertex;
+
+				return vertex;
+			};
 
-					uvs[c] = { j * inv_phi_count, 1.f - (i + 1) * inv_theta_count };
-					m.raw_indicies[c++] = index[0];
-					uvs[c] = { j * inv_phi_count, 1.f - (i + 2) * inv_theta_count };
-					m.raw_indicies[c++] = index[1];
-					uvs[c] = { (j + 1) * inv_phi_count, 1.f - (i + 2) * inv_theta_count };
-					m.raw_indicies[c++] = index[2];
-
-					uvs[c] = { j * inv_phi_count, 1.f - (i + 1) * inv_theta_count };
-					m.raw_indicies[c++] = index[0];
-					uvs[c] = { (j + 1) * inv_phi_count, 1.f - (i + 2) * inv_theta_count };
-					m.raw_indicies[c++] = index[2];
-					uvs[c] = { (j + 1) * inv_phi_count, 1.f - (i + 1) * inv_theta_count };
-					m.raw_indicies[c++] = index[3];
+			for (u32 i{ 0 }; i < triangles.size(); i += 3) {
+				f32 u[3]{};
+				bool is_pole[3]{};
+
+				for (u32 j{ 0 }; j < 3; ++j) {
+					const v3& p{ positions[triangles[i + j]] };
+					is_pole[j] = fabsf(p.y) > 1.f - EPSILON;
+					f32 phi{ atan2f(-p.z, p.x) };
+					if (phi < 0.f) phi += TWO_PI;
+					u[j] = phi * INV_TWO_PI;
 				}
-				const u32 index[4]{
-					phi_count + i * phi_count,
-					phi_count + (i + 1) * phi_count,
-					1 + (i + 1) * phi_count,
-					1 + i * phi_count,
-				};
 
-				uvs[c] = { 1.f - inv_phi_count, 1.f - (i + 1) * inv_theta_count };
-				m.raw_indicies[c++] = index[0];
-				uvs[c] = { 1.f - inv_phi_count, 1.f - (i + 2) * inv_theta_count };
-				m.raw_indicies[c++] = index[1];
-				uvs[c] = { 1.f, 1.f - (i + 2) * inv_theta_count };
-				m.raw_indicies[c++] = index[2];
-
-				uvs[c] = { 1.f - inv_phi_count, 1.f - (i + 1) * inv_theta_count };
-				m.raw_indicies[c++] = index[0];
-				uvs[c] = { 1.f, 1.f - (i + 2) * inv_theta_count };
-				m.raw_indicies[c++] = index[2];
-				uvs[c] = { 1.f, 1.f - (i + 1) * inv_theta_count };
-				m.raw_indicies[c++] = index[3];
+				f32 min_u{ 1.f }, max_u{ 0.f };
+				for (u32 j{ 0 }; j < 3; ++j) {
+					if (is_pole[j]) continue;
+					min_u = std::min(min_u, u[j]);
+					max_u = std::max(max_u, u[j]);
+				}
+
+				if (max_u - min_u > .5f) {
+					for (u32 j{ 0 }; j < 3; ++j) {
+						if (!is_pole[j] && u[j] < .5f) u[j] += 1.f;
+					}
+				}
+
+				for (u32 j{ 0 }; j < 3; ++j) {
+					if (!is_pole[j]) continue;
+					const u32 j1{ (j + 1) % 3 }, j2{ (j + 2) % 3 };
+					u[j] = .5f * (u[j1] + u[j2]);
+				}
+
+				const u32 a{ add_sphere_vertex(triangles[i], u[0], is_pole[0]) };
+				const u32 b{ add_sphere_vertex(triangles[i + 1], u[1], is_pole[1]) };
+				const u32 c{ add_sphere_vertex(triangles[i + 2], u[2], is_pole[2]) };
+				add_triangle(m, a, b, c);
 			}
 
-			const u32 south_pole_index{ (u32)m.positions.size() - 1 };
-			for (u32 i{ 0 }; i < phi_count - 1; ++i) {
-				uvs[c] = { (2 * i + 1) * .5f * inv_phi_count, 0.f };
-				m.raw_indicies[c++] = south_pole_index;
-				uvs[c] = { (i + 1) * inv_phi_count, inv_theta_count };
-				m.raw_indicies[c++] = south_pole_index - phi_count + i + 1;
-				uvs[c] = { i * inv_phi_count, inv_theta_count };
-				m.raw_indicies[c++] = south_pole_index - phi_count + i;
+			return m;
+		}
+
+		Mesh create_cylinder(const PrimitiveInitInfo& info) {
+			const u32 phi_count{ clamp(info.segments[Axis::x], 3u, 64u) };
+			const u32 height_count{ clamp(info.segments[Axis::y], 1u, 64u) };
+			const u32 ring_count{ clamp(info.segments[Axis::z], 1u, 64u) };
+
+			Mesh m{};
+			m.name = "cylinder";
+
+			add_grid(m, phi_count, height_count, [&](u32 column, u32 row) {
+				const f32 u{ (f32)column / phi_count };
+				const f32 v{ (f32)row / height_count };
+				PrimitiveVertex pv{ sphere_vertex(HALF_PI, u * TWO_PI, { u, v }) };
+				pv.position.y = 1.f - 2.f * v;
+				return transform(pv, info.size);
+			});
+
+			for (const f32 y : { 1.f, -1.f }) {
+				add_grid(m, phi_count, ring_count, [&](u32 column, u32 row) {
+					const f32 r{ 1.f - (f32)row / ring_count };
+					f32 sin_phi, cos_phi;
+					XMScalarSinCos(&sin_phi, &cos_phi, column * TWO_PI / phi_count);
+					const v3 position{ r * cos_phi, y, -r * sin_phi };
+					const v2 uv{ position.x * .5f + .5f, position.z * .5f + .5f };
+					return transform({ position, { 0.f, y, 0.f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f, 1.f }, uv }, info.size);
+				});
 			}
 
-			uvs[c] = { 1.f - .5f * inv_phi_count, 0.f };
-			m.raw_indicies[c++] = south_pole_index;
-			uvs[c] = { 1.f, inv_theta_count };
-			m.raw_indicies[c++] = south_pole_index - phi_count;
-			uvs[c] = { 1.f - inv_phi_count, inv_theta_count };
-			m.raw_indicies[c++] = south_pole_index - 1;
+			remove_unused_verticies(m);
 
-			assert(c == num_indicies);
+			return m;
+		}
+
+		Mesh create_capsule(const PrimitiveInitInfo& info) {
+			const u32 phi_count{ clamp(info.segments[Axis::x], 3u, 64u) };
+			const u32 cap_ring_count{ clamp(info.segments[Axis::y], 1u, 32u) };
+			const u32 height_count{ clamp(info.segments[Axis::z], 1u, 64u) };
+
+			// Hemispherical caps, the straight part takes whatever height is left.
+			const f32 cap_height{ std::min(info.size.y, std::min(info.size.x, info.size.z)) };
+			const f32 half_height{ info.size.y - cap_height };
+			const v3 cap_scale{ info.size.x, cap_height, info.size.z };
+
+			struct Ring {
+				f32 theta;
+				f32 offset;
+			};
 
-			m.uv_sets.emplace_back(uvs);
+			util::vector<Ring> rings{};
+			for (u32 i{ 0 }; i <= cap_ring_count; ++i) rings.emplace_back(Ring{ HALF_PI * i / cap_ring_count, half_height });
+			for (u32 i{ 1 }; i < height_count; ++i) rings.emplace_back(Ring{ HALF_PI, half_height - 2.f * half_height * i / height_count });
+			for (u32 i{ 0 }; i <= cap_ring_count; ++i) rings.emplace_back(Ring{ HALF_PI + HALF_PI * i / cap_ring_count, -half_height });
+
+			const u32 row_count{ (u32)rings.size() - 1 };
+
+			Mesh m{};
+			m.name = "capsule";
+
+			add_grid(m, phi_count, row_count, [&](u32 column, u32 row) {
+				const f32 u{ (f32)column / phi_count };
+				const f32 v{ (f32)row / row_count };
+				return transform(sphere_vertex(rings[row].theta, u * TWO_PI, { u, v }), cap_scale, { 0.f, rings[row].offset, 0.f });
+			});
+
+			remove_unused_verticies(m);
 
 			return m;
 		}
 
-		void create_plane(Scene& scene, const PrimitiveInitInfo& info) {
-			LodGroup lod{};
-			lod.name = "plane";
-			lod.meshes.emplace_back(create_plane(info));
-			scene.lod_groups.emplace_back(lod);
-		};
+		void create_primitive_lods(Scene& scene, const PrimitiveInitInfo& info) {
+			const u32 lod_count{ clamp(info.lod_count, 1u, max_lod_count) };
+			const f32 radius{ std::max(info.size.x, std::max(info.size.y, info.size.z)) };
 
-		void create_cube(Scene& scene, const PrimitiveInitInfo& info) {};
-		void create_uv_sphere(Scene& scene, const PrimitiveInitInfo& info) {
 			LodGroup lod{};
-			lod.name = "uv_sphere";
-			lod.meshes.emplace_back(create_uv_sphere(info));
+
+			for (u32 i{ 0 }; i < lod_count; ++i) {
+				PrimitiveInitInfo lod_info{ info };
+				for (u32 axis{ 0 }; axis < 3; ++axis) {
+					lod_info.segments[axis] = std::max(info.segments[axis] >> i, 1u);
+				}
+
+				Mesh m{ creators[info.type](lod_info) };
+				m.lod_id = i;
+				m.lod_threshold = i ? radius * lod_distance_factor * (f32)(1 << (i - 1)) : -1.f;
+				lod.name = m.name;
+				lod.meshes.emplace_back(m);
+			}
+
 			scene.lod_groups.emplace_back(lod);
-		};
-		void create_ico_sphere(Scene& scene, const PrimitiveInitInfo& info) {};
-		void create_cylinder(Scene& scene, const PrimitiveInitInfo& info) {};
-		void create_capsule(Scene& scene, const PrimitiveInitInfo& info) {};
+		}
 	}
 
 	EDITOR_INTERFACE void create_primitive_mesh(SceneData* data, PrimitiveInitInfo* info) {
 		assert(data && info);
 		assert(info->type < PrimitiveMeshType::count);
 		Scene scene{};
-		creators[info->type](scene, *info);
+		create_primitive_lods(scene, *info);
 
-		Progression progression{};
-		process_scene(scene, data->settings, &progression);
+		process_prebuilt_scene(scene, data->settings);
 		pack_data(scene, *data);
 	}
+
+	EDITOR_INTERFACE void create_primitive_meshes(SceneData* data, PrimitiveInitInfo* info, u32 count) {
+		assert(data && info && count);
+
+		thread_pool::parallel_for(count, [&](u32 i) {
+			create_primitive_mesh(&data[i], &info[i]);
+		});
+	}
 }
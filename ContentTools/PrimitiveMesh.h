@@ -16,6 +16,6 @@ namespace lightning::tools {
 		PrimitiveMeshType type;
 		u32 segments[3]{ 1, 1, 1 };
 		math::v3 size{ 1, 1, 1 };
-		u32 lod{ 0 };
+		u32 lod_count{ 1 };	// number of LODs to generate, each one halves the segment counts
 	};
 }
\ No newline at end of file
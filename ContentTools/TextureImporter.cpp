@@ -1,8 +1,14 @@
 #include "ToolsCommon.h"
 #include "Content/ContentToEngine.h"
 #include "Utilities/IOStream.h"
+#include "ContentCache.h"
+#include "BlockCompression.h"
+#include "MipGeneration.h"
+#include "ThreadPool.h"
 #include <directXTex.h>
 #include <dxgi1_6.h>
+#include <atomic>
+#include <condition_variable>
 
 using namespace DirectX;
 using namespace Microsoft::WRL;
@@ -11,7 +17,9 @@ namespace lightning::tools {
 
 	bool is_normal_map(const Image* const image);
 	HRESULT equirectangular_to_cubemap(ID3D11Device* device, const Image* env_maps, u32 env_map_count, u32 cubemap_size, bool use_prefilter_size, bool mirror_cubemap, ScratchImage& cubemaps);
-	HRESULT equirectangular_to_cubemap(const Image* env_maps, u32 env_map_count, u32 cubemap_size, bool use_prefilter_size, bool mirror_cubemap, ScratchImage& cubemaps);
+	HRESULT equirectangular_to_cubemap(const Image* env_maps, u32 env_map_count, u32 cubemap_size, bool use_prefilter_size, bool mirror_cubemap, bool bilinear, ScratchImage& cubemaps);
+	HRESULT prefilter_specular(const ScratchImage& cubemaps, ScratchImage& prefiltered);
+	HRESULT prefilter_diffuse(const ScratchImage& cubemaps, ScratchImage& prefiltered);
 
 	namespace {
 
@@ -40,6 +48,14 @@ namespace lightning::tools {
 			};
 		};
 
+		struct CubemapPrefilter {
+			enum Type : u32 {
+				NONE,
+				SPECULAR,
+				DIFFUSE
+			};
+		};
+
 		struct TextureImportSettings {
 			char* sources;
 			u32 source_count;
@@ -52,6 +68,9 @@ namespace lightning::tools {
 			u32 cubemap_size;
 			u32 mirror_cubemap;
 			u32 prefilter_cubemap;
+			u32 bilinear_cubemap;
+			u32 compression_quality;
+			u32 mip_filter;
 		};
 
 		struct TextureInfo {
@@ -74,6 +93,11 @@ namespace lightning::tools {
 			TextureImportSettings import_settings;
 		};
 
+		struct SourceImages {
+			util::vector<ScratchImage> scratch_images;
+			util::vector<Image> images;
+		};
+
 		struct D3D12Device {
 			ComPtr<ID3D11Device> device;
 			std::mutex hw_compression_mutex;
@@ -238,74 +262,170 @@ namespace lightning::tools {
 			set_or_clear_flags(info.flags, TextureFlags::IS_SRGB, IsSRGB(format));
 		}
 
+		// Writes the scratch image as a texture container, data->info has to be up to date.
 		void copy_subresources(const ScratchImage& scratch, TextureData* const data) {
-			const Image* const images{ scratch.GetImages() };
-			const u32 image_count{ (u32)scratch.GetImageCount() };
-			assert(images && scratch.GetMetadata().mipLevels && scratch.GetMetadata().mipLevels <= TextureData::max_mips);
-
-			u64 subresource_size{ 0 };
+			using namespace lightning::content;
+			using header_type = TextureContainerHeader;
 
-			for (u32 i{ 0 }; i < image_count; ++i) {
-				subresource_size += sizeof(u32) * 4 + images[i].slicePitch;
+			const TexMetadata& metadata{ scratch.GetMetadata() };
+			assert(scratch.GetImages() && metadata.mipLevels && metadata.mipLevels <= TextureData::max_mips);
+
+			const bool is_3d{ metadata.IsVolumemap() };
+			const u32 mip_levels{ (u32)metadata.mipLevels };
+			const u32 array_size{ is_3d ? 1 : (u32)metadata.arraySize };
+			const u32 subresource_count{ array_size * mip_levels };
+			util::vector<TextureSubresource> subresources(subresource_count);
+
+			const u64 data_offset{ math::align_size_up<header_type::placement_alignment>(sizeof(header_type) + sizeof(TextureSubresource) * subresource_count) };
+			u64 offset{ data_offset };
+
+			// Smallest mip first, so the mip tail can be loaded without the rest of the data.
+			for (u32 mip{ mip_levels }; mip-- > 0;) {
+				for (u32 item{ 0 }; item < array_size; ++item) {
+					const Image& image{ *scratch.GetImage(mip, item, 0) };
+					const u32 row_count{ (u32)(image.slicePitch / image.rowPitch) };
+					const u32 row_pitch{ (u32)math::align_size_up<header_type::row_pitch_alignment>(image.rowPitch) };
+					const u32 depth{ is_3d ? std::max((u32)metadata.depth >> mip, 1u) : 1 };
+
+					TextureSubresource& subresource{ subresources[item * mip_levels + mip] };
+					subresource.offset = offset;
+					subresource.width = (u32)image.width;
+					subresource.height = (u32)image.height;
+					subresource.depth = depth;
+					subresource.row_count = row_count;
+					subresource.row_pitch = row_pitch;
+					subresource.slice_pitch = row_pitch * row_count;
+
+					offset = math::align_size_up<header_type::placement_alignment>(offset + (u64)subresource.slice_pitch * depth);
+				}
 			}
 
-			if (subresource_size > ~(u32)0) {
+			if (offset > ~(u32)0) {
 				// Support up to 4GB per resource
 				data->info.import_error = ImportError::MAX_SIZE_EXCEEDED;
 				return;
 			}
 
-			data->subresource_size = (u32)subresource_size;
-			data->subresource_data = (u8* const)CoTaskMemRealloc(data->subresource_data, subresource_size);
+			data->subresource_size = (u32)offset;
+			data->subresource_data = (u8* const)CoTaskMemRealloc(data->subresource_data, offset);
 			assert(data->subresource_data);
+			memset(data->subresource_data, 0, offset);
+
+			header_type& header{ *(header_type*)data->subresource_data };
+			header.version = header_type::current_version;
+			header.width = data->info.width;
+			header.height = data->info.height;
+			header.array_size = data->info.array_size;
+			header.flags = data->info.flags;
+			header.mip_levels = data->info.mip_levels;
+			header.format = data->info.format;
+			header.subresource_count = subresource_count;
+			header.data_offset = data_offset;
+			header.data_size = offset - data_offset;
+			memcpy(data->subresource_data + sizeof(header_type), subresources.data(), sizeof(TextureSubresource) * subresource_count);
+
+			for (u32 item{ 0 }; item < array_size; ++item) {
+				for (u32 mip{ 0 }; mip < mip_levels; ++mip) {
+					const TextureSubresource& subresource{ subresources[item * mip_levels + mip] };
+
+					for (u32 slice{ 0 }; slice < subresource.depth; ++slice) {
+						const Image& image{ *scratch.GetImage(mip, item, slice) };
+						u8* const dst{ data->subresource_data + subresource.offset + (u64)subresource.slice_pitch * slice };
+
+						for (u32 row{ 0 }; row < subresource.row_count; ++row) {
+							memcpy(dst + (u64)subresource.row_pitch * row, image.pixels + image.rowPitch * row, image.rowPitch);
+						}
+					}
+				}
+			}
+		}
 
-			util::BlobStreamWriter blob{ data->subresource_data, data->subresource_size };
-
-			for (u32 i{ 0 }; i < image_count; ++i) {
-				const Image& image{ images[i] };
-				blob.write((u32)image.width);
-				blob.write((u32)image.height);
-				blob.write((u32)image.rowPitch);
-				blob.write((u32)image.slicePitch);
-				blob.write(image.pixels, image.slicePitch);
+		// Hash of the source files' content and the settings, 0 if any of the files can't be read.
+		u64 get_content_key(const util::vector<std::string>& files, const TextureImportSettings& settings) {
+			content_cache::KeyBuilder builder{ content::AssetType::TEXTURE };
+			for (const auto& file : files) {
+				if (!builder.add_file(file.c_str())) return 0;
 			}
+
+			// Everything after the source list affects the output.
+			constexpr u64 settings_offset{ offsetof(TextureImportSettings, source_count) };
+			builder.add((const u8*)&settings + settings_offset, sizeof(TextureImportSettings) - settings_offset);
+
+			return builder.key();
 		}
 
-		[[nodiscard]] util::vector<Image> subresource_data_to_images(TextureData* const data) {
-			assert(data && data->subresource_data && data->subresource_size);
-			assert(data->info.mip_levels && data->info.mip_levels <= TextureData::max_mips);
-			assert(data->info.array_size);
+		u64 get_cache_key(const util::vector<std::string>& files, const TextureImportSettings& settings) {
+			return content_cache::is_enabled() ? get_content_key(files, settings) : 0;
+		}
 
-			const TextureInfo& info{ data->info };
-			u32 image_count{ info.array_size };
+		bool load_from_cache(u64 key, TextureData* const data) {
+			util::vector<u8> buffer;
+			if (!key || !content_cache::load(key, buffer)) return false;
 
-			if (info.flags & content::TextureFlags::IS_VOLUME_MAP) {
-				u32 depth_per_miplevel{ info.array_size };
+			util::BlobStreamReader blob{ buffer.data() };
+			blob.read((u8*)&data->info, sizeof(TextureInfo));
+			const u32 subresource_size{ blob.read<u32>() };
+			const u32 icon_size{ blob.read<u32>() };
 
-				for (u32 i{ 1 }; i < info.mip_levels; ++i) {
-					depth_per_miplevel = std::max(depth_per_miplevel >> 1, (u32)1);
-					image_count += depth_per_miplevel;
-				}
-			}
-			else {
-				image_count *= info.mip_levels;
+			data->subresource_size = subresource_size;
+			data->subresource_data = (u8* const)CoTaskMemRealloc(data->subresource_data, subresource_size);
+			assert(data->subresource_data);
+			blob.read(data->subresource_data, subresource_size);
+
+			if (icon_size) {
+				data->icon_size = icon_size;
+				data->icon = (u8* const)CoTaskMemRealloc(data->icon, icon_size);
+				assert(data->icon);
+				blob.read(data->icon, icon_size);
 			}
 
-			util::BlobStreamReader blob{ data->subresource_data };
-			util::vector<Image> images(image_count);
+			return true;
+		}
 
-			for (u32 i{ 0 }; i < image_count; ++i) {
-				Image image{};
-				image.width = blob.read<u32>();
-				image.height = blob.read<u32>();
-				image.format = (DXGI_FORMAT)info.format;
-				image.rowPitch = blob.read<u32>();
-				image.slicePitch = blob.read<u32>();
-				image.pixels = (u8*)blob.position();
+		void store_in_cache(u64 key, const TextureData* const data) {
+			if (!key || data->info.import_error || !data->subresource_data) return;
+
+			const u32 icon_size{ data->icon ? data->icon_size : 0 };
+			const u64 size{ sizeof(TextureInfo) + sizeof(u32) * 2 + data->subresource_size + icon_size };
+			util::vector<u8> buffer(size);
+			util::BlobStreamWriter blob{ buffer.data(), buffer.size() };
+
+			blob.write((const u8*)&data->info, sizeof(TextureInfo));
+			blob.write(data->subresource_size);
+			blob.write(icon_size);
+			blob.write(data->subresource_data, data->subresource_size);
+			if (icon_size) blob.write(data->icon, icon_size);
+
+			content_cache::store(key, buffer.data(), buffer.size());
+		}
+
+		[[nodiscard]] util::vector<Image> subresource_data_to_images(TextureData* const data) {
+			using namespace lightning::content;
+			assert(data && data->subresource_data && data->subresource_size);
+
+			const TextureContainerHeader& header{ *(const TextureContainerHeader*)data->subresource_data };
+			assert(header.version == TextureContainerHeader::current_version);
+			assert(header.mip_levels && header.mip_levels <= TextureData::max_mips);
+			assert(header.subresource_count);
+
+			const TextureSubresource* const subresources{ get_texture_subresources(data->subresource_data) };
+			util::vector<Image> images{};
 
-				blob.skip(image.slicePitch);
+			// Same order as ScratchImage: array slice major, then mips, then depth slices.
+			for (u32 i{ 0 }; i < header.subresource_count; ++i) {
+				const TextureSubresource& subresource{ subresources[i] };
 
-				images[i] = image;
+				for (u32 slice{ 0 }; slice < subresource.depth; ++slice) {
+					Image image{};
+					image.width = subresource.width;
+					image.height = subresource.height;
+					image.format = (DXGI_FORMAT)header.format;
+					image.rowPitch = subresource.row_pitch;
+					image.slicePitch = subresource.slice_pitch;
+					image.pixels = data->subresource_data + subresource.offset + (u64)subresource.slice_pitch * slice;
+
+					images.emplace_back(image);
+				}
 			}
 
 			return images;
@@ -332,8 +452,19 @@ namespace lightning::tools {
 			blob.write(image.pixels, image.slicePitch);
 		}
 
+		// WIC needs COM on every thread that loads files. The pool threads are the engine's, so every thread
+		// initializes COM the first time it loads a file and uninitializes it when it exits.
+		struct ComScope {
+			ComScope() : result{ CoInitializeEx(nullptr, COINIT_MULTITHREADED) } {}
+			~ComScope() { if (SUCCEEDED(result)) CoUninitialize(); }
+			DISABLE_COPY_AND_MOVE(ComScope);
+
+			const HRESULT result;
+		};
+
 		[[nodiscard]] ScratchImage load_from_file(TextureData* const data, const char* file_name) {
 			using namespace lightning::content;
+			thread_local const ComScope com_scope{};
 
 			assert(file_exists(file_name));
 
@@ -389,7 +520,7 @@ namespace lightning::tools {
 			return scratch;
 		}
 
-		[[nodiscard]] ScratchImage generate_mipmaps(const ScratchImage& source, TextureInfo& info, u32 mip_levels, bool is_3d) {
+		[[nodiscard]] ScratchImage generate_mipmaps(const ScratchImage& source, TextureInfo& info, const TextureImportSettings& settings, u32 mip_levels, bool is_3d, bool normal_map, util::vector<XMFLOAT4>* const mip_buffer) {
 			const TexMetadata& metadata{ source.GetMetadata() };
 			mip_levels = math::clamp(mip_levels, (u32)0, get_max_mip_count((u32)metadata.width, (u32)metadata.height, (u32)metadata.depth));
 			HRESULT hr{ S_OK };
@@ -397,7 +528,14 @@ namespace lightning::tools {
 			ScratchImage mip_scratch{};
 
 			if (!is_3d) {
-				hr = GenerateMipMaps(source.GetImages(), source.GetImageCount(), source.GetMetadata(), TEX_FILTER_DEFAULT, mip_levels, mip_scratch);
+				mips::MipSettings mip_settings{};
+				mip_settings.mip_levels = mip_levels;
+				mip_settings.filter = (mips::Filter::Type)std::min(settings.mip_filter, (u32)mips::Filter::LANCZOS);
+				mip_settings.alpha_threshold = settings.alpha_threshold;
+				mip_settings.renormalize = normal_map;
+				mip_settings.scratch_buffer = mip_buffer;
+
+				hr = mips::generate_mip_chain(source, mip_settings, mip_scratch);
 			}
 			else {
 				hr = GenerateMipMaps3D(source.GetImages(), source.GetImageCount(), source.GetMetadata(), TEX_FILTER_DEFAULT, mip_levels, mip_scratch);
@@ -411,13 +549,16 @@ namespace lightning::tools {
 			return mip_scratch;
 		}
 
-		[[nodiscard]] ScratchImage initialize_from_images(TextureData* const data, const util::vector<Image>& images) {
+		// normal_map tells whether the top level was classified as a normal map. The classification reads every texel,
+		// so it runs once here and the result is reused for mip filtering and the output format.
+		[[nodiscard]] ScratchImage initialize_from_images(TextureData* const data, const util::vector<Image>& images, util::vector<XMFLOAT4>* const mip_buffer, bool& normal_map) {
 			assert(data);
 			const TextureImportSettings& settings{ data->import_settings };
 
 			ScratchImage scratch;
 			HRESULT hr{ S_OK };
 			const u32 array_size{ (u32)images.size() };
+			const bool prefilter{ settings.dimension == TextureDimension::TEXTURE_CUBE && settings.prefilter_cubemap != CubemapPrefilter::NONE };
 
 			{
 				ScratchImage working_scratch{};
@@ -433,7 +574,7 @@ namespace lightning::tools {
 					
 					if (math::is_equal((f32)image.width / (f32)image.height, 2.f)) {
 						if (!run_on_gpu([&](ID3D11Device* device) {hr = equirectangular_to_cubemap(device, images.data(), array_size, settings.cubemap_size, settings.prefilter_cubemap, settings.mirror_cubemap, working_scratch); })) {
-							hr = equirectangular_to_cubemap(images.data(), array_size, settings.cubemap_size, settings.prefilter_cubemap, settings.mirror_cubemap, working_scratch);
+							hr = equirectangular_to_cubemap(images.data(), array_size, settings.cubemap_size, settings.prefilter_cubemap, settings.mirror_cubemap, settings.bilinear_cubemap, working_scratch);
 						}
 					}
 					else if (array_size % 6 || image.width != image.height) {
@@ -449,6 +590,12 @@ namespace lightning::tools {
 					hr = working_scratch.Initialize3DFromImages(images.data(), images.size());
 				}
 
+				if (SUCCEEDED(hr) && prefilter) {
+					ScratchImage prefiltered{};
+					hr = settings.prefilter_cubemap == CubemapPrefilter::DIFFUSE ? prefilter_diffuse(working_scratch, prefiltered) : prefilter_specular(working_scratch, prefiltered);
+					working_scratch = std::move(prefiltered);
+				}
+
 				if (FAILED(hr)) {
 					data->info.import_error = ImportError::UNKNOWN;
 					return{};
@@ -457,14 +604,18 @@ namespace lightning::tools {
 				scratch = std::move(working_scratch);
 			}
 
-			if (settings.mip_levels != 1 || settings.prefilter_cubemap) {
-				scratch = generate_mipmaps(scratch, data->info, settings.prefilter_cubemap ? 0 : settings.mip_levels, settings.dimension == TextureDimension::TEXTURE_3D);
+			const bool is_3d{ settings.dimension == TextureDimension::TEXTURE_3D };
+			const bool generate_mips{ settings.mip_levels != 1 && !prefilter };
+			normal_map = (settings.compress || (generate_mips && !is_3d)) && is_normal_map(scratch.GetImage(0, 0, 0));
+
+			if (generate_mips) {
+				scratch = generate_mipmaps(scratch, data->info, settings, settings.mip_levels, is_3d, normal_map, mip_buffer);
 			}
 
 			return scratch;
 		}
 
-		DXGI_FORMAT determine_output_format(TextureData* const data, ScratchImage& scratch, const Image* const image) {
+		DXGI_FORMAT determine_output_format(TextureData* const data, ScratchImage& scratch, const Image* const image, bool normal_map) {
 			using namespace lightning::content;
 
 			assert(data && data->import_settings.compress);
@@ -481,7 +632,7 @@ namespace lightning::tools {
 			else if (image_format == DXGI_FORMAT_R8_UNORM || image_format == DXGI_FORMAT_BC4_UNORM || image_format == DXGI_FORMAT_BC4_SNORM) {
 				output_format = DXGI_FORMAT_BC4_UNORM;
 			}
-			else if (is_normal_map(image) || image_format == DXGI_FORMAT_BC5_UNORM || image_format == DXGI_FORMAT_BC5_SNORM) {
+			else if (normal_map || image_format == DXGI_FORMAT_BC5_UNORM || image_format == DXGI_FORMAT_BC5_SNORM) {
 				data->info.flags |= TextureFlags::IS_IMPORTED_AS_NORMAL_MAP;
 				output_format = DXGI_FORMAT_BC5_UNORM;
 
@@ -515,7 +666,59 @@ namespace lightning::tools {
 			return false;
 		}
 
-		[[nodiscard]] ScratchImage compress_image(TextureData* const data, ScratchImage& scratch) {
+		bool get_block_format(DXGI_FORMAT format, bc::Format::Type& block_format) {
+			switch (format) {
+			case DXGI_FORMAT_BC1_UNORM:
+			case DXGI_FORMAT_BC1_UNORM_SRGB: block_format = bc::Format::BC1; return true;
+			case DXGI_FORMAT_BC3_UNORM:
+			case DXGI_FORMAT_BC3_UNORM_SRGB: block_format = bc::Format::BC3; return true;
+			case DXGI_FORMAT_BC4_UNORM: block_format = bc::Format::BC4; return true;
+			case DXGI_FORMAT_BC5_UNORM: block_format = bc::Format::BC5; return true;
+			case DXGI_FORMAT_BC6H_UF16: block_format = bc::Format::BC6H; return true;
+			case DXGI_FORMAT_BC7_UNORM:
+			case DXGI_FORMAT_BC7_UNORM_SRGB: block_format = bc::Format::BC7; return true;
+			}
+
+			return false;
+		}
+
+		[[nodiscard]] HRESULT compress_blocks(const ScratchImage& scratch, DXGI_FORMAT output_format, bc::Format::Type block_format, const TextureImportSettings& settings, ScratchImage& bc_scratch) {
+			// Keep the sRGB encoding of the source, the block encoders work on the stored values.
+			const DXGI_FORMAT working_format{ block_format == bc::Format::BC6H ? DXGI_FORMAT_R16G16B16A16_FLOAT : IsSRGB(output_format) ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM };
+			const ScratchImage* source{ &scratch };
+			ScratchImage working_scratch{};
+			HRESULT hr{ S_OK };
+
+			if (scratch.GetMetadata().format != working_format) {
+				hr = Convert(scratch.GetImages(), scratch.GetImageCount(), scratch.GetMetadata(), working_format, TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, working_scratch);
+				if (FAILED(hr)) return hr;
+				source = &working_scratch;
+			}
+
+			TexMetadata metadata{ source->GetMetadata() };
+			metadata.format = output_format;
+			hr = bc_scratch.Initialize(metadata);
+			if (FAILED(hr)) return hr;
+
+			const u32 image_count{ (u32)source->GetImageCount() };
+			assert(image_count == bc_scratch.GetImageCount());
+			util::vector<bc::SourceImage> sources(image_count);
+			util::vector<bc::BlockImage> targets(image_count);
+
+			for (u32 i{ 0 }; i < image_count; ++i) {
+				const Image& src{ source->GetImages()[i] };
+				const Image& dst{ bc_scratch.GetImages()[i] };
+				sources[i] = { src.pixels, (u32)src.width, (u32)src.height, (u32)src.rowPitch };
+				targets[i] = { dst.pixels, (u32)dst.rowPitch };
+			}
+
+			const bc::Quality::Level quality{ (bc::Quality::Level)std::min(settings.compression_quality, (u32)bc::Quality::HIGH) };
+			bc::compress(sources.data(), targets.data(), image_count, block_format, quality, settings.alpha_threshold);
+
+			return hr;
+		}
+
+		[[nodiscard]] ScratchImage compress_image(TextureData* const data, ScratchImage& scratch, bool normal_map) {
 			assert(data && data->import_settings.compress && scratch.GetImages());
 			const Image* const image{ scratch.GetImage(0, 0, 0) };
 
@@ -524,12 +727,19 @@ namespace lightning::tools {
 				return {};
 			}
 
-			const DXGI_FORMAT output_format{ determine_output_format(data, scratch, image) };
+			const DXGI_FORMAT output_format{ determine_output_format(data, scratch, image, normal_map) };
 			HRESULT hr{ S_OK };
 			ScratchImage bc_scratch;
 
 			if (!(can_use_gpu(output_format) && run_on_gpu([&](ID3D11Device* device) { hr = Compress(device, scratch.GetImages(), scratch.GetImageCount(), scratch.GetMetadata(), output_format, TEX_COMPRESS_DEFAULT, 1.f, bc_scratch); }))) {
-				hr = Compress(scratch.GetImages(), scratch.GetImageCount(), scratch.GetMetadata(), output_format, TEX_COMPRESS_PARALLEL, data->import_settings.alpha_threshold, bc_scratch);
+				bc::Format::Type block_format{};
+
+				if (get_block_format(output_format, block_format)) {
+					hr = compress_blocks(scratch, output_format, block_format, data->import_settings, bc_scratch);
+				}
+				else {
+					hr = Compress(scratch.GetImages(), scratch.GetImageCount(), scratch.GetMetadata(), output_format, TEX_COMPRESS_PARALLEL, data->import_settings.alpha_threshold, bc_scratch);
+				}
 			}
 
 			if (FAILED(hr)) {
@@ -571,6 +781,96 @@ namespace lightning::tools {
 
 			return scratch;
 		}
+
+		void load_source_images(TextureData* const data, const util::vector<std::string>& files, SourceImages& sources) {
+			sources.scratch_images.clear();
+			sources.images.clear();
+
+			u32 width{ 0 };
+			u32 height{ 0 };
+			DXGI_FORMAT format{};
+
+			for (u32 i{ 0 }; i < files.size(); ++i) {
+				sources.scratch_images.emplace_back(load_from_file(data, files[i].c_str()));
+				if (data->info.import_error) return;
+
+				const ScratchImage& scratch{ sources.scratch_images.back() };
+				const TexMetadata& metadata{ scratch.GetMetadata() };
+
+				if (i == 0) {
+					width = (u32)metadata.width;
+					height = (u32)metadata.height;
+					format = metadata.format;
+				}
+
+				if (width != metadata.width || height != metadata.height) {
+					data->info.import_error = ImportError::SIZE_MISMATCH;
+					return;
+				}
+
+				if (format != metadata.format) {
+					data->info.import_error = ImportError::FORMAT_MISMATCH;
+					return;
+				}
+
+				const u32 array_size{ (u32)metadata.arraySize };
+				const u32 depth{ (u32)metadata.depth };
+
+				for (u32 array_index{ 0 }; array_index < array_size; ++array_index) {
+					for (u32 depth_index{ 0 }; depth_index < depth; ++depth_index) {
+						const Image* image{ scratch.GetImage(0, array_index, depth_index) };
+						assert(image);
+
+						if (!image) {
+							data->info.import_error = ImportError::UNKNOWN;
+							return;
+						}
+
+						if (width != image->width || height != image->height) {
+							data->info.import_error = ImportError::SIZE_MISMATCH;
+							return;
+						}
+
+						sources.images.emplace_back(*image);
+					}
+				}
+			}
+		}
+
+		void finalize_texture(TextureData* const data, ScratchImage& scratch, bool normal_map, u64 cache_key) {
+			if (data->import_settings.compress) {
+				ScratchImage bc_scratch{ compress_image(data, scratch, normal_map) };
+
+				if (data->info.import_error) return;
+
+				assert(bc_scratch.GetImages());
+				copy_icon(bc_scratch.GetImages()[0], data);
+
+				scratch = std::move(bc_scratch);
+			}
+
+			texture_info_from_metadata(scratch.GetMetadata(), data->info);
+			copy_subresources(scratch, data);
+			store_in_cache(cache_key, data);
+		}
+
+		void copy_texture_data(const TextureData* const src, TextureData* const dst) {
+			dst->info = src->info;
+
+			if (src->subresource_data) {
+				dst->subresource_size = src->subresource_size;
+				dst->subresource_data = (u8* const)CoTaskMemRealloc(dst->subresource_data, src->subresource_size);
+				assert(dst->subresource_data);
+				memcpy(dst->subresource_data, src->subresource_data, src->subresource_size);
+			}
+
+			if (src->icon) {
+				dst->icon_size = src->icon_size;
+				dst->icon = (u8* const)CoTaskMemRealloc(dst->icon, src->icon_size);
+				assert(dst->icon);
+				memcpy(dst->icon, src->icon, src->icon_size);
+			}
+		}
 	}
 
 	void shutdown_texture_tools() {
@@ -591,8 +891,8 @@ namespace lightning::tools {
 		ScratchImage scratch{ decompress_image(data) };
 
 		if (!data->info.import_error) {
-			copy_subresources(scratch, data);
 			texture_info_from_metadata(scratch.GetMetadata(), data->info);
+			copy_subresources(scratch, data);
 		}
 	}
 
@@ -600,77 +900,150 @@ namespace lightning::tools {
 		const TextureImportSettings& settings{ data->import_settings };
 		assert(settings.sources&& settings.source_count);
 
-		util::vector<ScratchImage> scratch_images;
-		util::vector<Image> images;
-
-		u32 width{ 0 };
-		u32 height{ 0 };
-		DXGI_FORMAT format{};
 		util::vector<std::string> files = split(settings.sources, ';');
 		assert(files.size() == settings.source_count);
 
-		for (u32 i{ 0 }; i < settings.source_count; ++i) {
-			scratch_images.emplace_back(load_from_file(data, files[i].c_str()));
-			if (data->info.import_error) return;
+		const u64 cache_key{ get_cache_key(files, settings) };
+		if (load_from_cache(cache_key, data)) return;
 
-			const ScratchImage& scratch{ scratch_images.back() };
-			const TexMetadata& metadata{ scratch.GetMetadata() };
+		SourceImages sources{};
+		load_source_images(data, files, sources);
+		if (data->info.import_error) return;
+
+		bool normal_map{ false };
+		ScratchImage scratch{ initialize_from_images(data, sources.images, nullptr, normal_map) };
+		if (data->info.import_error) return;
 
-			if (i == 0) {
-				width = (u32)metadata.width;
-				height = (u32)metadata.height;
-				format = metadata.format;
+		finalize_texture(data, scratch, normal_map, cache_key);
+	}
+
+	// Identical sources with identical settings are imported once and copied to the duplicates.
+	// Decode, mip generation and compression are separate pool tasks, so one texture can be
+	// compressed while the next one is still decoding.
+	EDITOR_INTERFACE void import_batch(TextureData* const data, u32 count) {
+		assert(data && count);
+		constexpr u32 max_textures_in_flight{ 4 };
+
+		struct BatchItem {
+			util::vector<std::string> files;
+			u64 content_key;
+			u32 source_index;
+		};
+
+		// Every texture in flight owns a slot, the next texture reuses its buffers.
+		struct BatchSlot {
+			SourceImages sources;
+			ScratchImage scratch;
+			util::vector<XMFLOAT4> mip_buffer;
+			u32 item;
+			bool normal_map;
+		};
+
+		util::vector<BatchItem> items(count);
+
+		thread_pool::parallel_for(count, [&](u32 i) {
+			const TextureImportSettings& settings{ data[i].import_settings };
+			assert(settings.sources && settings.source_count);
+
+			items[i].files = split(settings.sources, ';');
+			assert(items[i].files.size() == settings.source_count);
+			items[i].content_key = get_content_key(items[i].files, settings);
+		});
+
+		util::vector<u32> unique_items{};
+		std::unordered_map<u64, u32> first_items{};
+
+		for (u32 i{ 0 }; i < count; ++i) {
+			BatchItem& item{ items[i] };
+			item.source_index = i;
+
+			if (item.content_key) {
+				const auto [it, inserted] { first_items.try_emplace(item.content_key, i) };
+
+				if (!inserted) {
+					item.source_index = it->second;
+					continue;
+				}
 			}
 
-			if (width != metadata.width || height != metadata.height) {
-				data->info.import_error = ImportError::SIZE_MISMATCH;
+			unique_items.emplace_back(i);
+		}
+
+		const u32 unique_count{ (u32)unique_items.size() };
+		const u32 slot_count{ std::min(unique_count, max_textures_in_flight) };
+		util::vector<BatchSlot> slots(slot_count);
+		std::atomic<u32> next_item{ 0 };
+		std::mutex batch_mutex;
+		std::condition_variable batch_finished;
+		u32 finished_slots{ 0 };
+
+		std::function<void(BatchSlot&)> decode;
+		std::function<void(BatchSlot&)> generate_mips;
+		std::function<void(BatchSlot&)> compress;
+
+		auto next = [&](BatchSlot& slot) {
+			slot.scratch.Release();
+			const u32 index{ next_item++ };
+
+			if (index < unique_count) {
+				slot.item = unique_items[index];
+				thread_pool::submit([&decode, &slot]() { decode(slot); });
 				return;
 			}
 
-			if (format != metadata.format) {
-				data->info.import_error = ImportError::FORMAT_MISMATCH;
+			std::lock_guard lock{ batch_mutex };
+			++finished_slots;
+			batch_finished.notify_one();
+		};
+
+		decode = [&](BatchSlot& slot) {
+			TextureData* const texture{ &data[slot.item] };
+			const u64 cache_key{ content_cache::is_enabled() ? items[slot.item].content_key : 0 };
+
+			if (load_from_cache(cache_key, texture)) {
+				next(slot);
 				return;
 			}
 
-			const u32 array_size{ (u32)metadata.arraySize };
-			const u32 depth{ (u32)metadata.depth };
+			load_source_images(texture, items[slot.item].files, slot.sources);
 
-			for (u32 array_index{ 0 }; array_index < array_size; ++array_index) {
-				for (u32 depth_index{ 0 }; depth_index < depth; ++depth_index) {
-					const Image* image{ scratch.GetImage(0, array_index, depth_index) };
-					assert(image);
+			if (texture->info.import_error) {
+				next(slot);
+				return;
+			}
 
-					if (!image) {
-						data->info.import_error = ImportError::UNKNOWN;
-						return;
-					}
+			thread_pool::submit([&generate_mips, &slot]() { generate_mips(slot); });
+		};
 
-					if (width != image->width || height != image->height) {
-						data->info.import_error = ImportError::SIZE_MISMATCH;
-						return;
-					}
+		generate_mips = [&](BatchSlot& slot) {
+			TextureData* const texture{ &data[slot.item] };
+			slot.scratch = initialize_from_images(texture, slot.sources.images, &slot.mip_buffer, slot.normal_map);
+			slot.sources.scratch_images.clear();
+			slot.sources.images.clear();
 
-					images.emplace_back(*image);
-				}
+			if (texture->info.import_error) {
+				next(slot);
+				return;
 			}
-		}
-
-		ScratchImage scratch{ initialize_from_images(data, images) };
 
-		if (data->info.import_error) return;
+			thread_pool::submit([&compress, &slot]() { compress(slot); });
+		};
 
-		if (settings.compress) {
-			ScratchImage bc_scratch{};
+		compress = [&](BatchSlot& slot) {
+			const u64 cache_key{ content_cache::is_enabled() ? items[slot.item].content_key : 0 };
+			finalize_texture(&data[slot.item], slot.scratch, slot.normal_map, cache_key);
+			next(slot);
+		};
 
-			if (data->info.import_error) return;
+		for (u32 i{ 0 }; i < slot_count; ++i) next(slots[i]);
 
-			assert(bc_scratch.GetImages());
-			copy_icon(bc_scratch.GetImages()[0], data);
-			
-			scratch = std::move(bc_scratch);
+		{
+			std::unique_lock lock{ batch_mutex };
+			batch_finished.wait(lock, [&]() { return finished_slots == slot_count; });
 		}
 
-		copy_subresources(scratch, data);
-		texture_info_from_metadata(scratch.GetMetadata(), data->info);
+		for (u32 i{ 0 }; i < count; ++i) {
+			if (items[i].source_index != i) copy_texture_data(&data[items[i].source_index], &data[i]);
+		}
 	}
-}
\ No newline at end of file
+}
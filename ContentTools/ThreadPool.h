@@ -0,0 +1,31 @@
+#pragma once
+#include "ToolsCommon.h"
+#include "Utilities/ThreadPool.h"
+
+// The content tools share the engine's thread pool, only the row splitting of image loops lives here.
+namespace lightning::tools::thread_pool {
+
+	using namespace util::thread_pool;
+
+	// A band of rows of one item (an image, a cube face, a mip...), the unit of work of row parallel loops.
+	struct RowJob {
+		u32 item;
+		u32 first_row;
+		u32 last_row;
+	};
+
+	// Splits the rows of every item into jobs of at most rows_per_job rows, row_count(item) gives the rows of an item.
+	// Jobs are in item and row order, so per job results can be reduced deterministically.
+	template<typename F> void split_rows(u32 item_count, u32 rows_per_job, F row_count, util::vector<RowJob>& jobs) {
+		assert(rows_per_job);
+		jobs.clear();
+
+		for (u32 item{ 0 }; item < item_count; ++item) {
+			const u32 rows{ row_count(item) };
+
+			for (u32 row{ 0 }; row < rows; row += rows_per_job) {
+				jobs.emplace_back(RowJob{ item, row, std::min(row + rows_per_job, rows) });
+			}
+		}
+	}
+}
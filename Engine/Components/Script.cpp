@@ -150,8 +150,10 @@ namespace lightning::script {
 			ptr->update(dt);
 		}
 
+		// Also called without changes, so the change flags of the previous frame are cleared.
+		transform::update(transform_cache.data(), (u32)transform_cache.size());
+
 		if (transform_cache.size()) {
-			transform::update(transform_cache.data(), (u32)transform_cache.size());
 			transform_cache.clear();
 			#if USE_TRANSFORM_CACHE_MAP
 			cache_map.clear();
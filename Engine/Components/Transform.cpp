@@ -91,6 +91,8 @@ namespace lightning::transform {
 			inv_world.emplace_back();
 			changes_from_previous_frame.emplace_back((u8)ComponentFlags::ALL);
 		}
+
+		calculate_transform_matrices(entity_index);
 		return Component{ transform_id{ entity.get_id()} };
 	}
 
@@ -121,7 +123,7 @@ namespace lightning::transform {
 	}
 
 	void update(const ComponentCache* const cache, u32 count) {
-		assert(cache && count);
+		assert(cache || !count);
 		if (read_write_flags) {
 			memset(changes_from_previous_frame.data(), 0, changes_from_previous_frame.size());
 			read_write_flags = 0;
@@ -147,6 +149,12 @@ namespace lightning::transform {
 				set_scale(c.id, c.scale);
 			}
 		}
+
+		// The renderer reads the matrices from several threads, so they're never calculated lazily during the frame.
+		for (u32 i{ 0 }; i < count; ++i) {
+			const id::id_type index{ id::index(cache[i].id) };
+			if (!has_transform[index]) calculate_transform_matrices(index);
+		}
 	}
 
 	math::v3 Component::position() const {
@@ -1,6 +1,12 @@
 #include "ContentToEngine.h"
 #include "Graphics/Renderer.h"
 #include "Utilities/IOStream.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <thread>
 
 namespace lightning::content {
 	namespace {
@@ -22,7 +28,8 @@ namespace lightning::content {
 					if (lods != u32_invalid_id) *((u32*)buffer) = lods;
 					_lod_count = *((u32*)buffer);
 					_thresholds = (f32*)(&buffer[sizeof(u32)]);
-					_lod_offsets = (LodOffset*)(&_thresholds[_lod_count]);
+					_bounds = (GeometryBounds*)(&_thresholds[_lod_count]);
+					_lod_offsets = (LodOffset*)(&_bounds[_lod_count]);
 					_gpu_ids = (id::id_type*)(&_lod_offsets[_lod_count]);
 				}
 
@@ -46,11 +53,13 @@ namespace lightning::content {
 
 				[[nodiscard]] constexpr u32 lod_count() const { return _lod_count; }
 				[[nodiscard]] constexpr f32* thresholds() const { return _thresholds; }
+				[[nodiscard]] constexpr GeometryBounds* bounds() const { return _bounds; }
 				[[nodiscard]] constexpr LodOffset* lod_offsets() const { return _lod_offsets; }
 				[[nodiscard]] constexpr id::id_type* gpu_ids() const { return _gpu_ids; }
 
 			private:
 				f32* _thresholds;
+				GeometryBounds* _bounds;
 				LodOffset* _lod_offsets;
 				id::id_type* _gpu_ids;
 				u32 _lod_count;
@@ -60,19 +69,197 @@ namespace lightning::content {
 		util::free_list<u8*> geometry_hierarchies;
 		std::mutex geometry_mutex;
 
+		constexpr u32 max_lod_count{ 8 };
+
+		// LOD data of every geometry in flat arrays indexed by geometry id, max_lod_count entries each.
+		// An entry doesn't change while its geometry is alive, so it's read without taking geometry_mutex.
+		// The table is only replaced when it has to grow, the old one is freed once no reader uses it.
+		struct LodTable {
+			util::vector<f32> thresholds;			// unused LODs are +inf
+			util::vector<LodOffset> lod_offsets;
+			util::vector<GeometryBounds> bounds;
+			util::vector<u32> lod_counts;
+		};
+
+		std::unique_ptr<LodTable> lod_table_owner;
+		std::atomic<const LodTable*> lod_table{ nullptr };
+		std::atomic<u32> lod_table_readers{ 0 };
+
+		class LodTableReader {
+			public:
+				DISABLE_COPY_AND_MOVE(LodTableReader);
+				LodTableReader() {
+					++lod_table_readers;
+					_table = lod_table.load();
+					assert(_table);
+				}
+
+				~LodTableReader() { --lod_table_readers; }
+
+				[[nodiscard]] constexpr const LodTable& table() const { return *_table; }
+
+			private:
+				const LodTable* _table;
+		};
+
+		// Call with geometry_mutex locked.
+		LodTable& writable_lod_table(id::id_type id) {
+			LodTable* const table{ lod_table_owner.get() };
+			if (table && id < table->lod_counts.size()) return *table;
+
+			std::unique_ptr<LodTable> new_table{ table ? std::make_unique<LodTable>(*table) : std::make_unique<LodTable>() };
+			const u64 capacity{ std::max((u64)id + 1, table ? table->lod_counts.size() * 2 : 64) };
+			new_table->thresholds.resize(capacity * max_lod_count, std::numeric_limits<f32>::infinity());
+			new_table->lod_offsets.resize(capacity * max_lod_count);
+			new_table->bounds.resize(capacity * max_lod_count);
+			new_table->lod_counts.resize(capacity, 0);
+
+			lod_table.store(new_table.get());
+			while (lod_table_readers.load()) std::this_thread::yield();
+
+			lod_table_owner = std::move(new_table);
+			return *lod_table_owner;
+		}
+
+		void set_lods(id::id_type id, u32 lod_count, const f32* const thresholds, const LodOffset* const lod_offsets, const GeometryBounds* const bounds) {
+			// Geometry with more LODs is rejected by create_geometry_resource.
+			assert(lod_count && lod_count <= max_lod_count);
+
+			LodTable& table{ writable_lod_table(id) };
+			const u64 first{ (u64)id * max_lod_count };
+
+			for (u32 i{ 0 }; i < max_lod_count; ++i) {
+				table.thresholds[first + i] = i < lod_count ? thresholds[i] : std::numeric_limits<f32>::infinity();
+				table.lod_offsets[first + i] = i < lod_count ? lod_offsets[i] : LodOffset{};
+				table.bounds[first + i] = i < lod_count ? bounds[i] : GeometryBounds{};
+			}
+
+			table.lod_counts[id] = lod_count;
+		}
+
+		// Same as GeometryHierarchyStream::lod_from_threshold. Thresholds grow with the LOD index, so the selected LOD
+		// is the number of thresholds (past the first one) that aren't above the threshold of the item.
+		u32 select_lod(const LodTable& table, id::id_type id, f32 threshold) {
+			constexpr u8 bit_count[16]{ 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+			static_assert(max_lod_count == 8);
+
+			using namespace DirectX;
+			const f32* const thresholds{ &table.thresholds[(u64)id * max_lod_count] };
+			const XMVECTOR value{ XMVectorReplicate(threshold) };
+			const u32 low{ (u32)_mm_movemask_ps(XMVectorLessOrEqual(XMLoadFloat4A((const XMFLOAT4A*)thresholds), value)) & ~1u };
+			const u32 high{ (u32)_mm_movemask_ps(XMVectorLessOrEqual(XMLoadFloat4A((const XMFLOAT4A*)&thresholds[4]), value)) };
+
+			return std::min((u32)(bit_count[low] + bit_count[high]), table.lod_counts[id] - 1);
+		}
+
 		util::free_list<NoexceptMap> shader_groups;
 		std::mutex shader_mutex;
 
+		struct GeometryBlobHeader {
+			u32 lod_count;
+			bool has_bounds;
+		};
+
+		// Leaves the blob at the first LOD.
+		GeometryBlobHeader read_geometry_header(util::BlobStreamReader& blob) {
+			const u32 first{ blob.read<u32>() };
+			GeometryBlobHeader header{ first, false };
+
+			if ((first & ~0xffu) == geometry_blob_tag) {
+				assert((first & 0xffu) <= geometry_blob_version);
+				header.lod_count = blob.read<u32>();
+				header.has_bounds = true;
+			}
+
+			assert(header.lod_count);
+			return header;
+		}
+
+		// Bounds of the submeshes of a LOD, for blobs without bounds. data points at the submesh count of the LOD.
+		// Quantized positions only add their decode range, which contains every position.
+		GeometryBounds calculate_lod_bounds(const u8* const data) {
+			// Same as the alignment of the renderer's submesh buffers (D3D12_STANDARD_MAXIMUM_ELEMENT_ALIGNMENT_BYTE_MULTIPLE).
+			constexpr u32 alignment{ 4 };
+			util::BlobStreamReader blob{ data };
+			const u32 submesh_count{ blob.read<u32>() };
+			blob.skip(sizeof(u32));
+
+			math::v3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+			math::v3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			const auto add_point = [&min, &max](const math::v3& p) {
+				min = { std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z) };
+				max = { std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z) };
+			};
+
+			util::vector<const math::v3*> positions;
+			util::vector<u32> position_counts;
+			bool has_quantized_positions{ false };
+
+			for (u32 i{ 0 }; i < submesh_count; ++i) {
+				const u32 element_size{ blob.read<u32>() };
+				const u32 vertex_count{ blob.read<u32>() };
+				const u32 index_count{ blob.read<u32>() };
+				const u32 elements_type{ blob.read<u32>() };
+				blob.skip(sizeof(u32));
+
+				const u32 position_buffer_size{ get_position_buffer_size(elements_type, vertex_count) };
+				const u32 index_size{ (u32)((vertex_count < (1 << 16)) ? sizeof(u16) : sizeof(u32)) };
+
+				if (elements_type & ElementsFlags::QUANTIZED_POSITION) {
+					const QuantizedPositionHeader& header{ *(const QuantizedPositionHeader*)blob.position() };
+					add_point(header.min);
+					add_point({ header.min.x + header.extent.x, header.min.y + header.extent.y, header.min.z + header.extent.z });
+					has_quantized_positions = true;
+				}
+				else {
+					const math::v3* const p{ (const math::v3*)blob.position() };
+					for (u32 j{ 0 }; j < vertex_count; ++j) add_point(p[j]);
+					positions.emplace_back(p);
+					position_counts.emplace_back(vertex_count);
+				}
+
+				blob.skip(math::align_size_up<alignment>(position_buffer_size) + math::align_size_up<alignment>(element_size * vertex_count) + index_size * index_count);
+			}
+
+			GeometryBounds bounds{};
+			bounds.aabb_center = { (min.x + max.x) * .5f, (min.y + max.y) * .5f, (min.z + max.z) * .5f };
+			bounds.aabb_extents = { (max.x - min.x) * .5f, (max.y - min.y) * .5f, (max.z - min.z) * .5f };
+			bounds.sphere_center = bounds.aabb_center;
+
+			const auto distance_sq = [&bounds](const math::v3& p) {
+				const math::v3 d{ p.x - bounds.sphere_center.x, p.y - bounds.sphere_center.y, p.z - bounds.sphere_center.z };
+				return d.x * d.x + d.y * d.y + d.z * d.z;
+			};
+
+			// Without the exact positions, the corners of the AABB are the farthest a quantized position can be.
+			f32 radius_sq{ has_quantized_positions ? distance_sq(min) : 0.f };
+
+			for (u32 i{ 0 }; i < positions.size(); ++i) {
+				for (u32 j{ 0 }; j < position_counts[i]; ++j) radius_sq = std::max(radius_sq, distance_sq(positions[i][j]));
+			}
+
+			bounds.sphere_radius = sqrtf(radius_sq);
+			return bounds;
+		}
+
+		// Reads the threshold and bounds of a LOD and leaves the blob at its submesh count.
+		f32 read_lod_header(util::BlobStreamReader& blob, bool has_bounds, GeometryBounds& bounds) {
+			const f32 threshold{ blob.read<f32>() };
+			if (has_bounds) blob.read((u8*)&bounds, sizeof(GeometryBounds));
+			else bounds = calculate_lod_bounds(blob.position());
+			return threshold;
+		}
+
 		u32 get_geometry_hierarchy_buffer_size(const void* const data) {
 			assert(data);
 			util::BlobStreamReader blob{ (const u8*)data };
-			const u32 lod_count{ blob.read<u32>() };
-			assert(lod_count);
+			const GeometryBlobHeader header{ read_geometry_header(blob) };
+			const u32 lod_count{ header.lod_count };
 
-			u32 size{ sizeof(u32) + (sizeof(f32) + sizeof(LodOffset)) * lod_count };
+			u32 size{ sizeof(u32) + (sizeof(f32) + sizeof(GeometryBounds) + sizeof(LodOffset)) * lod_count };
 
 			for (u32 lod_idx{ 0 }; lod_idx < lod_count; ++lod_idx) {
-				blob.skip(sizeof(f32));
+				blob.skip(sizeof(f32) + (header.has_bounds ? sizeof(GeometryBounds) : 0));
 				size += sizeof(id::id_type) * blob.read<u32>();
 				blob.skip(blob.read<u32>());
 			}
@@ -86,14 +273,14 @@ namespace lightning::content {
 			u8* const hierarchy_buffer{ (u8* const)malloc(size) };
 
 			util::BlobStreamReader blob{ (const u8*)data };
-			const u32 lod_count{ blob.read<u32>() };
-			assert(lod_count);
+			const GeometryBlobHeader header{ read_geometry_header(blob) };
+			const u32 lod_count{ header.lod_count };
 			GeometryHierarchyStream stream{ hierarchy_buffer, lod_count };
 			u32 submesh_index{ 0 };
 			id::id_type* const gpu_ids{ stream.gpu_ids() };
 
 			for (u32 lod_idx{ 0 }; lod_idx < lod_count; ++lod_idx) {
-				stream.thresholds()[lod_idx] = blob.read<f32>();
+				stream.thresholds()[lod_idx] = read_lod_header(blob, header.has_bounds, stream.bounds()[lod_idx]);
 				const u32 id_count{ blob.read<u32>() };
 				assert(id_count < (1 << 16));
 				stream.lod_offsets()[lod_idx] = { (u16)submesh_index, (u16)id_count };
@@ -116,13 +303,19 @@ namespace lightning::content {
 			}());
 
 			std::lock_guard lock{ geometry_mutex };
-			return geometry_hierarchies.add(hierarchy_buffer);
+			const id::id_type id{ geometry_hierarchies.add(hierarchy_buffer) };
+			set_lods(id, lod_count, stream.thresholds(), stream.lod_offsets(), stream.bounds());
+
+			return id;
 		}
 
 		id::id_type create_single_submesh(const void* const data) {
 			assert(data);
 			util::BlobStreamReader blob{ (const u8*)data };
-			blob.skip(sizeof(u32) + sizeof(f32) + sizeof(u32) + sizeof(u32));
+			const GeometryBlobHeader header{ read_geometry_header(blob) };
+			GeometryBounds bounds{};
+			(void)read_lod_header(blob, header.has_bounds, bounds);
+			blob.skip(sizeof(u32) + sizeof(u32));
 			const u8* at{ blob.position() };
 			const id::id_type gpu_id{ graphics::add_submesh(at) };
 
@@ -133,17 +326,21 @@ namespace lightning::content {
 			static_assert(alignof(void*) > 2, "We need the least significant bit for the single mesh marker.");
 			std::lock_guard lock{ geometry_mutex };
 
-			return geometry_hierarchies.add(fake_pointer);
+			const id::id_type id{ geometry_hierarchies.add(fake_pointer) };
+			constexpr f32 threshold{ 0.f };
+			constexpr LodOffset lod_offset{ 0, 1 };
+			set_lods(id, 1, &threshold, &lod_offset, &bounds);
+
+			return id;
 		}
 
 		bool is_single_mesh(const void* const data) {
 			assert(data);
 			util::BlobStreamReader blob{ (const u8*)data };
-			const u32 lod_count{ blob.read<u32>() };
-			assert(lod_count);
-			if (lod_count > 1) return false;
+			const GeometryBlobHeader header{ read_geometry_header(blob) };
+			if (header.lod_count > 1) return false;
 
-			blob.skip(sizeof(u32));
+			blob.skip(sizeof(f32) + (header.has_bounds ? sizeof(GeometryBounds) : 0));
 			const u32 submesh_count{ blob.read<u32>() };
 			assert(submesh_count);
 			return submesh_count == 1;
@@ -157,8 +354,12 @@ namespace lightning::content {
 			return (((uintptr_t)pointer) >> shift_bits) & (uintptr_t)id::invalid_id;
 		}
 
+		// Geometry with more LODs than the LOD table holds is rejected before any of its submeshes are uploaded.
 		[[nodiscard]] id::id_type create_geometry_resource(const void* const data) {
 			assert(data);
+			util::BlobStreamReader blob{ (const u8*)data };
+			if (read_geometry_header(blob).lod_count > max_lod_count) return id::invalid_id;
+
 			return is_single_mesh(data) ? create_single_submesh(data) : create_mesh_hierarchy(data);
 		}
 
@@ -198,7 +399,11 @@ namespace lightning::content {
 
 		[[nodiscard]] id::id_type create_texture_resource(const void* const data) {
 			assert(data);
-			return graphics::add_texture((const u8* const)data);
+			if (is_texture_container((const u8* const)data)) return graphics::add_texture((const u8* const)data);
+
+			util::vector<u8> container;
+			convert_legacy_texture((const u8* const)data, container);
+			return graphics::add_texture(container.data());
 		}
 
 		void destroy_texture_resource(id::id_type id) {
@@ -206,6 +411,83 @@ namespace lightning::content {
 		}
 	}
 
+	void convert_legacy_texture(const u8* const data, util::vector<u8>& container) {
+		using header_type = TextureContainerHeader;
+		assert(data && !is_texture_container(data));
+		util::BlobStreamReader blob{ data };
+
+		const u32 width{ blob.read<u32>() };
+		const u32 height{ blob.read<u32>() };
+		const u32 stored_array_size{ blob.read<u32>() };
+		const u32 flags{ blob.read<u32>() };
+		const u32 mip_levels{ blob.read<u32>() };
+		const u32 format{ blob.read<u32>() };
+		assert(mip_levels);
+
+		const bool is_3d{ (flags & TextureFlags::IS_VOLUME_MAP) != 0 };
+		const u32 depth{ is_3d ? stored_array_size : 1 };
+		const u32 array_size{ is_3d ? 1 : stored_array_size };
+		const u32 subresource_count{ array_size * mip_levels };
+		util::vector<TextureSubresource> subresources(subresource_count);
+		util::vector<const u8*> pixels(subresource_count);
+		util::vector<u32> source_row_pitches(subresource_count);
+
+		for (u32 i{ 0 }; i < subresource_count; ++i) {
+			const u32 mip{ i % mip_levels };
+			const u32 row_pitch{ blob.read<u32>() };
+			const u32 slice_pitch{ blob.read<u32>() };
+			assert(row_pitch && slice_pitch % row_pitch == 0);
+
+			TextureSubresource& subresource{ subresources[i] };
+			subresource.width = std::max(width >> mip, 1u);
+			subresource.height = std::max(height >> mip, 1u);
+			subresource.depth = std::max(depth >> mip, 1u);
+			subresource.row_count = slice_pitch / row_pitch;
+			subresource.row_pitch = (u32)math::align_size_up<header_type::row_pitch_alignment>(row_pitch);
+			subresource.slice_pitch = subresource.row_pitch * subresource.row_count;
+
+			pixels[i] = blob.position();
+			source_row_pitches[i] = row_pitch;
+			blob.skip((size_t)slice_pitch * subresource.depth);
+		}
+
+		// Same placement as the texture importer: smallest mip first.
+		const u64 data_offset{ math::align_size_up<header_type::placement_alignment>(sizeof(header_type) + sizeof(TextureSubresource) * subresource_count) };
+		u64 offset{ data_offset };
+
+		for (u32 mip{ mip_levels }; mip-- > 0;) {
+			for (u32 item{ 0 }; item < array_size; ++item) {
+				TextureSubresource& subresource{ subresources[item * mip_levels + mip] };
+				subresource.offset = offset;
+				offset = math::align_size_up<header_type::placement_alignment>(offset + (u64)subresource.slice_pitch * subresource.depth);
+			}
+		}
+
+		container.resize(offset, 0);
+		header_type& header{ *(header_type* const)container.data() };
+		header.version = header_type::current_version;
+		header.width = width;
+		header.height = height;
+		header.array_size = stored_array_size;
+		header.flags = flags;
+		header.mip_levels = mip_levels;
+		header.format = format;
+		header.subresource_count = subresource_count;
+		header.data_offset = data_offset;
+		header.data_size = offset - data_offset;
+		memcpy(container.data() + sizeof(header_type), subresources.data(), sizeof(TextureSubresource) * subresource_count);
+
+		for (u32 i{ 0 }; i < subresource_count; ++i) {
+			const TextureSubresource& subresource{ subresources[i] };
+			const u32 source_row_pitch{ source_row_pitches[i] };
+			u8* const dst{ container.data() + subresource.offset };
+
+			for (u32 row{ 0 }; row < subresource.row_count * subresource.depth; ++row) {
+				memcpy(dst + (u64)subresource.row_pitch * row, pixels[i] + (u64)source_row_pitch * row, source_row_pitch);
+			}
+		}
+	}
+
 	id::id_type create_resource(const void* const data, AssetType::Type type) {
 		assert(data);
 		id::id_type id{ id::invalid_id };
@@ -228,7 +510,6 @@ namespace lightning::content {
 				break;
 		}
 
-		assert(id::is_valid(id));
 		return id;
 	}
 
@@ -326,19 +607,44 @@ namespace lightning::content {
 		assert(geometry_ids && thresholds && id_count);
 		assert(offsets.empty());
 
-		std::lock_guard lock{ geometry_mutex };
+		offsets.resize(id_count);
+		const LodTableReader reader{};
+		const LodTable& table{ reader.table() };
 
 		for (u32 i{ 0 }; i < id_count; ++i) {
-			u8* const pointer{ geometry_hierarchies[geometry_ids[i]] };
+			const id::id_type id{ geometry_ids[i] };
+			offsets[i] = table.lod_offsets[(u64)id * max_lod_count + select_lod(table, id, thresholds[i])];
+		}
+	}
 
-			if ((uintptr_t)pointer & single_mesh_marker) {
-				offsets.emplace_back(LodOffset{ 0, 1 });
-			}
-			else {
-				GeometryHierarchyStream stream{ pointer };
-				const u32 lod{ stream.lod_from_threshold(thresholds[i]) };
-				offsets.emplace_back(stream.lod_offsets()[lod]);
-			}
+	void get_lod_bounds(const id::id_type* const geometry_ids, const f32* const thresholds, u32 id_count, util::vector<GeometryBounds>& bounds) {
+		assert(geometry_ids && thresholds && id_count);
+		assert(bounds.empty());
+
+		bounds.resize(id_count);
+		const LodTableReader reader{};
+		const LodTable& table{ reader.table() };
+
+		for (u32 i{ 0 }; i < id_count; ++i) {
+			const id::id_type id{ geometry_ids[i] };
+			bounds[i] = table.bounds[(u64)id * max_lod_count + select_lod(table, id, thresholds[i])];
+		}
+	}
+
+	void get_lods(const id::id_type* const geometry_ids, const f32* const thresholds, u32 id_count, util::vector<LodOffset>& offsets, util::vector<GeometryBounds>& bounds) {
+		assert(geometry_ids && thresholds && id_count);
+		assert(offsets.empty() && bounds.empty());
+
+		offsets.resize(id_count);
+		bounds.resize(id_count);
+		const LodTableReader reader{};
+		const LodTable& table{ reader.table() };
+
+		for (u32 i{ 0 }; i < id_count; ++i) {
+			const id::id_type id{ geometry_ids[i] };
+			const u64 index{ (u64)id * max_lod_count + select_lod(table, id, thresholds[i]) };
+			offsets[i] = table.lod_offsets[index];
+			bounds[i] = table.bounds[index];
 		}
 	}
 }
\ No newline at end of file
@@ -29,6 +29,91 @@ namespace lightning::content {
 		};
 	};
 
+	struct ElementsFlags {
+		enum Flags : u32 {
+			QUANTIZED_POSITION = 0x10,
+			HALF_UV = 0x20,
+		};
+	};
+
+	// Quantized position streams start with the decode range of the submesh AABB,
+	// followed by one u16x4 (x, y, z, pad) per vertex.
+	struct QuantizedPositionHeader {
+		math::v3 min;
+		f32 pad;
+		math::v3 extent;
+		f32 pad2;
+	};
+
+	[[nodiscard]] constexpr u32 get_position_buffer_size(u32 elements_type, u32 vertex_count) {
+		return (elements_type & ElementsFlags::QUANTIZED_POSITION)
+			? (u32)(sizeof(QuantizedPositionHeader) + sizeof(u16) * 4 * vertex_count)
+			: (u32)(sizeof(math::v3) * vertex_count);
+	}
+
+	// Texture container written by the texture importer: the header, one TextureSubresource per
+	// subresource in D3D12 order (array slice major) and the pixel data. The data is stored from the
+	// smallest mip up, so the mip tail comes first and larger mips can be read on demand.
+	// Rows and subresources are placed with the D3D12 upload alignments.
+	// Textures written before the container (version 0) have no header, see convert_legacy_texture().
+	struct TextureContainerHeader {
+		constexpr static u32 tag{ 0x54584300 };		// "TXC" in the upper bytes, the version in the lowest one
+		constexpr static u32 current_version{ tag | 1 };
+		constexpr static u32 row_pitch_alignment{ 256 };		// D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
+		constexpr static u32 placement_alignment{ 512 };	// D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT
+
+		u32 version;
+		u32 width;
+		u32 height;
+		u32 array_size;		// depth for volume maps
+		u32 flags;
+		u32 mip_levels;
+		u32 format;
+		u32 subresource_count;
+		u64 data_offset;
+		u64 data_size;
+	};
+
+	struct TextureSubresource {
+		u64 offset;			// from the start of the container
+		u32 width;
+		u32 height;
+		u32 depth;
+		u32 row_count;
+		u32 row_pitch;
+		u32 slice_pitch;
+	};
+
+	// Version 0 textures start with their width, which never has the tag bits set.
+	[[nodiscard]] inline bool is_texture_container(const u8* const data) {
+		return (*(const u32* const)data & ~(u32)0xff) == TextureContainerHeader::tag;
+	}
+
+	// Rewrites a version 0 texture (width, height, array size, flags, mip levels and format, then the
+	// row pitch, slice pitch and pixels of every subresource) as a container.
+	void convert_legacy_texture(const u8* const data, util::vector<u8>& container);
+
+	[[nodiscard]] inline const TextureSubresource* const get_texture_subresources(const u8* const container) {
+		return (const TextureSubresource* const)(container + sizeof(TextureContainerHeader));
+	}
+
+	// Number of bytes from the start of the container that hold every mip from first_mip down.
+	[[nodiscard]] inline u64 get_texture_load_size(const u8* const container, u32 first_mip) {
+		const TextureContainerHeader& header{ *(const TextureContainerHeader* const)container };
+		const TextureSubresource* const subresources{ get_texture_subresources(container) };
+		assert(first_mip < header.mip_levels);
+		u64 size{ header.data_offset };
+
+		for (u32 i{ 0 }; i < header.subresource_count; ++i) {
+			if (i % header.mip_levels < first_mip) continue;
+
+			const TextureSubresource& subresource{ subresources[i] };
+			size = std::max(size, subresource.offset + (u64)subresource.slice_pitch * subresource.depth);
+		}
+
+		return size;
+	}
+
 	typedef struct CompiledShader {
 		static constexpr u32 hash_length{ 16 };
 		constexpr u64 byte_code_size() const { return _byte_code_size; }
@@ -48,6 +133,20 @@ namespace lightning::content {
 		u16 count;
 	};
 
+	struct GeometryBounds {
+		math::v3 aabb_center;
+		math::v3 aabb_extents;
+		math::v3 sphere_center;
+		f32 sphere_radius;
+	};
+
+	// Geometry blobs start with geometry_blob_tag | version and the LOD count. Every LOD has its threshold, its GeometryBounds,
+	// the submesh count, the size of its submeshes and the submeshes. Blobs written before the bounds existed (version 0)
+	// start with the LOD count and have no bounds, those are computed from the positions when the blob is loaded.
+	constexpr u32 geometry_blob_tag{ 0x47454f00 };		// "GEO" in the upper bytes, the version in the lowest one
+	constexpr u32 geometry_blob_version{ 1 };
+
+	// Returns id::invalid_id when the data can't be used, e.g. geometry with more than 8 LODs.
 	id::id_type create_resource(const void* const data, AssetType::Type type);
 	void destroy_resource(id::id_type id, AssetType::Type type);
 
@@ -57,4 +156,7 @@ namespace lightning::content {
 
 	void get_submesh_gpu_ids(id::id_type geometry_content_id, u32 id_count, id::id_type* const gpu_ids);
 	void get_lod_offsets(const id::id_type* const geometry_ids, const f32* const thresholds, u32 id_count, util::vector<LodOffset>& offsets);
+	void get_lod_bounds(const id::id_type* const geometry_ids, const f32* const thresholds, u32 id_count, util::vector<GeometryBounds>& bounds);
+	// Both of the above in one pass. None of these take a lock, they can run while geometry is added.
+	void get_lods(const id::id_type* const geometry_ids, const f32* const thresholds, u32 id_count, util::vector<LodOffset>& offsets, util::vector<GeometryBounds>& bounds);
 }
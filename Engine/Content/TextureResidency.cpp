@@ -0,0 +1,367 @@
+#include "TextureResidency.h"
+#include "ContentToEngine.h"
+#include "Graphics/Renderer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace lightning::content::texture_residency {
+	namespace {
+
+		constexpr u32 max_mips{ 14 };
+
+		struct ResidentTexture {
+			std::unique_ptr<u8[]> container;
+			u64 mip_sizes[max_mips];	// resident size with the given first mip
+			id::id_type gpu_id;
+			u32 size;					// largest dimension of the top mip
+			u32 mip_levels;
+			u32 tail_mip;
+			u32 resident_mip;
+			u32 requested_mip;
+			u32 wanted_mip;
+			u32 frames_unused;
+		};
+
+		id::id_type create_graphics_texture(const u8* const container) {
+			return graphics::add_texture(container);
+		}
+
+		void update_graphics_texture(id::id_type gpu_id, const u8* const container) {
+			graphics::update_texture(gpu_id, container);
+		}
+
+		void remove_graphics_texture(id::id_type gpu_id) {
+			graphics::remove_texture(gpu_id);
+		}
+
+		Settings settings{};
+		Backend backend{};
+		Stats stats{};
+		util::free_list<ResidentTexture> textures;
+		util::vector<id::id_type> live_ids;
+		util::vector<id::id_type> candidates;
+		util::vector<u8> container_buffer;
+		std::unordered_map<id::id_type, id::id_type> gpu_id_map;	// gpu id to residency id
+		std::mutex residency_mutex;
+
+		u64 get_container_size(const u8* const container) {
+			const TextureContainerHeader& header{ *(const TextureContainerHeader* const)container };
+			return header.data_offset + header.data_size;
+		}
+
+		// Same texture without the mips above first_mip. Those are stored last, so the kept data is one block.
+		void create_trimmed_container(const u8* const container, u32 first_mip, util::vector<u8>& buffer) {
+			const TextureContainerHeader& header{ *(const TextureContainerHeader* const)container };
+			const TextureSubresource* const subresources{ get_texture_subresources(container) };
+			assert(first_mip < header.mip_levels);
+
+			const bool is_3d{ (header.flags & TextureFlags::IS_VOLUME_MAP) != 0 };
+			const u32 mip_levels{ header.mip_levels - first_mip };
+			const u32 item_count{ header.subresource_count / header.mip_levels };
+			const u32 subresource_count{ item_count * mip_levels };
+			const u64 data_offset{ math::align_size_up<TextureContainerHeader::placement_alignment>(sizeof(TextureContainerHeader) + sizeof(TextureSubresource) * subresource_count) };
+			const u64 data_size{ get_texture_load_size(container, first_mip) - header.data_offset };
+
+			buffer.resize(data_offset + data_size);
+			u8* const data{ buffer.data() };
+
+			TextureContainerHeader& trimmed{ *(TextureContainerHeader* const)data };
+			trimmed = header;
+			trimmed.width = std::max(header.width >> first_mip, 1u);
+			trimmed.height = std::max(header.height >> first_mip, 1u);
+			trimmed.array_size = is_3d ? std::max(header.array_size >> first_mip, 1u) : header.array_size;
+			trimmed.mip_levels = mip_levels;
+			trimmed.subresource_count = subresource_count;
+			trimmed.data_offset = data_offset;
+			trimmed.data_size = data_size;
+
+			TextureSubresource* const trimmed_subresources{ (TextureSubresource* const)(data + sizeof(TextureContainerHeader)) };
+
+			for (u32 item{ 0 }; item < item_count; ++item) {
+				for (u32 mip{ 0 }; mip < mip_levels; ++mip) {
+					TextureSubresource& subresource{ trimmed_subresources[item * mip_levels + mip] };
+					subresource = subresources[item * header.mip_levels + first_mip + mip];
+					subresource.offset = subresource.offset - header.data_offset + data_offset;
+				}
+			}
+
+			memcpy(data + data_offset, container + header.data_offset, data_size);
+		}
+
+		const u8* get_resident_container(const ResidentTexture& texture, u32 mip) {
+			if (!mip) return texture.container.get();
+
+			create_trimmed_container(texture.container.get(), mip, container_buffer);
+			return container_buffer.data();
+		}
+
+		id::id_type create_gpu_texture(const ResidentTexture& texture, u32 mip) {
+			const id::id_type gpu_id{ backend.create(get_resident_container(texture, mip)) };
+			assert(id::is_valid(gpu_id));
+			return gpu_id;
+		}
+
+		// The gpu texture keeps its id, only its resource is recreated with the new mips.
+		void make_resident(ResidentTexture& texture, u32 mip) {
+			assert(mip <= texture.tail_mip && id::is_valid(texture.gpu_id));
+			backend.update(texture.gpu_id, get_resident_container(texture, mip));
+
+			if (mip < texture.resident_mip) {
+				++stats.loads;
+				stats.uploaded_size += texture.mip_sizes[mip];
+			}
+			else {
+				++stats.evictions;
+			}
+
+			stats.resident_size = stats.resident_size - texture.mip_sizes[texture.resident_mip] + texture.mip_sizes[mip];
+			texture.resident_mip = mip;
+		}
+
+		void initialize_texture(ResidentTexture& texture, const u8* const container) {
+			const TextureContainerHeader& header{ *(const TextureContainerHeader* const)container };
+			assert(is_texture_container(container) && header.version == TextureContainerHeader::current_version);
+			assert(header.mip_levels && header.mip_levels <= max_mips);
+
+			const u64 container_size{ get_container_size(container) };
+			texture.container = std::make_unique<u8[]>(container_size);
+			memcpy(texture.container.get(), container, container_size);
+
+			texture.size = std::max(header.width, header.height);
+			texture.mip_levels = header.mip_levels;
+			texture.tail_mip = 0;
+
+			while (texture.tail_mip < header.mip_levels - 1 && (texture.size >> texture.tail_mip) > settings.mip_tail_size) {
+				++texture.tail_mip;
+			}
+
+			for (u32 mip{ 0 }; mip < header.mip_levels; ++mip) {
+				texture.mip_sizes[mip] = get_texture_load_size(container, mip) - header.data_offset;
+			}
+
+			texture.gpu_id = id::invalid_id;
+			texture.resident_mip = texture.tail_mip;
+			texture.requested_mip = u32_invalid_id;
+			texture.wanted_mip = texture.tail_mip;
+			texture.frames_unused = 0;
+		}
+
+		// Textures keep their mips for eviction_delay frames after they stop being requested.
+		void update_wanted_mip(ResidentTexture& texture) {
+			const u32 target{ std::min(texture.requested_mip, texture.tail_mip) };
+			texture.requested_mip = u32_invalid_id;
+
+			if (target < texture.resident_mip) {
+				texture.wanted_mip = target;
+				texture.frames_unused = 0;
+			}
+			else if (target > texture.resident_mip) {
+				texture.wanted_mip = ++texture.frames_unused >= settings.eviction_delay ? target : texture.resident_mip;
+			}
+			else {
+				texture.wanted_mip = target;
+				texture.frames_unused = 0;
+			}
+		}
+
+		// One texel per pixel: every halving of the screen size drops a mip.
+		void request_size(ResidentTexture& texture, f32 screen_size) {
+			u32 mip{ texture.tail_mip };
+
+			if (screen_size > 0.f) {
+				const f32 lod{ floorf(log2f((f32)texture.size / screen_size) + settings.mip_bias) };
+				mip = (u32)math::clamp(lod, 0.f, (f32)texture.tail_mip);
+			}
+
+			texture.requested_mip = std::min(texture.requested_mip, mip);
+		}
+
+		// Most detailed mip that can be loaded without going over the budget or the upload limit.
+		u32 get_affordable_mip(const ResidentTexture& texture) {
+			const u64 resident_size{ texture.mip_sizes[texture.resident_mip] };
+
+			for (u32 mip{ texture.wanted_mip }; mip < texture.resident_mip; ++mip) {
+				const u64 size{ texture.mip_sizes[mip] };
+				const bool fits_budget{ stats.resident_size - resident_size + size <= settings.budget };
+				// One upload per frame is always allowed, so a single huge texture can't stall forever.
+				const bool fits_upload{ !stats.uploaded_size || stats.uploaded_size + size <= settings.max_upload_per_frame };
+
+				if (fits_budget && fits_upload) return mip;
+			}
+
+			return texture.resident_mip;
+		}
+
+		void trim_to_budget() {
+			if (stats.resident_size <= settings.budget) return;
+
+			candidates.clear();
+			for (id::id_type id : live_ids) {
+				if (textures[id].resident_mip < textures[id].tail_mip) candidates.emplace_back(id);
+			}
+
+			std::sort(candidates.begin(), candidates.end(), [](id::id_type a, id::id_type b) {
+				return textures[a].mip_sizes[textures[a].resident_mip] > textures[b].mip_sizes[textures[b].resident_mip];
+			});
+
+			for (id::id_type id : candidates) {
+				ResidentTexture& texture{ textures[id] };
+				u32 mip{ texture.resident_mip };
+
+				while (mip < texture.tail_mip && stats.resident_size - texture.mip_sizes[texture.resident_mip] + texture.mip_sizes[mip] > settings.budget) {
+					++mip;
+				}
+
+				make_resident(texture, mip);
+				if (stats.resident_size <= settings.budget) break;
+			}
+		}
+	}
+
+	void initialize(const Settings& init_settings, const Backend* const init_backend) {
+		std::lock_guard lock{ residency_mutex };
+		assert(live_ids.empty());
+
+		settings = init_settings;
+		backend = init_backend ? *init_backend : Backend{ create_graphics_texture, update_graphics_texture, remove_graphics_texture };
+		assert(backend.create && backend.update && backend.remove);
+
+		stats = {};
+		stats.budget = settings.budget;
+	}
+
+	void shutdown() {
+		std::lock_guard lock{ residency_mutex };
+
+		for (id::id_type id : live_ids) {
+			backend.remove(textures[id].gpu_id);
+			textures.remove(id);
+		}
+
+		live_ids.clear();
+		gpu_id_map.clear();
+		candidates.clear();
+		container_buffer.clear();
+		stats = {};
+	}
+
+	id::id_type add(const u8* const container) {
+		assert(container);
+		util::vector<u8> converted;
+
+		if (!is_texture_container(container)) {
+			convert_legacy_texture(container, converted);
+		}
+
+		std::lock_guard lock{ residency_mutex };
+
+		const id::id_type id{ textures.add() };
+		ResidentTexture& texture{ textures[id] };
+		initialize_texture(texture, converted.empty() ? container : converted.data());
+
+		// The mip tail is always resident, even when that means going over the budget.
+		texture.gpu_id = create_gpu_texture(texture, texture.tail_mip);
+		stats.resident_size += texture.mip_sizes[texture.tail_mip];
+		live_ids.emplace_back(id);
+		gpu_id_map[texture.gpu_id] = id;
+
+		return id;
+	}
+
+	void remove(id::id_type id) {
+		std::lock_guard lock{ residency_mutex };
+		ResidentTexture& texture{ textures[id] };
+
+		stats.resident_size -= texture.mip_sizes[texture.resident_mip];
+		gpu_id_map.erase(texture.gpu_id);
+		backend.remove(texture.gpu_id);
+		textures.remove(id);
+
+		for (u32 i{ 0 }; i < live_ids.size(); ++i) {
+			if (live_ids[i] == id) {
+				live_ids.erease_unordered(i);
+				break;
+			}
+		}
+	}
+
+	void request_mip(id::id_type id, u32 mip) {
+		std::lock_guard lock{ residency_mutex };
+		ResidentTexture& texture{ textures[id] };
+		texture.requested_mip = std::min(texture.requested_mip, mip);
+	}
+
+	void request_screen_size(const id::id_type* const ids, const f32* const screen_sizes, u32 count) {
+		assert(ids && screen_sizes && count);
+		std::lock_guard lock{ residency_mutex };
+
+		for (u32 i{ 0 }; i < count; ++i) {
+			request_size(textures[ids[i]], screen_sizes[i]);
+		}
+	}
+
+	void request_gpu_screen_size(const id::id_type* const gpu_ids, const f32* const screen_sizes, u32 count) {
+		assert(gpu_ids && screen_sizes && count);
+		std::lock_guard lock{ residency_mutex };
+
+		for (u32 i{ 0 }; i < count; ++i) {
+			const auto pair = gpu_id_map.find(gpu_ids[i]);
+			if (pair != gpu_id_map.end()) request_size(textures[pair->second], screen_sizes[i]);
+		}
+	}
+
+	void update() {
+		std::lock_guard lock{ residency_mutex };
+
+		stats.loads = 0;
+		stats.evictions = 0;
+		stats.uploaded_size = 0;
+		stats.requested_size = 0;
+		stats.over_budget_count = 0;
+		stats.texture_count = (u32)live_ids.size();
+		stats.budget = settings.budget;
+
+		candidates.clear();
+
+		for (id::id_type id : live_ids) {
+			ResidentTexture& texture{ textures[id] };
+			update_wanted_mip(texture);
+			stats.requested_size += texture.mip_sizes[texture.wanted_mip];
+
+			if (texture.wanted_mip > texture.resident_mip) make_resident(texture, texture.wanted_mip);
+			else if (texture.wanted_mip < texture.resident_mip) candidates.emplace_back(id);
+		}
+
+		// Largest deficit first, these are the textures that look the worst.
+		std::sort(candidates.begin(), candidates.end(), [](id::id_type a, id::id_type b) {
+			const u32 deficit_a{ textures[a].resident_mip - textures[a].wanted_mip };
+			const u32 deficit_b{ textures[b].resident_mip - textures[b].wanted_mip };
+			return deficit_a != deficit_b ? deficit_a > deficit_b : a < b;
+		});
+
+		for (id::id_type id : candidates) {
+			ResidentTexture& texture{ textures[id] };
+			const u32 mip{ get_affordable_mip(texture) };
+
+			if (mip < texture.resident_mip) make_resident(texture, mip);
+			if (texture.resident_mip > texture.wanted_mip) ++stats.over_budget_count;
+		}
+
+		trim_to_budget();
+	}
+
+	id::id_type gpu_id(id::id_type id) {
+		std::lock_guard lock{ residency_mutex };
+		return textures[id].gpu_id;
+	}
+
+	u32 resident_mip(id::id_type id) {
+		std::lock_guard lock{ residency_mutex };
+		return textures[id].resident_mip;
+	}
+
+	Stats get_stats() {
+		std::lock_guard lock{ residency_mutex };
+		return stats;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "CommonHeaders.h"
+
+namespace lightning::content::texture_residency {
+
+	// Creates a GPU texture from a texture container, returns its id.
+	// The residency manager hands over containers that start at the mip that should be resident.
+	// Mip changes go through update, which has to keep the id, so materials using the texture stay valid.
+	struct Backend {
+		id::id_type(*create)(const u8* const container);
+		void(*update)(id::id_type gpu_id, const u8* const container);
+		void(*remove)(id::id_type gpu_id);
+	};
+
+	struct Settings {
+		u64 budget{ 512ull * 1024 * 1024 };
+		u64 max_upload_per_frame{ 32ull * 1024 * 1024 };	// upgrades above this wait for the next frame
+		u32 mip_tail_size{ 64 };							// mips this size or smaller are always resident
+		u32 eviction_delay{ 30 };							// frames a texture has to want fewer mips before it's trimmed
+		f32 mip_bias{ 0.f };								// positive values request smaller mips
+	};
+
+	struct Stats {
+		u64 budget;
+		u64 resident_size;
+		u64 requested_size;			// what would be resident with an unlimited budget
+		u32 texture_count;
+		u32 over_budget_count;		// textures resident at a smaller mip than requested
+		u32 loads;					// during the last update
+		u32 evictions;
+		u64 uploaded_size;
+	};
+
+	// Without a backend the textures are created with graphics::add_texture and updated with graphics::update_texture.
+	void initialize(const Settings& settings, const Backend* const backend = nullptr);
+	void shutdown();
+
+	// The container is copied, only its mip tail is created on the GPU until requested. Version 0 textures are converted first.
+	[[nodiscard]] id::id_type add(const u8* const container);
+	void remove(id::id_type id);
+
+	// Requests are gathered during the frame, the most detailed mip wins.
+	void request_mip(id::id_type id, u32 mip);
+	// screen_sizes are the projected sizes (pixels) of the surfaces using the textures.
+	void request_screen_size(const id::id_type* const ids, const f32* const screen_sizes, u32 count);
+	// Same as request_screen_size, for the renderer which only knows the gpu ids. Textures that aren't managed here are skipped.
+	void request_gpu_screen_size(const id::id_type* const gpu_ids, const f32* const screen_sizes, u32 count);
+
+	// Applies the requests of the frame: loads wanted mips within budget and trims unused ones.
+	void update();
+
+	// Stays the same for the lifetime of the texture.
+	[[nodiscard]] id::id_type gpu_id(id::id_type id);
+	[[nodiscard]] u32 resident_mip(id::id_type id);
+	[[nodiscard]] Stats get_stats();
+}
@@ -11,6 +11,7 @@
 #include <dxgi1_6.h>
 #include <d3d12.h>
 #include <wrl.h>
+#include <atomic>
 
 #pragma comment(lib, "dxgi.lib")
 #pragma comment(lib, "d3d12.lib")
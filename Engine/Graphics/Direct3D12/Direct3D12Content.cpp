@@ -2,8 +2,15 @@
 #include "Direct3D12Core.h"
 #include "Utilities/IOStream.h"
 #include "Content/ContentToEngine.h"
+#include "Content/TextureResidency.h"
 #include "Direct3D12GPass.h"
 #include "Direct3D12Upload.h"
+#include "Direct3D12Culling.h"
+#include "Direct3D12Camera.h"
+#include "Components/Entity.h"
+#include "Components/Transform.h"
+#include <algorithm>
+#include <cmath>
 
 #ifdef OPAQUE
 #undef OPAQUE
@@ -48,21 +55,153 @@ namespace lightning::graphics::direct3d12::content {
 		util::vector<ID3D12RootSignature*> root_signatures;
 		std::unordered_map<u64, id::id_type> material_rs_map;
 		util::free_list<std::unique_ptr<u8[]>> materials;
+		util::vector<util::vector<id::id_type>> texture_materials;	// materials using each texture, needs material_mutex
 		std::mutex material_mutex{};
 
 		util::free_list<D3D12RenderItem> render_items;
 		util::free_list<std::unique_ptr<id::id_type[]>> render_item_ids;
+		// Last automatic LOD threshold of every render item as seen by every camera, negative before the first one.
+		// Indexed by camera index, then render item index. Reused camera slots start over.
+		util::vector<util::vector<f32>> render_item_thresholds;
+		util::vector<id::id_type> threshold_camera_ids;
+		util::vector<u8> d3d12_render_item_states;
+		util::vector<id::id_type> changed_d3d12_render_items;
 		std::mutex render_item_mutex{};
 
+		struct RenderItemState {
+			enum State : u8 {
+				CHANGED = 0x01,
+				ALIVE = 0x02,
+			};
+		};
+
 		util::vector<ID3D12PipelineState*> pipeline_states;
 		std::unordered_map<u64, id::id_type> pso_map;
 		std::mutex pso_mutex{};
 
 		struct {
 			util::vector<lightning::content::LodOffset> lod_offsets;
+			util::vector<lightning::content::GeometryBounds> bounds;
+			util::vector<math::m4x4> world_matrices;
 			util::vector<id::id_type> geometry_ids;
+			util::vector<id::id_type> entity_ids;
+			util::vector<f32> thresholds;
+			util::vector<u32> visible_items;
+			util::vector<f32> screen_sizes;
+			util::vector<id::id_type> texture_ids;
+			util::vector<f32> texture_sizes;
 		} frame_cache;
 
+		// Changes are only reported once per frame, the last one wins. Needs render_item_mutex.
+		void set_d3d12_render_item_changed(id::id_type id, bool alive) {
+			if (id >= d3d12_render_item_states.size()) d3d12_render_item_states.resize(id + 1, 0);
+			u8& state{ d3d12_render_item_states[id] };
+			if (!(state & RenderItemState::CHANGED)) changed_d3d12_render_items.emplace_back(id);
+			state = RenderItemState::CHANGED | (alive ? RenderItemState::ALIVE : 0);
+		}
+
+		// Automatic LOD thresholds are distances as seen by a camera with this field of view,
+		// which is how LOD thresholds are authored in the assets.
+		constexpr f32 reference_field_of_view{ .25f };
+
+		// Every item gets the distance at which the reference camera would see it as big as the current camera does.
+		// Items only switch to a new value once it differs by more than the hysteresis, so they don't pop back and forth.
+		void calculate_lod_thresholds(const D3D12FrameInfo& info, const lightning::content::GeometryBounds* const bounds, const math::m4x4* const world, u32 count, f32* const thresholds) {
+			using namespace DirectX;
+			const camera::D3D12Camera& camera{ *info.camera };
+			const f32 reference_scale{ 1.f / tanf(reference_field_of_view * XM_PI * .5f) };
+			const f32 bias{ exp2f(info.info->lod_bias) };
+
+			if (camera.projection_type() == graphics::Camera::ORTOGRAPHIC) {
+				const f32 threshold{ camera.view_height() * .5f * reference_scale * bias };
+				for (u32 i{ 0 }; i < count; ++i) thresholds[i] = threshold;
+			}
+			else {
+				const XMVECTOR scale{ XMVectorReplicate(tanf(camera.field_of_view() * XM_PI * .5f) * reference_scale * bias) };
+				const XMVECTOR camera_x{ XMVectorSplatX(camera.position()) };
+				const XMVECTOR camera_y{ XMVectorSplatY(camera.position()) };
+				const XMVECTOR camera_z{ XMVectorSplatZ(camera.position()) };
+
+				for (u32 i{ 0 }; i < count; i += 4) {
+					const u32 lane_count{ std::min(count - i, 4u) };
+					XMFLOAT4A spheres[4]{};
+
+					for (u32 lane{ 0 }; lane < lane_count; ++lane) {
+						const lightning::content::GeometryBounds& b{ bounds[i + lane] };
+						const XMMATRIX m{ XMLoadFloat4x4(&world[i + lane]) };
+						const XMVECTOR scale_sq{ XMVectorMax(XMVector3LengthSq(m.r[0]), XMVectorMax(XMVector3LengthSq(m.r[1]), XMVector3LengthSq(m.r[2]))) };
+						const XMVECTOR radius{ XMVectorMultiply(XMVectorReplicate(b.sphere_radius), XMVectorSqrt(scale_sq)) };
+						XMStoreFloat4A(&spheres[lane], XMVectorSelect(XMVector3Transform(XMLoadFloat3(&b.sphere_center), m), radius, g_XMSelect0001));
+					}
+
+					const XMMATRIX soa{ XMMatrixTranspose(XMLoadFloat4x4A((const XMFLOAT4X4A*)spheres)) };
+					const XMVECTOR dx{ XMVectorSubtract(soa.r[0], camera_x) };
+					const XMVECTOR dy{ XMVectorSubtract(soa.r[1], camera_y) };
+					const XMVECTOR dz{ XMVectorSubtract(soa.r[2], camera_z) };
+					const XMVECTOR distance{ XMVectorSqrt(XMVectorMultiplyAdd(dx, dx, XMVectorMultiplyAdd(dy, dy, XMVectorMultiply(dz, dz)))) };
+
+					// Inside the bounding sphere the item covers the whole view.
+					const XMVECTOR threshold{ XMVectorSelect(XMVectorMultiply(distance, scale), XMVectorZero(), XMVectorLess(distance, soa.r[3])) };
+
+					XMFLOAT4A result;
+					XMStoreFloat4A(&result, threshold);
+					memcpy(&thresholds[i], &result, lane_count * sizeof(f32));
+				}
+			}
+
+			const f32 hysteresis{ info.info->lod_hysteresis };
+			const id::id_type camera_id{ info.info->camera_id };
+			const id::id_type camera_index{ id::index(camera_id) };
+
+			if (camera_index >= render_item_thresholds.size()) {
+				render_item_thresholds.resize(camera_index + 1);
+				threshold_camera_ids.resize(camera_index + 1, id::invalid_id);
+			}
+
+			util::vector<f32>& camera_thresholds{ render_item_thresholds[camera_index] };
+
+			if (threshold_camera_ids[camera_index] != camera_id) {
+				threshold_camera_ids[camera_index] = camera_id;
+				camera_thresholds.clear();
+			}
+
+			for (u32 i{ 0 }; i < count; ++i) {
+				const id::id_type index{ id::index(info.info->render_item_ids[i]) };
+				if (index >= camera_thresholds.size()) camera_thresholds.resize(index + 1, -1.f);
+				f32& previous{ camera_thresholds[index] };
+
+				if (previous < 0.f || fabsf(thresholds[i] - previous) > previous * hysteresis) previous = thresholds[i];
+				else thresholds[i] = previous;
+			}
+		}
+
+		// Projected height (pixels) of the bounding spheres of the given items. Textures are requested at the size of
+		// the items using them, so the most detailed resident mip is about one texel per pixel.
+		void calculate_screen_sizes(const D3D12FrameInfo& info, const lightning::content::GeometryBounds* const bounds, const math::m4x4* const world, const u32* const items, u32 count, f32* const sizes) {
+			using namespace DirectX;
+			const camera::D3D12Camera& camera{ *info.camera };
+			const f32 surface_height{ (f32)info.surface_height };
+			const bool is_orthographic{ camera.projection_type() == graphics::Camera::ORTOGRAPHIC };
+			const f32 scale{ is_orthographic ? 2.f / camera.view_height() : 1.f / tanf(camera.field_of_view() * XM_PI * .5f) };
+
+			for (u32 i{ 0 }; i < count; ++i) {
+				const lightning::content::GeometryBounds& b{ bounds[items[i]] };
+				const XMMATRIX m{ XMLoadFloat4x4(&world[items[i]]) };
+				const XMVECTOR scale_sq{ XMVectorMax(XMVector3LengthSq(m.r[0]), XMVectorMax(XMVector3LengthSq(m.r[1]), XMVector3LengthSq(m.r[2]))) };
+				const f32 radius{ b.sphere_radius * sqrtf(XMVectorGetX(scale_sq)) };
+				f32 size{ radius * scale };
+
+				if (!is_orthographic) {
+					const XMVECTOR center{ XMVector3Transform(XMLoadFloat3(&b.sphere_center), m) };
+					const f32 distance{ XMVectorGetX(XMVector3Length(XMVectorSubtract(center, camera.position()))) };
+					// Inside the bounding sphere the item covers the whole view.
+					size = distance > radius ? size / distance : 1.f;
+				}
+
+				sizes[i] = std::min(size, 1.f) * surface_height;
+			}
+		}
+
 		constexpr D3D12_ROOT_SIGNATURE_FLAGS get_root_signature_flags(ShaderFlags::Flags flags) {
 			D3D12_ROOT_SIGNATURE_FLAGS default_flags{ d3dx::D3D12RootSignatureDesc::default_flags };
 
@@ -117,7 +256,8 @@ namespace lightning::graphics::direct3d12::content {
 					}
 
 					parameters[params::GLOBAL_SHADER_DATA].as_cbv(D3D12_SHADER_VISIBILITY_ALL, 0);
-					parameters[params::PER_OBJECT_DATA].as_cbv(data_visibility, 1);
+					parameters[params::PER_OBJECT_DATA].as_srv(data_visibility, 7);
+					parameters[params::INSTANCES].as_srv(data_visibility, 8);
 					parameters[params::POSITION_BUFFER].as_srv(buffer_visibility, 0);
 					parameters[params::ELEMENT_BUFFER].as_srv(buffer_visibility, 1);
 					parameters[params::SRV_INDICIES].as_srv(D3D12_SHADER_VISIBILITY_PIXEL, 2);
@@ -373,46 +513,23 @@ namespace lightning::graphics::direct3d12::content {
 		}
 
 		D3D12Texture create_resource_from_texture_data(const u8* const data) {
+			using namespace lightning::content;
 			assert(data);
-			util::BlobStreamReader blob{ data };
-			const u32 width{ blob.read<u32>() };
-			const u32 height{ blob.read<u32>() };
-			u32 depth{ 1 };
-			u32 array_size{ blob.read<u32>() };
-			const u32 flags{ blob.read<u32>() };
-			const u32 mip_levels{ blob.read<u32>() };
-			const DXGI_FORMAT format{ (DXGI_FORMAT)blob.read<u32>() };
+			const TextureContainerHeader& header{ *(const TextureContainerHeader* const)data };
+			// Version 0 textures are converted by the content layer before they get here.
+			assert(is_texture_container(data) && header.version == TextureContainerHeader::current_version);
+
+			const u32 width{ header.width };
+			const u32 height{ header.height };
+			const u32 flags{ header.flags };
+			const u32 mip_levels{ header.mip_levels };
+			const DXGI_FORMAT format{ (DXGI_FORMAT)header.format };
 			const bool is_3d{ (flags & lightning::content::TextureFlags::IS_VOLUME_MAP) != 0 };
-			
-			assert(mip_levels <= D3D12Texture::max_mips);
-			u32 depth_per_mip_level[D3D12Texture::max_mips]{};
-
-			for (u32 i{ 0 }; i < D3D12Texture::max_mips; ++i) {
-				depth_per_mip_level[i] = 1;
-			}
-
-			if (is_3d) {
-				depth = array_size;
-				array_size = 1;
-				u32 depth_per_mip{ depth };
-
-				for (u32 i{ 0 }; i < mip_levels; ++i) {
-					depth_per_mip_level[i] = depth_per_mip;
-					depth_per_mip = std::max(depth_per_mip >> 1, (u32)1);
-				}
-			}
-
-			util::vector<D3D12_SUBRESOURCE_DATA> subresources{};
-
-			for (u32 i{ 0 }; i < array_size; ++i) {
-				for (u32 j{ 0 }; j < mip_levels; ++j) {
-					const u32 row_pitch{ blob.read<u32>() };
-					const u32 slice_pitch{ blob.read<u32>() };
+			const u32 depth{ is_3d ? header.array_size : 1 };
+			const u32 array_size{ is_3d ? 1 : header.array_size };
 
-					subresources.emplace_back(D3D12_SUBRESOURCE_DATA{ blob.position(), row_pitch, slice_pitch });
-					blob.skip(slice_pitch * depth_per_mip_level[j]);
-				}
-			}
+			assert(mip_levels <= D3D12Texture::max_mips);
+			const TextureSubresource* const subresources{ get_texture_subresources(data) };
 
 			D3D12_RESOURCE_DESC desc{};
 			desc.Dimension = is_3d ? D3D12_RESOURCE_DIMENSION_TEXTURE3D : D3D12_RESOURCE_DIMENSION_TEXTURE2D;
@@ -449,20 +566,25 @@ namespace lightning::graphics::direct3d12::content {
 				const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout{ layouts[subresource_idx] };
 				const u32 subresource_height{ num_rows[subresource_idx] };
 				const u32 subresource_depth{ layout.Footprint.Depth };
-				const D3D12_SUBRESOURCE_DATA& subresource{ subresources[subresource_idx] };
+				const TextureSubresource& subresource{ subresources[subresource_idx] };
+				const u8* const src{ data + subresource.offset };
+				u8* const dst{ cpu_address + layout.Offset };
+				assert(subresource.row_count == subresource_height && subresource.depth == subresource_depth);
+
+				// The container stores rows with the upload pitch, so usually the whole subresource is one copy.
+				if (subresource.row_pitch == layout.Footprint.RowPitch) {
+					memcpy(dst, src, (u64)subresource.slice_pitch * subresource_depth);
+					continue;
+				}
 
-				const D3D12_MEMCPY_DEST copy_dst{
-					cpu_address + layout.Offset,
-					layout.Footprint.RowPitch,
-					layout.Footprint.RowPitch * subresource_height
-				};
+				const u64 dst_slice_pitch{ (u64)layout.Footprint.RowPitch * subresource_height };
 
 				for (u32 depth_idx{ 0 }; depth_idx < subresource_depth; ++depth_idx) {
-					u8* const src_slice{ (u8* const)subresource.pData + subresource.SlicePitch * depth_idx };
-					u8* const dst_slice{ (u8* const)copy_dst.pData + copy_dst.SlicePitch * depth_idx };
+					const u8* const src_slice{ src + (u64)subresource.slice_pitch * depth_idx };
+					u8* const dst_slice{ dst + dst_slice_pitch * depth_idx };
 
 					for (u32 row_idx{ 0 }; row_idx < subresource_height; ++row_idx) {
-						memcpy(dst_slice + copy_dst.RowPitch * row_idx, src_slice + subresource.RowPitch * row_idx, row_sizes[subresource_idx]);
+						memcpy(dst_slice + (u64)layout.Footprint.RowPitch * row_idx, src_slice + (u64)subresource.row_pitch * row_idx, row_sizes[subresource_idx]);
 					}
 				}
 			}
@@ -545,7 +667,7 @@ namespace lightning::graphics::direct3d12::content {
 			const u32 primitive_topology{ blob.read<u32>() };
 			const u32 index_size{ (vertex_count < (1 << 16)) ? sizeof(u16) : sizeof(u32) };
 
-			const u32 position_buffer_size{ sizeof(math::v3) * vertex_count };
+			const u32 position_buffer_size{ lightning::content::get_position_buffer_size(elements_type, vertex_count) };
 			const u32 element_buffer_size{ element_size * vertex_count };
 			const u32 index_buffer_size{ index_size * index_count };
 
@@ -562,7 +684,7 @@ namespace lightning::graphics::direct3d12::content {
 			SubmeshView view{};
 			view.position_buffer_view.BufferLocation = resource->GetGPUVirtualAddress();
 			view.position_buffer_view.SizeInBytes = position_buffer_size;
-			view.position_buffer_view.StrideInBytes = sizeof(math::v3);
+			view.position_buffer_view.StrideInBytes = (elements_type & lightning::content::ElementsFlags::QUANTIZED_POSITION) ? sizeof(u16) * 4 : sizeof(math::v3);
 
 			if (element_size) {
 				view.element_buffer_view.BufferLocation = resource->GetGPUVirtualAddress() + aligned_position_buffer_size;
@@ -619,7 +741,37 @@ namespace lightning::graphics::direct3d12::content {
 			return id;
 		}
 
+		// The texture gets a new resource and descriptor, the old ones are released once the frames using them are done.
+		// Materials copy the descriptor indicies of their textures, so their copies are updated as well.
+		void update(id::id_type id, const u8* const data) {
+			assert(data);
+			D3D12Texture texture{ create_resource_from_texture_data(data) };
+
+			std::lock_guard material_lock{ material_mutex };
+			u32 descriptor_index{ u32_invalid_id };
+			{
+				std::lock_guard lock{ texture_mutex };
+				textures[id] = std::move(texture);
+				descriptor_index = textures[id].srv().index;
+				descriptor_indicies[id] = descriptor_index;
+			}
+
+			if (id >= texture_materials.size()) return;
+
+			for (const id::id_type material_id : texture_materials[id]) {
+				const D3D12MaterialStream stream{ materials[material_id].get() };
+
+				for (u32 i{ 0 }; i < stream.texture_count(); ++i) {
+					if (stream.texture_ids()[i] == id) stream.descriptor_indicies()[i] = descriptor_index;
+				}
+			}
+		}
+
+		// The id can be reused by the next texture, which mustn't inherit the materials of this one.
 		void remove(id::id_type id) {
+			std::lock_guard material_lock{ material_mutex };
+			if (id < texture_materials.size()) texture_materials[id].clear();
+
 			std::lock_guard lock{ texture_mutex };
 			textures.remove(id);
 			descriptor_indicies.remove(id);
@@ -645,17 +797,41 @@ namespace lightning::graphics::direct3d12::content {
 			D3D12MaterialStream stream{ buffer, info };
 
 			assert(buffer);
-			return materials.add(std::move(buffer));
+			const id::id_type id{ materials.add(std::move(buffer)) };
+
+			for (u32 i{ 0 }; i < info.texture_count; ++i) {
+				const id::id_type texture_id{ info.texture_ids[i] };
+				if (texture_id >= texture_materials.size()) texture_materials.resize(texture_id + 1);
+				texture_materials[texture_id].emplace_back(id);
+			}
+
+			return id;
 		}
 
 		void remove(id::id_type id) {
 			std::lock_guard lock{ material_mutex };
+
+			{
+				const D3D12MaterialStream stream{ materials[id].get() };
+
+				for (u32 i{ 0 }; i < stream.texture_count(); ++i) {
+					util::vector<id::id_type>& users{ texture_materials[stream.texture_ids()[i]] };
+
+					for (u32 j{ 0 }; j < users.size(); ++j) {
+						if (users[j] == id) {
+							users.erease_unordered(j);
+							break;
+						}
+					}
+				}
+			}
+
 			materials.remove(id);
 		}
 
 		void get_materials(const id::id_type* const material_ids, u32 material_count, const MaterialsCache& cache, u32& descriptor_index_count) {
 			assert(material_ids && material_count);
-			assert(cache.root_signatures && cache.material_types);
+			assert(cache.root_signatures && cache.material_types && cache.root_signature_ids);
 
 			std::lock_guard lock{ material_mutex };
 
@@ -668,6 +844,7 @@ namespace lightning::graphics::direct3d12::content {
 				cache.descriptor_indices[i] = stream.descriptor_indicies();
 				cache.texture_count[i] = stream.texture_count();
 				cache.material_surfaces[i] = stream.surface();
+				cache.root_signature_ids[i] = stream.root_signature_id();
 				total_index_count += stream.texture_count();
 			}
 
@@ -716,11 +893,19 @@ namespace lightning::graphics::direct3d12::content {
 
 			for (u32 i{ 0 }; i < material_count; ++i) {
 				item_ids[i] = render_items.add(d3d12_items[i]);
+				set_d3d12_render_item_changed(item_ids[i], true);
 			}
 
 			item_ids[material_count] = id::invalid_id;
 
-			return render_item_ids.add(std::move(items));
+			const id::id_type id{ render_item_ids.add(std::move(items)) };
+			const id::id_type index{ id::index(id) };
+
+			for (util::vector<f32>& camera_thresholds : render_item_thresholds) {
+				if (index < camera_thresholds.size()) camera_thresholds[index] = -1.f;
+			}
+
+			return id;
 		}
 
 		void remove(id::id_type id) {
@@ -730,17 +915,35 @@ namespace lightning::graphics::direct3d12::content {
 
 			for (u32 i{ 0 }; item_ids[i] != id::invalid_id; ++i) {
 				render_items.remove(item_ids[i]);
+				set_d3d12_render_item_changed(item_ids[i], false);
 			}
 
 			render_item_ids.remove(id);
 		}
 
-		void get_d3d12_render_items_id(const FrameInfo& info, util::vector<id::id_type>& d3d12_render_item_ids) {
-			assert(info.render_item_ids && info.thresholds && info.render_item_count);
+		void get_changes(util::vector<id::id_type>& added, util::vector<id::id_type>& removed) {
+			assert(added.empty() && removed.empty());
+			std::lock_guard lock{ render_item_mutex };
+
+			for (const id::id_type id : changed_d3d12_render_items) {
+				u8& state{ d3d12_render_item_states[id] };
+				(state & RenderItemState::ALIVE ? added : removed).emplace_back(id);
+				state &= ~RenderItemState::CHANGED;
+			}
+
+			changed_d3d12_render_items.clear();
+		}
+
+		void get_d3d12_render_items_id(const D3D12FrameInfo& d3d12_info, util::vector<id::id_type>& d3d12_render_item_ids) {
+			const FrameInfo& info{ *d3d12_info.info };
+			assert(info.render_item_ids && info.render_item_count);
 			assert(d3d12_render_item_ids.empty());
 
 			frame_cache.lod_offsets.clear();
+			frame_cache.bounds.clear();
 			frame_cache.geometry_ids.clear();
+			frame_cache.entity_ids.clear();
+			frame_cache.visible_items.clear();
 			const u32 count{ info.render_item_count };
 
 			std::lock_guard lock{ render_item_mutex };
@@ -748,24 +951,45 @@ namespace lightning::graphics::direct3d12::content {
 			for (u32 i{ 0 }; i < count; ++i) {
 				const id::id_type* const buffer{ render_item_ids[info.render_item_ids[i]].get() };
 				frame_cache.geometry_ids.emplace_back(buffer[0]);
+				frame_cache.entity_ids.emplace_back(render_items[buffer[1]].entity_id);
 			}
 
-			lightning::content::get_lod_offsets(frame_cache.geometry_ids.data(), info.thresholds, count, frame_cache.lod_offsets);
+			frame_cache.world_matrices.resize(count);
+			math::m4x4 inverse_world{};
 
-			assert(frame_cache.lod_offsets.size() == count);
+			for (u32 i{ 0 }; i < count; ++i) {
+				transform::get_transform_matrices(game_entity::entity_id{ frame_cache.entity_ids[i] }, frame_cache.world_matrices[i], inverse_world);
+			}
+
+			const f32* thresholds{ info.thresholds };
+
+			if (!thresholds) {
+				// Sized by the most detailed LOD, so the threshold doesn't depend on the LOD it selects.
+				frame_cache.thresholds.clear();
+				frame_cache.thresholds.resize(count, 0.f);
+				lightning::content::get_lod_bounds(frame_cache.geometry_ids.data(), frame_cache.thresholds.data(), count, frame_cache.bounds);
+				calculate_lod_thresholds(d3d12_info, frame_cache.bounds.data(), frame_cache.world_matrices.data(), count, frame_cache.thresholds.data());
+				frame_cache.bounds.clear();
+				thresholds = frame_cache.thresholds.data();
+			}
+
+			lightning::content::get_lods(frame_cache.geometry_ids.data(), thresholds, count, frame_cache.lod_offsets, frame_cache.bounds);
+
+			assert(frame_cache.lod_offsets.size() == count && frame_cache.bounds.size() == count);
+
+			// Only the items that can end up on screen are expanded into D3D12 render items.
+			culling::cull(d3d12_info.camera->view_projection(), frame_cache.bounds.data(), frame_cache.world_matrices.data(), count, frame_cache.visible_items);
 
 			u32 d3d12_render_item_count{ 0 };
 
-			for (u32 i{ 0 }; i < count; ++i) {
+			for (const u32 i : frame_cache.visible_items) {
 				d3d12_render_item_count += frame_cache.lod_offsets[i].count;
 			}
 
-			assert(d3d12_render_item_count);
-
 			d3d12_render_item_ids.resize(d3d12_render_item_count);
 			u32 item_index{ 0 };
 
-			for (u32 i{ 0 }; i < count; ++i) {
+			for (const u32 i : frame_cache.visible_items) {
 				const id::id_type* const item_ids{ &render_item_ids[info.render_item_ids[i]][1] };
 				const lightning::content::LodOffset& lod_offset{ frame_cache.lod_offsets[i] };
 				memcpy(&d3d12_render_item_ids[item_index], &item_ids[lod_offset.offset], sizeof(id::id_type) * lod_offset.count);
@@ -774,11 +998,47 @@ namespace lightning::graphics::direct3d12::content {
 				assert(item_index <= d3d12_render_item_count);
 			}
 			assert(item_index == d3d12_render_item_count);
+
+			// Every texture of the visible LODs is requested at the size of the largest item using it this frame.
+			const u32 visible_count{ (u32)frame_cache.visible_items.size() };
+			if (!visible_count) return;
+
+			frame_cache.screen_sizes.resize(visible_count);
+			calculate_screen_sizes(d3d12_info, frame_cache.bounds.data(), frame_cache.world_matrices.data(), frame_cache.visible_items.data(), visible_count, frame_cache.screen_sizes.data());
+
+			frame_cache.texture_ids.clear();
+			frame_cache.texture_sizes.clear();
+			item_index = 0;
+
+			{
+				std::lock_guard material_lock{ material_mutex };
+
+				for (u32 v{ 0 }; v < visible_count; ++v) {
+					const u32 item_count{ frame_cache.lod_offsets[frame_cache.visible_items[v]].count };
+
+					for (u32 i{ 0 }; i < item_count; ++i) {
+						const D3D12RenderItem& item{ render_items[d3d12_render_item_ids[item_index + i]] };
+						const D3D12MaterialStream stream{ materials[item.material_id].get() };
+
+						for (u32 t{ 0 }; t < stream.texture_count(); ++t) {
+							frame_cache.texture_ids.emplace_back(stream.texture_ids()[t]);
+							frame_cache.texture_sizes.emplace_back(frame_cache.screen_sizes[v]);
+						}
+					}
+
+					item_index += item_count;
+				}
+			}
+
+			// Not under material_mutex, texture residency updates materials when it changes mips.
+			if (!frame_cache.texture_ids.empty()) {
+				lightning::content::texture_residency::request_gpu_screen_size(frame_cache.texture_ids.data(), frame_cache.texture_sizes.data(), (u32)frame_cache.texture_ids.size());
+			}
 		}
 
 		void get_items(const id::id_type* const d3d12_render_item_ids, u32 id_count, const ItemsCache& cache) {
 			assert(d3d12_render_item_ids && id_count);
-			assert(cache.entity_ids && cache.submesh_gpu_ids && cache.material_ids && cache.gpass_psos && cache.depth_psos);
+			assert(cache.entity_ids && cache.submesh_gpu_ids && cache.material_ids && cache.gpass_psos && cache.depth_psos && cache.gpass_pso_ids && cache.depth_pso_ids);
 
 			std::lock_guard lock_1{ render_item_mutex };
 			std::lock_guard lock_2{ pso_mutex };
@@ -790,6 +1050,8 @@ namespace lightning::graphics::direct3d12::content {
 				cache.material_ids[i] = item.material_id;
 				cache.gpass_psos[i] = pipeline_states[item.pso_id];
 				cache.depth_psos[i] = pipeline_states[item.depth_pso_id];
+				cache.gpass_pso_ids[i] = item.pso_id;
+				cache.depth_pso_ids[i] = item.depth_pso_id;
 			}
 		}
 	}
@@ -1,6 +1,10 @@
 #pragma once
 #include "Direct3D12CommonHeaders.h"
 
+namespace lightning::graphics::direct3d12 {
+	struct D3D12FrameInfo;
+}
+
 namespace lightning::graphics::direct3d12::content {
 
 	bool initialize();
@@ -23,6 +27,7 @@ namespace lightning::graphics::direct3d12::content {
 
 	namespace texture {
 		id::id_type add(const u8* const data);
+		void update(id::id_type id, const u8* const data);
 		void remove(id::id_type id);
 		void get_descriptor_indicies(const id::id_type* const texture_ids, u32 id_count, u32* const indicies);
 	}
@@ -35,6 +40,7 @@ namespace lightning::graphics::direct3d12::content {
 			u32** const descriptor_indices;
 			u32* const texture_count;
 			MaterialSurface** const material_surfaces;
+			id::id_type* const root_signature_ids;
 		};
 
 		id::id_type add(MaterialInitInfo info);
@@ -50,11 +56,16 @@ namespace lightning::graphics::direct3d12::content {
 			id::id_type* const material_ids;
 			ID3D12PipelineState** const gpass_psos;
 			ID3D12PipelineState** const depth_psos;
+			id::id_type* const gpass_pso_ids;
+			id::id_type* const depth_pso_ids;
 		};
 
 		id::id_type add(id::id_type entity_id, id::id_type geometry_content_id, u32 material_count, const id::id_type* const material_ids);
 		void remove(id::id_type id);
-		void get_d3d12_render_items_id(const FrameInfo& info, util::vector<id::id_type>& d3d12_render_item_ids);
+		// D3D12 render items added or removed since the last call.
+		void get_changes(util::vector<id::id_type>& added, util::vector<id::id_type>& removed);
+		// Picks the LOD of every item of the frame, frustum culls them and expands the visible ones into D3D12 render items.
+		void get_d3d12_render_items_id(const D3D12FrameInfo& info, util::vector<id::id_type>& d3d12_render_item_ids);
 		void get_items(const id::id_type* const d3d12_render_item_ids, u32 id_count, const ItemsCache& cache);
 	}
 }
\ No newline at end of file
@@ -8,12 +8,46 @@
 #include "Direct3D12Light.h"
 #include "Direct3D12LightCulling.h"
 #include "Direct3D12Camera.h"
+#include "Direct3D12Recording.h"
 #include "Shaders/ShaderTypes.h"
+#include "Content/TextureResidency.h"
+#include "Utilities/ThreadPool.h"
 
 using namespace Microsoft::WRL;
 
 namespace lightning::graphics::direct3d12::core {
 	namespace {
+		// Creates the command lists and allocators of the parallel recording list pool of a command queue.
+		struct D3D12ListDevice {
+			using list_type = id3d12_graphics_command_list*;
+			using allocator_type = ID3D12CommandAllocator*;
+
+			D3D12_COMMAND_LIST_TYPE type{};
+
+			[[nodiscard]] list_type create_list(u32 index) const {
+				id3d12_graphics_command_list* list{ nullptr };
+				DXCall(core::device()->CreateCommandList1(0, type, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&list)));
+				NAME_D3D12_OBJECT_INDEXED(list, index, L"Parallel Recording Command List");
+				return list;
+			}
+
+			[[nodiscard]] allocator_type create_allocator(u32 frame_index, u32) const {
+				ID3D12CommandAllocator* allocator{ nullptr };
+				DXCall(core::device()->CreateCommandAllocator(type, IID_PPV_ARGS(&allocator)));
+				NAME_D3D12_OBJECT_INDEXED(allocator, frame_index, L"Parallel Recording Command Allocator");
+				return allocator;
+			}
+
+			void reset(list_type list, allocator_type allocator) const {
+				DXCall(allocator->Reset());
+				DXCall(list->Reset(allocator, nullptr));
+			}
+
+			void close(list_type list) const { DXCall(list->Close()); }
+			void release_list(list_type& list) const { core::release(list); }
+			void release_allocator(allocator_type& allocator) const { core::release(allocator); }
+		};
+
 		class D3D12Command {
 			public:
 				D3D12Command() = default;
@@ -25,6 +59,7 @@ namespace lightning::graphics::direct3d12::core {
 					desc.NodeMask = 0;
 					desc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
 					desc.Type = type;
+					_list_device.type = type;
 					DXCall(hr = device->CreateCommandQueue(&desc, IID_PPV_ARGS(&_cmd_queue)));
 					if (FAILED(hr)) goto _error;
 					NAME_D3D12_OBJECT(_cmd_queue, type == D3D12_COMMAND_LIST_TYPE_DIRECT ? L"GFX Command Queue" : type == D3D12_COMMAND_LIST_TYPE_COMPUTE ? L"Compute Command Queue" : L"Command Queue");
@@ -65,12 +100,25 @@ namespace lightning::graphics::direct3d12::core {
 					frame.wait(_fence_event, _fence);
 					DXCall(frame.cmd_allocator->Reset());
 					DXCall(_cmd_list->Reset(frame.cmd_allocator, nullptr));
+
+					_list_pool.begin_frame(_frame_index, _cmd_list);
+				}
+
+				// Closes the current command list and returns count lists for recording in parallel, followed by the new
+				// current list. Every list has its own allocator in each frame, so they can be recorded concurrently.
+				id3d12_graphics_command_list* const* begin_parallel_recording(u32 count) {
+					return _list_pool.begin_parallel_recording(_list_device, count);
 				}
 
 				void end_frame(const D3D12Surface& surface) {
-					DXCall(_cmd_list->Close());
-					ID3D12CommandList* const cmd_lists[]{ _cmd_list };
-					_cmd_queue->ExecuteCommandLists(_countof(cmd_lists), &cmd_lists[0]);
+					_list_pool.end_frame(_list_device);
+
+					_submitted_lists.clear();
+					for (u32 i{ 0 }; i < _list_pool.submitted_count(); ++i) {
+						_submitted_lists.emplace_back(_list_pool.submitted_lists()[i]);
+					}
+
+					_cmd_queue->ExecuteCommandLists((u32)_submitted_lists.size(), _submitted_lists.data());
 
 					surface.present();
 
@@ -100,13 +148,16 @@ namespace lightning::graphics::direct3d12::core {
 					core::release(_cmd_queue);
 					core::release(_cmd_list);
 
+					_list_pool.release(_list_device);
+					_submitted_lists.clear();
+
 					for (u32 i{ 0 }; i < FRAME_BUFFER_COUNT; ++i) {
 						_cmd_frames[i].release();
 					}
 				}
 
 				[[nodiscard]] constexpr ID3D12CommandQueue* const command_queue() const { return _cmd_queue; }
-				[[nodiscard]] constexpr id3d12_graphics_command_list* const command_list() const { return _cmd_list; }
+				[[nodiscard]] constexpr id3d12_graphics_command_list* const command_list() const { return _list_pool.current_list(); }
 				[[nodiscard]] constexpr u32 frame_index() const { return _frame_index; }
 
 			private:
@@ -131,6 +182,9 @@ namespace lightning::graphics::direct3d12::core {
 
 				ID3D12CommandQueue* _cmd_queue{ nullptr };
 				id3d12_graphics_command_list* _cmd_list{ nullptr };
+				D3D12ListDevice _list_device{};
+				recording::ListPool<D3D12ListDevice, FRAME_BUFFER_COUNT> _list_pool;
+				util::vector<ID3D12CommandList*> _submitted_lists;
 				ID3D12Fence1* _fence{ nullptr };
 				u64 _fence_value{ 0 };
 				CommandFrame _cmd_frames[FRAME_BUFFER_COUNT]{};
@@ -152,6 +206,9 @@ namespace lightning::graphics::direct3d12::core {
 		DescriptorHeap srv_desc_heap{ D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV };
 		DescriptorHeap uav_desc_heap{ D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV };
 
+		const D3D12Surface* frame_surface{ nullptr };
+		util::vector<id::id_type> residency_frame_surfaces;		// surfaces rendered since the last texture residency update
+
 		util::vector<IUnknown*> deferred_releases[FRAME_BUFFER_COUNT]{};
 		u32 deferred_release_flag[FRAME_BUFFER_COUNT]{};
 		std::mutex deferred_releases_mutex{};
@@ -209,6 +266,28 @@ namespace lightning::graphics::direct3d12::core {
 			}
 		}
 
+		void set_frame_state(id3d12_graphics_command_list* cmd_list, const D3D12Surface& surface) {
+			ID3D12DescriptorHeap* const heaps[]{ srv_desc_heap.heap() };
+			cmd_list->SetDescriptorHeaps(1, &heaps[0]);
+
+			cmd_list->RSSetViewports(1, &surface.viewport());
+			cmd_list->RSSetScissorRects(1, &surface.scissor_rect());
+		}
+
+		// Applies the texture requests of every surface of the previous frame, before any list of this frame references
+		// the textures. Surfaces don't share a frame begin, so a frame starts when a surface is rendered a second time.
+		void update_texture_residency(surface_id id) {
+			for (u32 i{ 0 }; i < residency_frame_surfaces.size(); ++i) {
+				if (residency_frame_surfaces[i] == id) {
+					lightning::content::texture_residency::update();
+					residency_frame_surfaces.clear();
+					break;
+				}
+			}
+
+			residency_frame_surfaces.emplace_back(id);
+		}
+
 		D3D12FrameInfo get_d3d12_frame_info(const FrameInfo& info, ConstantBuffer& cbuffer, const D3D12Surface& surface, u32 frame_index, f32 delta_time) {
 			camera::D3D12Camera& camera{ camera::get(info.camera_id) };
 			camera.update();
@@ -346,6 +425,7 @@ namespace lightning::graphics::direct3d12::core {
 		fx::shutdown();
 		gpass::shutdown();
 		shaders::shutdown();
+		util::thread_pool::shutdown();
 
 		for (u32 i{ 0 }; i < FRAME_BUFFER_COUNT; ++i) constant_buffers[i].release();
 
@@ -392,6 +472,17 @@ namespace lightning::graphics::direct3d12::core {
 	ConstantBuffer& c_buffer() { return constant_buffers[current_frame_index()]; }
 	u32 current_frame_index() { return gfx_command.frame_index(); }
 
+	id3d12_graphics_command_list* const* begin_parallel_recording(u32 count) {
+		assert(frame_surface);
+		id3d12_graphics_command_list* const* const cmd_lists{ gfx_command.begin_parallel_recording(count) };
+
+		for (u32 i{ 0 }; i <= count; ++i) {
+			set_frame_state(cmd_lists[i], *frame_surface);
+		}
+
+		return cmd_lists;
+	}
+
 	void set_deferred_release_flag() {
 		deferred_release_flag[current_frame_index()] = 1;
 	}
@@ -405,6 +496,13 @@ namespace lightning::graphics::direct3d12::core {
 	void remove_surface(surface_id id) {
 		gfx_command.flush();
 		surfaces.remove(id);
+
+		for (u32 i{ 0 }; i < residency_frame_surfaces.size(); ++i) {
+			if (residency_frame_surfaces[i] == id) {
+				residency_frame_surfaces.erease_unordered(i);
+				break;
+			}
+		}
 	}
 
 	void resize_surface(surface_id id, u32, u32) {
@@ -416,6 +514,8 @@ namespace lightning::graphics::direct3d12::core {
 	u32 surface_height(surface_id id) { return surfaces[id].height(); }
 
 	void render_surface(surface_id id, FrameInfo info) {
+		update_texture_residency(id);
+
 		gfx_command.begin_frame();
 		id3d12_graphics_command_list* cmd_list{ gfx_command.command_list() };
 
@@ -438,11 +538,8 @@ namespace lightning::graphics::direct3d12::core {
 		gpass::set_size({ frame_info.surface_width, frame_info.surface_height });
 		d3dx::D3D12ResourceBarrier& barriers{ resource_barriers };
 
-		ID3D12DescriptorHeap* const heaps[]{ srv_desc_heap.heap() };
-		cmd_list->SetDescriptorHeaps(1, &heaps[0]);
-		
-		cmd_list->RSSetViewports(1, &surface.viewport());
-		cmd_list->RSSetScissorRects(1, &surface.scissor_rect());
+		frame_surface = &surface;
+		set_frame_state(cmd_list, surface);
 	
 		barriers.add(current_back_buffer, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY);
 		gpass::add_transitions_for_depth_prepass(barriers);
@@ -450,6 +547,7 @@ namespace lightning::graphics::direct3d12::core {
 
 		gpass::set_render_targets_for_depth_prepass(cmd_list);
 		gpass::depth_prepass(cmd_list, frame_info);
+		cmd_list = gfx_command.command_list();
 
 		light::update_light_buffers(frame_info);
 		delight::cull_lights(cmd_list, frame_info, barriers);
@@ -457,6 +555,7 @@ namespace lightning::graphics::direct3d12::core {
 		barriers.apply(cmd_list);
 		gpass::set_render_targets_for_gpass(cmd_list);
 		gpass::render(cmd_list, frame_info);
+		cmd_list = gfx_command.command_list();
 
 		gpass::add_transitions_for_post_process(barriers);
 		barriers.add(current_back_buffer, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY);
@@ -467,5 +566,6 @@ namespace lightning::graphics::direct3d12::core {
 		d3dx::transition_resource(cmd_list, current_back_buffer, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
 
 		gfx_command.end_frame(surface);
+		frame_surface = nullptr;
 	}
 }
\ No newline at end of file
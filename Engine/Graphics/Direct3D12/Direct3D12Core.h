@@ -47,6 +47,11 @@ namespace lightning::graphics::direct3d12::core {
 	 [[nodiscard]] u32 current_frame_index();
 	void set_deferred_release_flag();
 
+	// Only while rendering a surface. Closes the current command list and returns count command lists for recording
+	// in parallel, followed by the new current command list. They're executed in that order at the end of the frame,
+	// each with the descriptor heaps, viewport and scissor rect of the frame already set.
+	[[nodiscard]] id3d12_graphics_command_list* const* begin_parallel_recording(u32 count);
+
 	[[nodiscard]] Surface create_surface(platform::Window window);
 	void remove_surface(surface_id id);
 	void resize_surface(surface_id id, u32 width, u32 height);
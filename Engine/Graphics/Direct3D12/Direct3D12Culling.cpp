@@ -0,0 +1,147 @@
+#include "Direct3D12Culling.h"
+#include "Utilities/ThreadPool.h"
+#include <algorithm>
+
+namespace lightning::graphics::direct3d12::culling {
+	namespace {
+
+		using namespace DirectX;
+
+		// Multiple of 4, a job always covers whole SIMD batches.
+		constexpr u32 items_per_job{ 1024 };
+
+		struct Frustum {
+			XMFLOAT4 planes[6];
+		};
+
+		// World space bounds of 4 items, one component per vector lane.
+		struct BoundsSoA {
+			XMVECTOR box_x, box_y, box_z;
+			XMVECTOR extents_x, extents_y, extents_z;
+			XMVECTOR sphere_x, sphere_y, sphere_z;
+			XMVECTOR radius;
+		};
+
+		util::vector<u8> visibility;
+
+		// Planes point inwards. Works for reversed depth too, near and far just swap places.
+		Frustum get_frustum(FXMMATRIX view_projection) {
+			const XMMATRIX m{ XMMatrixTranspose(view_projection) };
+			const XMVECTOR planes[6]{
+				XMVectorAdd(m.r[3], m.r[0]),
+				XMVectorSubtract(m.r[3], m.r[0]),
+				XMVectorAdd(m.r[3], m.r[1]),
+				XMVectorSubtract(m.r[3], m.r[1]),
+				m.r[2],
+				XMVectorSubtract(m.r[3], m.r[2]),
+			};
+
+			Frustum frustum{};
+			for (u32 i{ 0 }; i < _countof(planes); ++i) XMStoreFloat4(&frustum.planes[i], XMPlaneNormalize(planes[i]));
+
+			return frustum;
+		}
+
+		void load_bounds(const lightning::content::GeometryBounds* const bounds, const math::m4x4* const world, u32 first, u32 lane_count, BoundsSoA& soa) {
+			XMFLOAT4A box[4]{};
+			XMFLOAT4A extents[4]{};
+			XMFLOAT4A sphere[4]{};
+
+			for (u32 lane{ 0 }; lane < lane_count; ++lane) {
+				const lightning::content::GeometryBounds& b{ bounds[first + lane] };
+				const XMMATRIX m{ XMLoadFloat4x4(&world[first + lane]) };
+
+				const XMVECTOR e{ XMLoadFloat3(&b.aabb_extents) };
+				XMVECTOR world_extents{ XMVectorMultiply(XMVectorAbs(m.r[0]), XMVectorSplatX(e)) };
+				world_extents = XMVectorMultiplyAdd(XMVectorAbs(m.r[1]), XMVectorSplatY(e), world_extents);
+				world_extents = XMVectorMultiplyAdd(XMVectorAbs(m.r[2]), XMVectorSplatZ(e), world_extents);
+
+				const XMVECTOR scale{ XMVectorMax(XMVector3LengthSq(m.r[0]), XMVectorMax(XMVector3LengthSq(m.r[1]), XMVector3LengthSq(m.r[2]))) };
+				const XMVECTOR radius{ XMVectorMultiply(XMVectorReplicate(b.sphere_radius), XMVectorSqrt(scale)) };
+
+				XMStoreFloat4A(&box[lane], XMVector3Transform(XMLoadFloat3(&b.aabb_center), m));
+				XMStoreFloat4A(&extents[lane], world_extents);
+				XMStoreFloat4A(&sphere[lane], XMVectorSelect(XMVector3Transform(XMLoadFloat3(&b.sphere_center), m), radius, g_XMSelect0001));
+			}
+
+			// Transposing turns 4 items into one vector per component.
+			XMMATRIX t{ XMMatrixTranspose(XMLoadFloat4x4A((const XMFLOAT4X4A*)box)) };
+			soa.box_x = t.r[0];
+			soa.box_y = t.r[1];
+			soa.box_z = t.r[2];
+
+			t = XMMatrixTranspose(XMLoadFloat4x4A((const XMFLOAT4X4A*)extents));
+			soa.extents_x = t.r[0];
+			soa.extents_y = t.r[1];
+			soa.extents_z = t.r[2];
+
+			t = XMMatrixTranspose(XMLoadFloat4x4A((const XMFLOAT4X4A*)sphere));
+			soa.sphere_x = t.r[0];
+			soa.sphere_y = t.r[1];
+			soa.sphere_z = t.r[2];
+			soa.radius = t.r[3];
+		}
+
+		// Returns a bit for every lane that is completely outside of at least one plane.
+		u32 test_bounds(const Frustum& frustum, const BoundsSoA& soa) {
+			XMVECTOR outside{ XMVectorFalseInt() };
+
+			for (const XMFLOAT4& plane : frustum.planes) {
+				const XMVECTOR a{ XMVectorReplicate(plane.x) };
+				const XMVECTOR b{ XMVectorReplicate(plane.y) };
+				const XMVECTOR c{ XMVectorReplicate(plane.z) };
+				const XMVECTOR d{ XMVectorReplicate(plane.w) };
+
+				XMVECTOR sphere_distance{ XMVectorMultiplyAdd(soa.sphere_x, a, d) };
+				sphere_distance = XMVectorMultiplyAdd(soa.sphere_y, b, sphere_distance);
+				sphere_distance = XMVectorMultiplyAdd(soa.sphere_z, c, sphere_distance);
+
+				XMVECTOR box_distance{ XMVectorMultiplyAdd(soa.box_x, a, d) };
+				box_distance = XMVectorMultiplyAdd(soa.box_y, b, box_distance);
+				box_distance = XMVectorMultiplyAdd(soa.box_z, c, box_distance);
+
+				XMVECTOR box_radius{ XMVectorMultiply(soa.extents_x, XMVectorAbs(a)) };
+				box_radius = XMVectorMultiplyAdd(soa.extents_y, XMVectorAbs(b), box_radius);
+				box_radius = XMVectorMultiplyAdd(soa.extents_z, XMVectorAbs(c), box_radius);
+
+				outside = XMVectorOrInt(outside, XMVectorLess(sphere_distance, XMVectorNegate(soa.radius)));
+				outside = XMVectorOrInt(outside, XMVectorLess(box_distance, XMVectorNegate(box_radius)));
+			}
+
+			return (u32)_mm_movemask_ps(outside);
+		}
+
+		void cull_range(const Frustum& frustum, const lightning::content::GeometryBounds* const bounds, const math::m4x4* const world, u32 first, u32 count, u8* const visible) {
+			BoundsSoA soa{};
+
+			for (u32 i{ first }; i < first + count; i += 4) {
+				const u32 lane_count{ std::min(first + count - i, 4u) };
+				load_bounds(bounds, world, i, lane_count, soa);
+				const u32 outside{ test_bounds(frustum, soa) };
+
+				for (u32 lane{ 0 }; lane < lane_count; ++lane) {
+					visible[i + lane] = (outside & (1 << lane)) ? 0 : 1;
+				}
+			}
+		}
+	}
+
+	void cull(FXMMATRIX view_projection, const lightning::content::GeometryBounds* const bounds, const math::m4x4* const world, u32 count, util::vector<u32>& visible) {
+		assert(bounds && world && count);
+		assert(visible.empty());
+
+		const Frustum frustum{ get_frustum(view_projection) };
+		visibility.resize(count);
+		u8* const flags{ visibility.data() };
+
+		const u32 job_count{ (count + items_per_job - 1) / items_per_job };
+		util::thread_pool::parallel_for(job_count, [&](u32 job) {
+			const u32 first{ job * items_per_job };
+			cull_range(frustum, bounds, world, first, std::min(count - first, items_per_job), flags);
+		});
+
+		for (u32 i{ 0 }; i < count; ++i) {
+			if (flags[i]) visible.emplace_back(i);
+		}
+	}
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "Direct3D12CommonHeaders.h"
+#include "Content/ContentToEngine.h"
+
+namespace lightning::graphics::direct3d12::culling {
+
+	// Writes the indicies of the items that intersect the view frustum, in ascending order.
+	// Bounds are in model space and placed in the world with the matching world matrix.
+	void cull(DirectX::FXMMATRIX view_projection, const lightning::content::GeometryBounds* const bounds, const math::m4x4* const world, u32 count, util::vector<u32>& visible);
+}
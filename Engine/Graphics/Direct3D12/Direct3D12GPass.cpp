@@ -5,9 +5,13 @@
 #include "Direct3D12Light.h"
 #include "Direct3D12Camera.h"
 #include "Direct3D12LightCulling.h"
+#include "Direct3D12Recording.h"
+#include "Direct3D12Indirect.h"
 #include "Shaders/ShaderTypes.h"
 #include "Components/Entity.h"
 #include "Components/Transform.h"
+#include "Utilities/ThreadPool.h"
+#include <algorithm>
 
 namespace lightning::graphics::direct3d12::gpass {
 	namespace {
@@ -15,6 +19,10 @@ namespace lightning::graphics::direct3d12::gpass {
 		#undef OPAQUE
 		#endif
 
+		#ifdef TRANSPARENT
+		#undef TRANSPARENT
+		#endif
+
 		constexpr math::u32v2 initial_dimensions{ 100, 100 };
 
 		D3D12RenderTexture gpass_main_buffer{};
@@ -28,124 +36,365 @@ namespace lightning::graphics::direct3d12::gpass {
 		constexpr f32 clear_value[4]{};
 		#endif
 
+		// Draws are sorted by a 64 bit key, most significant bits first:
+		// material type | root signature | pso | material | depth bucket
+		struct SortKey {
+			constexpr static u32 depth_bits{ 16 };
+			constexpr static u32 material_bits{ 16 };
+			constexpr static u32 pso_bits{ 16 };
+			constexpr static u32 root_signature_bits{ 12 };
+
+			constexpr static u32 material_shift{ depth_bits };
+			constexpr static u32 pso_shift{ material_shift + material_bits };
+			constexpr static u32 root_signature_shift{ pso_shift + pso_bits };
+			constexpr static u32 material_type_shift{ root_signature_shift + root_signature_bits };
+		};
+
+		struct SortItem {
+			u64 key;
+			u32 index;
+		};
+
+		constexpr u32 radix_bits{ 8 };
+		constexpr u32 radix_size{ 1 << radix_bits };
+		constexpr u32 min_items_per_sort_job{ 4096 };
+		constexpr u32 min_items_per_prepare_job{ 1024 };
+		constexpr u32 min_draws_per_recording_list{ 512 };
+		// Shorter batches are drawn directly, the fixed cost of an ExecuteIndirect only pays off when it replaces several draws.
+		constexpr u32 min_draws_per_indirect_batch{ 8 };
+
+		struct Pass {
+			enum Type : u32 {
+				DEPTH_PREPASS,
+				GPASS,
+
+				count
+			};
+		};
+
+		FrameStats frame_stats{};
+		util::vector<recording::Range> recording_ranges;
+		util::vector<FrameStats> recording_stats;
+
+		// One job for every worker and the calling thread, unless there are too few items to be worth it.
+		[[nodiscard]] u32 get_job_count(u32 items_count, u32 min_items_per_job) {
+			return std::max(1u, std::min(util::thread_pool::worker_count() + 1, items_count / min_items_per_job));
+		}
+
 		#if USE_STL_VECTOR
 		#define CONSTEXPR
 		#else
 		#define CONSTEXPR constexpr
 		#endif
 
-		struct GPassCache {
-			util::vector<id::id_type> d3d12_render_item_ids;
-			u32 descriptor_index_count{ 0 };
-
-			id::id_type* entity_ids{ nullptr };
-			id::id_type* submesh_gpu_ids{ nullptr };
-			id::id_type* material_ids{ nullptr };
-			ID3D12PipelineState** gpass_pipeline_states{ nullptr };
-			ID3D12PipelineState** depth_pipeline_states{ nullptr };
-			ID3D12RootSignature** root_signatures{ nullptr };
-			MaterialType::Type* material_types{ nullptr };
-			u32** descriptor_indices{ nullptr };
-			u32* texture_counts{ nullptr };
-			MaterialSurface** material_surfaces{ nullptr };
-			D3D12_GPU_VIRTUAL_ADDRESS* position_buffers{ nullptr };
-			D3D12_GPU_VIRTUAL_ADDRESS* element_buffers{ nullptr };
-			D3D12_INDEX_BUFFER_VIEW* index_buffer_views{ nullptr };
-			D3D_PRIMITIVE_TOPOLOGY* primitive_topologies{ nullptr };
-			u32* elements_types{ nullptr };
-			D3D12_GPU_VIRTUAL_ADDRESS* per_object_data{ nullptr };
-			D3D12_GPU_VIRTUAL_ADDRESS* srv_indices{ nullptr };
-
-			constexpr content::render_item::ItemsCache items_cache() const {
+		// Everything needed to draw a D3D12 render item, indexed by its id. Rows are only fetched from content
+		// when render items are added: materials and submeshes don't change after they're created.
+		struct DrawCache {
+			util::vector<id::id_type> entity_ids;
+			util::vector<id::id_type> submesh_gpu_ids;
+			util::vector<id::id_type> material_ids;
+			util::vector<ID3D12PipelineState*> gpass_pipeline_states;
+			util::vector<ID3D12PipelineState*> depth_pipeline_states;
+			util::vector<id::id_type> gpass_pso_ids;
+			util::vector<id::id_type> depth_pso_ids;
+			util::vector<ID3D12RootSignature*> root_signatures;
+			util::vector<MaterialType::Type> material_types;
+			util::vector<u32*> descriptor_indices;
+			util::vector<u32> texture_counts;
+			util::vector<MaterialSurface*> material_surfaces;
+			util::vector<id::id_type> root_signature_ids;
+			util::vector<D3D12_GPU_VIRTUAL_ADDRESS> position_buffers;
+			util::vector<D3D12_GPU_VIRTUAL_ADDRESS> element_buffers;
+			util::vector<D3D12_INDEX_BUFFER_VIEW> index_buffer_views;
+			util::vector<D3D_PRIMITIVE_TOPOLOGY> primitive_topologies;
+			util::vector<u32> elements_types;
+
+			content::render_item::ItemsCache items_cache(id::id_type id) {
 				return {
-					entity_ids,
-					submesh_gpu_ids,
-					material_ids,
-					gpass_pipeline_states,
-					depth_pipeline_states
+					&entity_ids[id],
+					&submesh_gpu_ids[id],
+					&material_ids[id],
+					&gpass_pipeline_states[id],
+					&depth_pipeline_states[id],
+					&gpass_pso_ids[id],
+					&depth_pso_ids[id]
 				};
 			}
 
-			constexpr content::submesh::ViewsCache views_cache() const {
+			content::submesh::ViewsCache views_cache(id::id_type id) {
 				return {
-					position_buffers,
-					element_buffers,
-					index_buffer_views,
-					primitive_topologies,
-					elements_types
+					&position_buffers[id],
+					&element_buffers[id],
+					&index_buffer_views[id],
+					&primitive_topologies[id],
+					&elements_types[id]
 				};
 			}
 
-			constexpr content::material::MaterialsCache materials_cache() const {
+			content::material::MaterialsCache materials_cache(id::id_type id) {
 				return {
-					root_signatures,
-					material_types,
-					descriptor_indices,
-					texture_counts,
-					material_surfaces
+					&root_signatures[id],
+					&material_types[id],
+					&descriptor_indices[id],
+					&texture_counts[id],
+					&material_surfaces[id],
+					&root_signature_ids[id]
 				};
 			}
 
+			CONSTEXPR u32 size() const { return (u32)entity_ids.size(); }
+
+			void resize(u32 size) {
+				entity_ids.resize(size, id::invalid_id);
+				submesh_gpu_ids.resize(size);
+				material_ids.resize(size);
+				gpass_pipeline_states.resize(size);
+				depth_pipeline_states.resize(size);
+				gpass_pso_ids.resize(size);
+				depth_pso_ids.resize(size);
+				root_signatures.resize(size);
+				material_types.resize(size);
+				descriptor_indices.resize(size);
+				texture_counts.resize(size);
+				material_surfaces.resize(size);
+				root_signature_ids.resize(size);
+				position_buffers.resize(size);
+				element_buffers.resize(size);
+				index_buffer_views.resize(size);
+				primitive_topologies.resize(size);
+				elements_types.resize(size);
+			}
+
+			void clear() { resize(0); }
+
+			void update() {
+				using namespace content;
+				_added.clear();
+				_removed.clear();
+				render_item::get_changes(_added, _removed);
+
+				for (const id::id_type id : _removed) {
+					if (id < size()) entity_ids[id] = id::invalid_id;
+				}
+
+				u32 new_size{ size() };
+				for (const id::id_type id : _added) new_size = std::max(new_size, id + 1);
+				if (new_size != size()) resize(new_size);
+
+				for (const id::id_type id : _added) {
+					const render_item::ItemsCache items{ items_cache(id) };
+					render_item::get_items(&id, 1, items);
+					submesh::get_views(items.submesh_gpu_ids, 1, views_cache(id));
+
+					u32 descriptor_index_count{ 0 };
+					material::get_materials(items.material_ids, 1, materials_cache(id), descriptor_index_count);
+				}
+			}
+
+			// Changes applied by the last update.
+			[[nodiscard]] const util::vector<id::id_type>& added() const { return _added; }
+			[[nodiscard]] const util::vector<id::id_type>& removed() const { return _removed; }
+
+			private:
+				util::vector<id::id_type> _added;
+				util::vector<id::id_type> _removed;
+		} draw_cache;
+
+		// Object data of every D3D12 render item, in one upload buffer per frame in flight. A row is only written
+		// when its item was added or its entity moved, once into each of the frame buffers. Shaders read the rows
+		// as a structured buffer, indexed by the D3D12 render item id.
+		class ObjectDataBuffer {
+		public:
+			void update(const DrawCache& draws, u32 frame_index) {
+				assert(frame_index < FRAME_BUFFER_COUNT);
+				for (const id::id_type id : draws.removed()) remove(id);
+				for (const id::id_type id : draws.added()) add(id, draws.entity_ids[id]);
+
+				const u32 count{ (u32)_entity_ids.size() };
+				if (count) {
+					_transform_flags.resize(count);
+					transform::get_updated_component_flags(_entity_ids.data(), count, _transform_flags.data());
+
+					for (u32 i{ 0 }; i < count; ++i) {
+						if (_transform_flags[i]) set_dirty(_entity_rows[i], all_frames_dirty);
+					}
+				}
+
+				FrameBuffer& frame_buffer{ _buffers[frame_index] };
+				const u8 frame_mask{ (u8)(1 << frame_index) };
+
+				if (frame_buffer.buffer.size() < draws.size() * object_data_stride) {
+					resize_buffer(frame_buffer, (draws.size() * 3) >> 1, frame_index);
+					for (const id::id_type id : _entity_rows) set_dirty(id, frame_mask);
+				}
+
+				const u32 dirty_row_count{ (u32)_dirty_rows.size() };
+				if (!dirty_row_count) return;
+
+				// Rows are only in the list once, so the jobs never write the same row or dirty bits.
+				const u32 job_count{ get_job_count(dirty_row_count, min_items_per_prepare_job) };
+				const u32 rows_per_job{ (dirty_row_count + job_count - 1) / job_count };
+				util::thread_pool::parallel_for(job_count, [&](u32 job) {
+					const u32 last{ std::min(dirty_row_count, (job + 1) * rows_per_job) };
+					for (u32 i{ job * rows_per_job }; i < last; ++i) {
+						const id::id_type id{ _dirty_rows[i] };
+						if (_dirty_bits[id] & frame_mask) {
+							write_row(draws, id, frame_buffer.cpu_address);
+							_dirty_bits[id] &= ~frame_mask;
+						}
+					}
+				});
+
+				u32 dirty_count{ 0 };
+				for (const id::id_type id : _dirty_rows) {
+					if (_dirty_bits[id]) _dirty_rows[dirty_count++] = id;
+				}
+
+				_dirty_rows.resize(dirty_count);
+			}
+
+			[[nodiscard]] D3D12_GPU_VIRTUAL_ADDRESS gpu_address(u32 frame_index) const {
+				assert(frame_index < FRAME_BUFFER_COUNT);
+				return _buffers[frame_index].buffer.gpu_address();
+			}
+
+			void release() {
+				for (u32 i{ 0 }; i < FRAME_BUFFER_COUNT; ++i) {
+					_buffers[i].buffer.release();
+					_buffers[i].cpu_address = nullptr;
+				}
+
+				_dirty_bits.clear();
+				_dirty_rows.clear();
+				_entity_ids.clear();
+				_entity_rows.clear();
+				_entity_positions.clear();
+			}
+
+		private:
+			constexpr static u32 object_data_stride{ sizeof(hlsl::PerObjectData) };
+			constexpr static u8 all_frames_dirty{ (1 << FRAME_BUFFER_COUNT) - 1 };
+
+			struct FrameBuffer {
+				D3D12Buffer buffer{};
+				u8* cpu_address{ nullptr };
+			};
+
+			void add(id::id_type id, id::id_type entity_id) {
+				if (id >= _entity_positions.size()) {
+					_entity_positions.resize(id + 1, u32_invalid_id);
+					_dirty_bits.resize(id + 1, 0);
+				}
+
+				if (_entity_positions[id] == u32_invalid_id) {
+					_entity_positions[id] = (u32)_entity_ids.size();
+					_entity_ids.emplace_back(entity_id);
+					_entity_rows.emplace_back(id);
+				}
+				else {
+					_entity_ids[_entity_positions[id]] = game_entity::entity_id{ entity_id };
+				}
+
+				set_dirty(id, all_frames_dirty);
+			}
+
+			void remove(id::id_type id) {
+				if (id >= _entity_positions.size() || _entity_positions[id] == u32_invalid_id) return;
+
+				const u32 position{ _entity_positions[id] };
+				const id::id_type last_row{ _entity_rows.back() };
+				util::erease_unordered(_entity_ids, position);
+				util::erease_unordered(_entity_rows, position);
+				if (last_row != id) _entity_positions[last_row] = position;
+				_entity_positions[id] = u32_invalid_id;
+				// Leave it in _dirty_rows when it's there, writing the unused row is harmless.
+			}
+
+			void set_dirty(id::id_type id, u8 frame_bits) {
+				u8& bits{ _dirty_bits[id] };
+				if (!bits) _dirty_rows.emplace_back(id);
+				bits |= frame_bits;
+			}
+
+			void write_row(const DrawCache& draws, id::id_type id, u8* const cpu_address) const {
+				assert(cpu_address);
+				const id::id_type entity_id{ draws.entity_ids[id] };
+				if (!id::is_valid(entity_id)) return;
+
+				hlsl::PerObjectData data{};
+				transform::get_transform_matrices(game_entity::entity_id{ entity_id }, data.world, data.inv_world);
+				memcpy(&data.base_color, draws.material_surfaces[id], sizeof(MaterialSurface));
+				memcpy(cpu_address + (u64)id * object_data_stride, &data, sizeof(hlsl::PerObjectData));
+			}
+
+			void resize_buffer(FrameBuffer& frame_buffer, u32 row_count, [[maybe_unused]] u32 frame_index) {
+				frame_buffer.buffer = D3D12Buffer{ ConstantBuffer::get_default_init_info(row_count * object_data_stride), true };
+				NAME_D3D12_OBJECT_INDEXED(frame_buffer.buffer.buffer(), frame_index, L"GPass Object Data Buffer");
+
+				D3D12_RANGE range{};
+				DXCall(frame_buffer.buffer.buffer()->Map(0, &range, (void**)(&frame_buffer.cpu_address)));
+				assert(frame_buffer.cpu_address);
+			}
+
+			FrameBuffer _buffers[FRAME_BUFFER_COUNT]{};
+			util::vector<u8> _dirty_bits;								// one bit per frame buffer that has an old copy of the row
+			util::vector<id::id_type> _dirty_rows;
+			util::vector<game_entity::entity_id> _entity_ids;			// one per live row, for getting the transform flags in one call
+			util::vector<id::id_type> _entity_rows;
+			util::vector<u32> _entity_positions;						// index of the row in _entity_ids
+			util::vector<u8> _transform_flags;
+		} object_data;
+
+		// Per frame data of the visible D3D12 render items, in the order get_d3d12_render_items_id returned them.
+		// Items that share submesh, material and pipeline state are merged into one instanced draw, after sorting
+		// draw_order only has the first item of every draw.
+		struct GPassCache {
+			util::vector<id::id_type> d3d12_render_item_ids;
+			util::vector<SortItem> draw_order;
+			util::vector<SortItem> sort_scratch;
+			util::vector<D3D12_GPU_VIRTUAL_ADDRESS> srv_indices;
+			util::vector<indirect::InstanceRange> instances;		// in draw order
+			util::vector<id::id_type> instance_rows;				// object data rows of the instances of every draw
+			util::vector<indirect::InstanceItem> instance_items;	// every sorted item
+			util::vector<u32> draw_items;							// first sorted item of every draw
+			util::vector<u64> draw_states[Pass::count];				// in draw order
+			util::vector<indirect::Batch> batches[Pass::count];
+
 			CONSTEXPR u32 size() const { return (u32)d3d12_render_item_ids.size(); }
+			CONSTEXPR u32 draw_count() const { return (u32)draw_order.size(); }
 
 			CONSTEXPR void clear() {
 				d3d12_render_item_ids.clear();
-				descriptor_index_count = 0;
-			}
+				draw_order.clear();
+				instances.clear();
 
-			CONSTEXPR void resize() {
-				const u64 items_count{ d3d12_render_item_ids.size() };
-				const u64 new_buffer_size{ items_count * struct_size };
-				const u64 old_buffer_size{ _buffer.size() };
-
-				if (new_buffer_size > old_buffer_size) _buffer.resize(new_buffer_size);
-
-				if (new_buffer_size != old_buffer_size) {
-					entity_ids = (id::id_type*)_buffer.data();
-					submesh_gpu_ids = (id::id_type*)&entity_ids[items_count];
-					material_ids = (id::id_type*)&submesh_gpu_ids[items_count];
-					gpass_pipeline_states = (ID3D12PipelineState**)&material_ids[items_count];
-					depth_pipeline_states = (ID3D12PipelineState**)&gpass_pipeline_states[items_count];
-					root_signatures = (ID3D12RootSignature**)&depth_pipeline_states[items_count];
-					material_types = (MaterialType::Type*)&root_signatures[items_count];
-					descriptor_indices = (u32**)&material_types[items_count];
-					texture_counts = (u32*)&descriptor_indices[items_count];
-					material_surfaces = (MaterialSurface**)&texture_counts[items_count];
-					position_buffers = (D3D12_GPU_VIRTUAL_ADDRESS*)&material_surfaces[items_count];
-					element_buffers = (D3D12_GPU_VIRTUAL_ADDRESS*)&position_buffers[items_count];
-					index_buffer_views = (D3D12_INDEX_BUFFER_VIEW*)&element_buffers[items_count];
-					primitive_topologies = (D3D_PRIMITIVE_TOPOLOGY*)&index_buffer_views[items_count];
-					elements_types = (u32*)&primitive_topologies[items_count];
-					per_object_data = (D3D12_GPU_VIRTUAL_ADDRESS*)&elements_types[items_count];
-					srv_indices = (D3D12_GPU_VIRTUAL_ADDRESS*)&per_object_data[items_count];
+				for (u32 i{ 0 }; i < Pass::count; ++i) {
+					draw_states[i].clear();
+					batches[i].clear();
 				}
 			}
 
-			private:
-				constexpr static u32 struct_size{
-					sizeof(id::id_type) +
-					sizeof(id::id_type) +
-					sizeof(id::id_type) +
-					sizeof(ID3D12PipelineState*) +
-					sizeof(ID3D12PipelineState*) +
-					sizeof(ID3D12RootSignature*) +
-					sizeof(MaterialType::Type) +
-					sizeof(u32*) + 
-					sizeof(u32) + 
-					sizeof(MaterialSurface*) + 
-					sizeof(D3D12_GPU_VIRTUAL_ADDRESS) +
-					sizeof(D3D12_GPU_VIRTUAL_ADDRESS) +
-					sizeof(D3D12_INDEX_BUFFER_VIEW) +
-					sizeof(D3D_PRIMITIVE_TOPOLOGY) +
-					sizeof(u32) +
-					sizeof(D3D12_GPU_VIRTUAL_ADDRESS) + 
-					sizeof(D3D12_GPU_VIRTUAL_ADDRESS)
-				};
-
-				util::vector<u8> _buffer;
+			void resize() {
+				const u32 items_count{ size() };
+				draw_order.resize(items_count);
+				srv_indices.resize(items_count);
+			}
 		} frame_cache;
 		#undef CONSTEXPR
 
+		// Upload buffer that's rewritten every frame, one per frame in flight.
+		struct FrameUploadBuffer {
+			D3D12Buffer buffer{};
+			u8* cpu_address{ nullptr };
+			u32 size{ 0 };
+		};
+
+		FrameUploadBuffer argument_buffers[FRAME_BUFFER_COUNT]{};		// indirect arguments of the draws
+		FrameUploadBuffer instance_buffers[FRAME_BUFFER_COUNT]{};		// GPassCache::instance_rows
+		// Keyed by the root signature itself, ids of removed root signatures can be reused for different ones.
+		std::unordered_map<ID3D12RootSignature*, ID3D12CommandSignature*> command_signatures;
+		indirect::InstanceState instance_state;
+
 		bool create_buffers(math::u32v2 size) {
 			assert(size.x && size.y);
 			gpass_main_buffer.release();
@@ -193,49 +442,145 @@ namespace lightning::graphics::direct3d12::gpass {
 			return gpass_main_buffer.resource() && gpass_depth_buffer.resource();
 		}
 
-		void fill_per_object_data(const D3D12FrameInfo& info, const content::material::MaterialsCache& materials_cache) {
-			const GPassCache& cache{ frame_cache };
-			const u32 render_items_count{ (u32)cache.size() };
-			id::id_type current_entity_id{ id::invalid_id };
-			hlsl::PerObjectData* current_data_pointer{ nullptr };
+		// Opaque draws are ordered front to back for early depth rejection, transparent ones back to front.
+		[[nodiscard]] u64 depth_bucket(f32 view_depth, f32 far_z, MaterialType::Type material_type) {
+			constexpr u32 max_bucket{ (1 << SortKey::depth_bits) - 1 };
+			const f32 depth{ std::min(std::max(view_depth / far_z, 0.f), 1.f) };
+			// sqrt gives more buckets to the items close to the camera.
+			const u32 bucket{ (u32)(std::sqrt(depth) * max_bucket) };
+			return material_type == MaterialType::TRANSPARENT ? max_bucket - bucket : bucket;
+		}
 
-			ConstantBuffer& cbuffer{ core::c_buffer() };
+		// Builds the sort keys and packs the srv indices of a range of the visible items. Every range gets its own
+		// block of the constant buffer for the srv indices, so the jobs don't share any data.
+		void prepare_items(const D3D12FrameInfo& info, u32 first, u32 last) {
+			GPassCache& cache{ frame_cache };
+			const DrawCache& draws{ draw_cache };
+			const D3D12Camera& camera{ *info.camera };
+			const f32 far_z{ camera.far_z() };
+			id::id_type current_entity_id{ id::invalid_id };
+			f32 view_depth{ 0.f };
+			u32 texture_count{ 0 };
 
 			using namespace DirectX;
-			for (u32 i{ 0 }; i < render_items_count; ++i) {
-				if (current_entity_id != cache.entity_ids[i]) {
-					current_entity_id = cache.entity_ids[i];
-					hlsl::PerObjectData data{};
-					transform::get_transform_matrices(game_entity::entity_id{ current_entity_id }, data.world, data.inv_world);
-					XMMATRIX world{ XMLoadFloat4x4(&data.world) };
-					XMMATRIX wvp{ XMMatrixMultiply(world, info.camera->view_projection()) };
-					XMStoreFloat4x4(&data.world_view_projection, wvp);
-
-					const MaterialSurface* const surface{ materials_cache.material_surfaces[i] };
-					memcpy(&data.base_color, surface, sizeof(MaterialSurface));
-
-					current_data_pointer = cbuffer.allocate<hlsl::PerObjectData>();
-					memcpy(current_data_pointer, &data, sizeof(hlsl::PerObjectData));
+			for (u32 i{ first }; i < last; ++i) {
+				const id::id_type item_id{ cache.d3d12_render_item_ids[i] };
+				assert(id::is_valid(draws.entity_ids[item_id]));
+
+				if (current_entity_id != draws.entity_ids[item_id]) {
+					current_entity_id = draws.entity_ids[item_id];
+					const math::v3 position{ game_entity::Entity{ game_entity::entity_id{ current_entity_id } }.transform().position() };
+					const XMVECTOR to_item{ XMVectorSubtract(XMLoadFloat3(&position), camera.position()) };
+					view_depth = XMVectorGetX(XMVector3Dot(to_item, camera.direction()));
+				}
+
+				const MaterialType::Type material_type{ draws.material_types[item_id] };
+				assert(draws.root_signature_ids[item_id] < (1 << SortKey::root_signature_bits));
+				assert(draws.gpass_pso_ids[item_id] < (1 << SortKey::pso_bits));
+
+				const u64 key{
+					((u64)material_type << SortKey::material_type_shift) |
+					((u64)draws.root_signature_ids[item_id] << SortKey::root_signature_shift) |
+					((u64)draws.gpass_pso_ids[item_id] << SortKey::pso_shift) |
+					((u64)(id::index(draws.material_ids[item_id]) & ((1 << SortKey::material_bits) - 1)) << SortKey::material_shift) |
+					depth_bucket(view_depth, far_z, material_type)
+				};
+
+				cache.draw_order[i] = { key, i };
+				texture_count += draws.texture_counts[item_id];
+			}
+
+			u32* srv_indices{ nullptr };
+			D3D12_GPU_VIRTUAL_ADDRESS srv_indices_address{ 0 };
+
+			if (texture_count) {
+				ConstantBuffer& cbuffer{ core::c_buffer() };
+				srv_indices = (u32*)cbuffer.allocate(texture_count * sizeof(u32));
+				assert(srv_indices);
+				srv_indices_address = cbuffer.gpu_address(srv_indices);
+			}
+
+			for (u32 i{ first }; i < last; ++i) {
+				const id::id_type item_id{ cache.d3d12_render_item_ids[i] };
+				const u32 item_texture_count{ draws.texture_counts[item_id] };
+				cache.srv_indices[i] = 0;
+
+				if (item_texture_count) {
+					memcpy(srv_indices, draws.descriptor_indices[item_id], item_texture_count * sizeof(u32));
+					cache.srv_indices[i] = srv_indices_address;
+					srv_indices += item_texture_count;
+					srv_indices_address += item_texture_count * sizeof(u32);
+				}
+			}
+		}
+
+		// Stable LSD radix sort. Every job counts and scatters its own range of items, digits that are the
+		// same for all keys (e.g. unused material types) are skipped.
+		void sort_draw_order() {
+			GPassCache& cache{ frame_cache };
+			const u32 items_count{ (u32)cache.draw_order.size() };
+			if (items_count < 2) return;
+
+			cache.sort_scratch.resize(items_count);
+			const u32 job_count{ get_job_count(items_count, min_items_per_sort_job) };
+			const u32 items_per_job{ (items_count + job_count - 1) / job_count };
+			u32* const histograms{ (u32* const)alloca(job_count * radix_size * sizeof(u32)) };
+
+			SortItem* src{ cache.draw_order.data() };
+			SortItem* dst{ cache.sort_scratch.data() };
+
+			for (u32 shift{ 0 }; shift < 64; shift += radix_bits) {
+				util::thread_pool::parallel_for(job_count, [&](u32 job) {
+					u32* const histogram{ &histograms[job * radix_size] };
+					memset(histogram, 0, radix_size * sizeof(u32));
+					const u32 last{ std::min(items_count, (job + 1) * items_per_job) };
+					for (u32 i{ job * items_per_job }; i < last; ++i) ++histogram[(src[i].key >> shift) & (radix_size - 1)];
+				});
+
+				bool single_digit{ false };
+				u32 offset{ 0 };
+				for (u32 digit{ 0 }; digit < radix_size; ++digit) {
+					const u32 digit_start{ offset };
+					for (u32 job{ 0 }; job < job_count; ++job) {
+						u32& count{ histograms[job * radix_size + digit] };
+						const u32 digit_count{ count };
+						count = offset;
+						offset += digit_count;
+					}
+					if (offset - digit_start == items_count) single_digit = true;
 				}
-				assert(current_data_pointer);
-				cache.per_object_data[i] = cbuffer.gpu_address(current_data_pointer);
+
+				if (single_digit) continue;
+
+				util::thread_pool::parallel_for(job_count, [&](u32 job) {
+					u32* const offsets{ &histograms[job * radix_size] };
+					const u32 last{ std::min(items_count, (job + 1) * items_per_job) };
+					for (u32 i{ job * items_per_job }; i < last; ++i) dst[offsets[(src[i].key >> shift) & (radix_size - 1)]++] = src[i];
+				});
+
+				std::swap(src, dst);
 			}
+
+			if (src != cache.draw_order.data()) memcpy(cache.draw_order.data(), src, items_count * sizeof(SortItem));
 		}
 
-		void set_root_parameters(id3d12_graphics_command_list* cmd_list, u32 cache_index) {
+		void set_root_parameters(id3d12_graphics_command_list* cmd_list, u32 draw, u32 frame_index) {
 			const GPassCache& cache{ frame_cache };
-			assert(cache_index < cache.size());
+			const DrawCache& draws{ draw_cache };
+			assert(draw < cache.draw_count());
 
-			const MaterialType::Type material_type{ cache.material_types[cache_index] };
+			const u32 cache_index{ cache.draw_order[draw].index };
+			const id::id_type item_id{ cache.d3d12_render_item_ids[cache_index] };
+			const MaterialType::Type material_type{ draws.material_types[item_id] };
 
 			switch (material_type) {
 				case MaterialType::OPAQUE: {
 					using params = OpaqueRootParameter;
-					cmd_list->SetGraphicsRootShaderResourceView(params::POSITION_BUFFER, cache.position_buffers[cache_index]);
-					cmd_list->SetGraphicsRootShaderResourceView(params::ELEMENT_BUFFER, cache.element_buffers[cache_index]);
-					cmd_list->SetGraphicsRootConstantBufferView(params::PER_OBJECT_DATA, cache.per_object_data[cache_index]);
+					cmd_list->SetGraphicsRootShaderResourceView(params::POSITION_BUFFER, draws.position_buffers[item_id]);
+					cmd_list->SetGraphicsRootShaderResourceView(params::ELEMENT_BUFFER, draws.element_buffers[item_id]);
+					cmd_list->SetGraphicsRootShaderResourceView(params::INSTANCES, instance_buffers[frame_index].buffer.gpu_address() + cache.instances[draw].first * sizeof(id::id_type));
 
-					if (cache.texture_counts[cache_index]) {
+					if (draws.texture_counts[item_id]) {
 						cmd_list->SetGraphicsRootShaderResourceView(params::SRV_INDICIES, cache.srv_indices[cache_index]);
 					}
 				}
@@ -243,45 +588,283 @@ namespace lightning::graphics::direct3d12::gpass {
 			}
 		}
 
+		// Draws with the same state in a pass can be batched into one ExecuteIndirect.
+		[[nodiscard]] constexpr u64 draw_state(id::id_type root_signature_id, id::id_type pso_id, D3D_PRIMITIVE_TOPOLOGY topology) {
+			assert(root_signature_id < (1 << 24) && topology < (1 << 8));
+			return ((u64)root_signature_id << 40) | ((u64)pso_id << 8) | (u64)topology;
+		}
+
+		// Grows the buffer by half again of what's needed, so it isn't recreated every time a few more items are visible.
+		void reserve(FrameUploadBuffer& frame_buffer, u32 size, [[maybe_unused]] const wchar_t* const name, [[maybe_unused]] u32 frame_index) {
+			if (frame_buffer.size >= size) return;
+
+			const u32 buffer_size{ (size * 3) >> 1 };
+			frame_buffer.buffer = D3D12Buffer{ ConstantBuffer::get_default_init_info(buffer_size), true };
+			NAME_D3D12_OBJECT_INDEXED(frame_buffer.buffer.buffer(), frame_index, name);
+
+			D3D12_RANGE range{};
+			DXCall(frame_buffer.buffer.buffer()->Map(0, &range, (void**)(&frame_buffer.cpu_address)));
+			assert(frame_buffer.cpu_address);
+			frame_buffer.size = buffer_size;
+		}
+
+		// Merges the sorted items that share submesh, material and pipeline state into instanced draws. Such items
+		// have the same sort key above the depth bits. A draw takes the place of its nearest item.
+		void build_instances() {
+			GPassCache& cache{ frame_cache };
+			const DrawCache& draws{ draw_cache };
+			const u32 items_count{ (u32)cache.draw_order.size() };
+
+			cache.instance_items.resize(items_count);
+
+			for (u32 n{ 0 }; n < items_count; ++n) {
+				const SortItem item{ cache.draw_order[n] };
+				const id::id_type item_id{ cache.d3d12_render_item_ids[item.index] };
+
+				cache.instance_items[n] = {
+					item.key >> SortKey::material_shift,
+					draws.submesh_gpu_ids[item_id],
+					draws.material_ids[item_id],
+					item_id,
+					draws.material_types[item_id] == MaterialType::TRANSPARENT
+				};
+			}
+
+			indirect::build_instances(cache.instance_items.data(), items_count, instance_state, cache.draw_items, cache.instances, cache.instance_rows);
+
+			// Draws are compacted to the front of draw_order, the first item of a draw is never before the draw.
+			const u32 draw_count{ (u32)cache.draw_items.size() };
+			for (u32 draw{ 0 }; draw < draw_count; ++draw) {
+				cache.draw_order[draw] = cache.draw_order[cache.draw_items[draw]];
+			}
+
+			cache.draw_order.resize(draw_count);
+		}
+
+		// Writes the instances, indirect arguments and draw states of the sorted draws, then splits every pass into
+		// batches. The arguments are the same for both passes, only the pipeline states differ.
+		void prepare_indirect_draws(const D3D12FrameInfo& info) {
+			GPassCache& cache{ frame_cache };
+			const DrawCache& draws{ draw_cache };
+			const u32 frame_index{ info.frame_index };
+			const u32 draw_count{ cache.draw_count() };
+			FrameUploadBuffer& arguments{ argument_buffers[frame_index] };
+			FrameUploadBuffer& instances{ instance_buffers[frame_index] };
+
+			const u32 instance_rows_size{ (u32)(cache.instance_rows.size() * sizeof(id::id_type)) };
+			reserve(instances, instance_rows_size, L"GPass Instance Buffer", frame_index);
+			reserve(arguments, draw_count * (u32)sizeof(indirect::DrawArguments), L"GPass Indirect Argument Buffer", frame_index);
+			memcpy(instances.cpu_address, cache.instance_rows.data(), instance_rows_size);
+
+			indirect::DrawArguments* const draw_arguments{ (indirect::DrawArguments*)arguments.cpu_address };
+			const D3D12_GPU_VIRTUAL_ADDRESS instances_address{ instances.buffer.gpu_address() };
+
+			for (u32 pass{ 0 }; pass < Pass::count; ++pass) cache.draw_states[pass].resize(draw_count);
+
+			const u32 job_count{ get_job_count(draw_count, min_items_per_prepare_job) };
+			const u32 draws_per_job{ (draw_count + job_count - 1) / job_count };
+
+			util::thread_pool::parallel_for(job_count, [&](u32 job) {
+				const u32 last{ std::min(draw_count, (job + 1) * draws_per_job) };
+				for (u32 n{ job * draws_per_job }; n < last; ++n) {
+					const u32 i{ cache.draw_order[n].index };
+					const id::id_type item_id{ cache.d3d12_render_item_ids[i] };
+					const id::id_type root_signature_id{ draws.root_signature_ids[item_id] };
+					const D3D_PRIMITIVE_TOPOLOGY topology{ draws.primitive_topologies[item_id] };
+					const indirect::InstanceRange& draw_instances{ cache.instances[n] };
+
+					draw_arguments[n] = indirect::get_draw_arguments(instances_address + draw_instances.first * sizeof(id::id_type), draw_instances.count,
+						draws.position_buffers[item_id], draws.element_buffers[item_id], cache.srv_indices[i], draws.index_buffer_views[item_id]);
+					cache.draw_states[Pass::DEPTH_PREPASS][n] = draw_state(root_signature_id, draws.depth_pso_ids[item_id], topology);
+					cache.draw_states[Pass::GPASS][n] = draw_state(root_signature_id, draws.gpass_pso_ids[item_id], topology);
+				}
+			});
+
+			for (u32 pass{ 0 }; pass < Pass::count; ++pass) {
+				indirect::build_batches(cache.draw_states[pass].data(), draw_count, cache.batches[pass]);
+
+				for (const indirect::Batch& batch : cache.batches[pass]) {
+					if (batch.count < min_draws_per_indirect_batch) continue;
+
+					const id::id_type item_id{ cache.d3d12_render_item_ids[cache.draw_order[batch.first].index] };
+					ID3D12RootSignature* const root_signature{ draws.root_signatures[item_id] };
+					ID3D12CommandSignature*& signature{ command_signatures[root_signature] };
+					if (!signature) signature = indirect::create_command_signature(root_signature);
+				}
+
+				// Reads the upload buffer back, only in debug builds.
+				assert(indirect::validate(draw_arguments, cache.draw_states[pass].data(), draw_count, cache.batches[pass].data(), (u32)cache.batches[pass].size()));
+			}
+		}
+
 		void prepare_render_frame(const D3D12FrameInfo& info) {
 			assert(info.info && info.camera);
 			assert(info.info->render_item_ids && info.info->render_item_count);
 
 			GPassCache& cache{ frame_cache };
+			DrawCache& draws{ draw_cache };
 			cache.clear();
+			frame_stats = {};
+
+			content::render_item::get_d3d12_render_items_id(info, cache.d3d12_render_item_ids);
+
+			// After getting the ids, so every visible item has been reported as added. The object data is updated
+			// even when nothing is visible, transform changes are only reported for one frame.
+			draws.update();
+			object_data.update(draws, info.frame_index);
+
+			if (cache.d3d12_render_item_ids.empty()) return;
 
-			using namespace content;
-			render_item::get_d3d12_render_items_id(*info.info, cache.d3d12_render_item_ids);
 			cache.resize();
 			const u32 items_count{ cache.size() };
-			const render_item::ItemsCache items_cache{ cache.items_cache() };
-			render_item::get_items(cache.d3d12_render_item_ids.data(), items_count, items_cache);
+			const u32 job_count{ get_job_count(items_count, min_items_per_prepare_job) };
+			const u32 items_per_job{ (items_count + job_count - 1) / job_count };
 
-			const submesh::ViewsCache views_cache{ cache.views_cache() };
-			submesh::get_views(items_cache.submesh_gpu_ids, items_count, views_cache);
+			util::thread_pool::parallel_for(job_count, [&](u32 job) {
+				const u32 first{ job * items_per_job };
+				prepare_items(info, first, std::min(items_count, first + items_per_job));
+			});
 
-			const material::MaterialsCache materials_cache{ cache.materials_cache() };
-			material::get_materials(items_cache.material_ids, items_count, materials_cache, cache.descriptor_index_count);
+			sort_draw_order();
+			build_instances();
+			prepare_indirect_draws(info);
+		}
 
-			fill_per_object_data(info, materials_cache);
+		void bind_render_targets(id3d12_graphics_command_list* cmd_list, Pass::Type pass) {
+			const D3D12_CPU_DESCRIPTOR_HANDLE dsv{ gpass_depth_buffer.dsv() };
 
-			if (cache.descriptor_index_count) {
-				ConstantBuffer& cbuffer{ core::c_buffer() };
-				const u32 size{ cache.descriptor_index_count * sizeof(u32) };
-				u32* const srv_indices{ (u32* const)cbuffer.allocate(size) };
-				u32 srv_index_offset{ 0 };
-
-				for (u32 i{ 0 }; i < items_count; ++i) {
-					const u32 texture_count{ cache.texture_counts[i] };
-					cache.srv_indices[i] = 0;
-
-					if (texture_count) {
-						const u32* const descriptor_indicies{ cache.descriptor_indices[i] };
-						memcpy(&srv_indices[srv_index_offset], descriptor_indicies, texture_count * sizeof(u32));
-						cache.srv_indices[i] = cbuffer.gpu_address(srv_indices + srv_index_offset);
-						srv_index_offset += texture_count;
+			if (pass == Pass::DEPTH_PREPASS) {
+				cmd_list->OMSetRenderTargets(0, nullptr, 0, &dsv);
+			}
+			else {
+				const D3D12_CPU_DESCRIPTOR_HANDLE rtv{ gpass_main_buffer.rtv(0) };
+				cmd_list->OMSetRenderTargets(1, &rtv, 0, &dsv);
+			}
+		}
+
+		// Records a range of the sorted draws. Nothing is inherited from the previous range, so it can go into its own command list.
+		// Batches that are cut by the range are clipped to it.
+		void record_draws(id3d12_graphics_command_list* cmd_list, const D3D12FrameInfo& info, Pass::Type pass, recording::Range range, FrameStats& stats) {
+			const GPassCache& cache{ frame_cache };
+			const DrawCache& draws{ draw_cache };
+			const u32 frame_index{ info.frame_index };
+			const id::id_type light_culling_id{ info.light_culling_id };
+			ID3D12PipelineState* const* const pipeline_states{ pass == Pass::DEPTH_PREPASS ? draws.depth_pipeline_states.data() : draws.gpass_pipeline_states.data() };
+			ID3D12Resource* const argument_buffer{ argument_buffers[frame_index].buffer.buffer() };
+			const util::vector<indirect::Batch>& batches{ cache.batches[pass] };
+			assert(range.first + range.count <= cache.draw_count());
+			if (!range.count) return;
+
+			// The last batch that starts at or before the first draw of the range.
+			const indirect::Batch* batch{ std::upper_bound(batches.data(), batches.data() + batches.size(), range.first, [](u32 n, const indirect::Batch& b) { return n < b.first; }) - 1 };
+			ID3D12RootSignature* current_root_signature{ nullptr };
+			ID3D12PipelineState* current_pipeline_state{ nullptr };
+			const u32 last{ range.first + range.count };
+
+			for (u32 n{ range.first }; n < last; ) {
+				while (batch->first + batch->count <= n) ++batch;
+				const u32 batch_last{ std::min(last, batch->first + batch->count) };
+				const id::id_type item_id{ cache.d3d12_render_item_ids[cache.draw_order[n].index] };
+
+				if (current_root_signature != draws.root_signatures[item_id]) {
+					++stats.root_signature_changes;
+
+					using idx = OpaqueRootParameter;
+					current_root_signature = draws.root_signatures[item_id];
+					cmd_list->SetGraphicsRootSignature(current_root_signature);
+					cmd_list->SetGraphicsRootConstantBufferView(idx::GLOBAL_SHADER_DATA, info.global_shader_data);
+					cmd_list->SetGraphicsRootShaderResourceView(idx::PER_OBJECT_DATA, object_data.gpu_address(frame_index));
+
+					if (pass == Pass::GPASS) {
+						cmd_list->SetGraphicsRootShaderResourceView(idx::DIRECTIONAL_LIGHTS, light::non_cullable_light_buffer(frame_index));
+						cmd_list->SetGraphicsRootShaderResourceView(idx::CULLABLE_LIGHTS, light::cullable_light_buffer(frame_index));
+						cmd_list->SetGraphicsRootShaderResourceView(idx::LIGHT_GRID, delight::light_grid_opaque(light_culling_id, frame_index));
+						cmd_list->SetGraphicsRootShaderResourceView(idx::LIGHT_INDEX_LIST, delight::light_index_list_opaque(light_culling_id ,frame_index));
 					}
 				}
+
+				if (current_pipeline_state != pipeline_states[item_id]) {
+					current_pipeline_state = pipeline_states[item_id];
+					++stats.pipeline_state_changes;
+					cmd_list->SetPipelineState(current_pipeline_state);
+				}
+
+				// Every draw of a batch has the same topology.
+				cmd_list->IASetPrimitiveTopology(draws.primitive_topologies[item_id]);
+				const u32 draw_count{ batch_last - n };
+
+				if (draw_count >= min_draws_per_indirect_batch) {
+					const auto pair = command_signatures.find(draws.root_signatures[item_id]);
+					assert(pair != command_signatures.end() && pair->second);
+					ID3D12CommandSignature* const signature{ pair->second };
+					cmd_list->ExecuteIndirect(signature, draw_count, argument_buffer, (u64)n * sizeof(indirect::DrawArguments), nullptr, 0);
+					++stats.execute_indirect_count;
+					stats.draw_count += draw_count;
+					// The instances of consecutive draws are next to each other.
+					stats.instance_count += cache.instances[batch_last - 1].first + cache.instances[batch_last - 1].count - cache.instances[n].first;
+					n = batch_last;
+					continue;
+				}
+
+				for (; n < batch_last; ++n) {
+					const D3D12_INDEX_BUFFER_VIEW& ibv{ draws.index_buffer_views[cache.d3d12_render_item_ids[cache.draw_order[n].index]] };
+					const u32 instance_count{ cache.instances[n].count };
+					set_root_parameters(cmd_list, n, frame_index);
+					cmd_list->IASetIndexBuffer(&ibv);
+					cmd_list->DrawIndexedInstanced(indirect::index_count(ibv), instance_count, 0, 0, 0);
+					++stats.draw_count;
+					stats.instance_count += instance_count;
+				}
+			}
+		}
+
+		struct RecordingContext {
+			const D3D12FrameInfo* info;
+			id3d12_graphics_command_list* const* cmd_lists;
+			FrameStats* stats;
+			Pass::Type pass;
+		};
+
+		void* begin_recording_list(void* context, u32 list_index) {
+			const RecordingContext& c{ *(const RecordingContext*)context };
+			id3d12_graphics_command_list* const cmd_list{ c.cmd_lists[list_index] };
+			bind_render_targets(cmd_list, c.pass);
+			c.stats[list_index] = {};
+			return cmd_list;
+		}
+
+		void record_list(void* context, void* list, u32 list_index, recording::Range range) {
+			const RecordingContext& c{ *(const RecordingContext*)context };
+			record_draws((id3d12_graphics_command_list*)list, *c.info, c.pass, range, c.stats[list_index]);
+		}
+
+		void end_recording_list(void*, void* list) {
+			DXCall(((id3d12_graphics_command_list*)list)->Close());
+		}
+
+		// Big passes are recorded into several command lists in parallel, they're executed in draw order after
+		// what cmd_list has recorded so far.
+		void record_pass(id3d12_graphics_command_list* cmd_list, const D3D12FrameInfo& info, Pass::Type pass) {
+			const u32 draw_count{ frame_cache.draw_count() };
+			recording::partition(draw_count, util::thread_pool::worker_count() + 1, min_draws_per_recording_list, recording_ranges);
+			const u32 list_count{ (u32)recording_ranges.size() };
+
+			if (list_count < 2) {
+				record_draws(cmd_list, info, pass, { 0, draw_count }, frame_stats);
+				return;
+			}
+
+			recording_stats.resize(list_count);
+			RecordingContext context{ &info, core::begin_parallel_recording(list_count), recording_stats.data(), pass };
+			const recording::Backend backend{ begin_recording_list, record_list, end_recording_list, &context };
+			recording::record(backend, recording_ranges.data(), list_count);
+
+			for (const FrameStats& stats : recording_stats) {
+				frame_stats.draw_count += stats.draw_count;
+				frame_stats.instance_count += stats.instance_count;
+				frame_stats.root_signature_changes += stats.root_signature_changes;
+				frame_stats.pipeline_state_changes += stats.pipeline_state_changes;
+				frame_stats.execute_indirect_count += stats.execute_indirect_count;
 			}
 		}
 	}
@@ -295,10 +878,29 @@ namespace lightning::graphics::direct3d12::gpass {
 		gpass_depth_buffer.release();
 
 		dimensions = initial_dimensions;
+		draw_cache.clear();
+		object_data.release();
+
+		for (u32 i{ 0 }; i < FRAME_BUFFER_COUNT; ++i) {
+			for (FrameUploadBuffer* frame_buffer : { &argument_buffers[i], &instance_buffers[i] }) {
+				frame_buffer->buffer.release();
+				frame_buffer->cpu_address = nullptr;
+				frame_buffer->size = 0;
+			}
+		}
+
+		for (auto& pair : command_signatures) {
+			core::release(pair.second);
+		}
+
+		command_signatures.clear();
+		instance_state.submesh_draws.clear();
+		instance_state.item_draws.clear();
 	}
 
 	const D3D12RenderTexture& main_buffer() { return gpass_main_buffer; }
 	const D3D12DepthBuffer& depth_buffer() { return gpass_depth_buffer; }
+	FrameStats get_frame_stats() { return frame_stats; }
 
 	void set_size(math::u32v2 size) {
 		math::u32v2& d{ dimensions };
@@ -310,72 +912,11 @@ namespace lightning::graphics::direct3d12::gpass {
 
 	void depth_prepass(id3d12_graphics_command_list* cmd_list, const D3D12FrameInfo& info) {
 		prepare_render_frame(info);
-
-		const GPassCache& cache{ frame_cache };
-		const u32 items_count{ cache.size() };
-
-		ID3D12RootSignature* current_root_signature{ nullptr };
-		ID3D12PipelineState* current_pipeline_state{ nullptr };
-
-		for (u32 i{ 0 }; i < items_count; ++i) {
-			if (current_root_signature != cache.root_signatures[i]) {
-				current_root_signature = cache.root_signatures[i];
-				cmd_list->SetGraphicsRootSignature(current_root_signature);
-				cmd_list->SetGraphicsRootConstantBufferView(OpaqueRootParameter::GLOBAL_SHADER_DATA, info.global_shader_data);
-			}
-
-			if (current_pipeline_state != cache.depth_pipeline_states[i]) {
-				current_pipeline_state = cache.depth_pipeline_states[i];
-				cmd_list->SetPipelineState(current_pipeline_state);
-			}
-
-			set_root_parameters(cmd_list, i);
-
-			const D3D12_INDEX_BUFFER_VIEW& ibv{ cache.index_buffer_views[i] };
-			const u32 index_count{ ibv.SizeInBytes >> (ibv.Format == DXGI_FORMAT_R16_UINT ? 1 : 2) };
-
-			cmd_list->IASetIndexBuffer(&ibv);
-			cmd_list->IASetPrimitiveTopology(cache.primitive_topologies[i]);
-			cmd_list->DrawIndexedInstanced(index_count, 1, 0, 0, 0);
-		}
+		record_pass(cmd_list, info, Pass::DEPTH_PREPASS);
 	}
 
 	void render(id3d12_graphics_command_list* cmd_list, const D3D12FrameInfo& info) {
-		const GPassCache& cache{ frame_cache };
-		const u32 items_count{ cache.size() };
-		const u32 frame_index{ info.frame_index };
-		const id::id_type light_culling_id{ info.light_culling_id };
-
-		ID3D12RootSignature* current_root_signature{ nullptr };
-		ID3D12PipelineState* current_pipeline_state{ nullptr };
-
-		for (u32 i{ 0 }; i < items_count; ++i) {
-			if (current_root_signature != cache.root_signatures[i]) {
-
-				using idx = OpaqueRootParameter;
-				current_root_signature = cache.root_signatures[i];
-				cmd_list->SetGraphicsRootSignature(current_root_signature);
-				cmd_list->SetGraphicsRootConstantBufferView(idx::GLOBAL_SHADER_DATA, info.global_shader_data);
-				cmd_list->SetGraphicsRootShaderResourceView(idx::DIRECTIONAL_LIGHTS, light::non_cullable_light_buffer(frame_index));
-				cmd_list->SetGraphicsRootShaderResourceView(idx::CULLABLE_LIGHTS, light::cullable_light_buffer(frame_index));
-				cmd_list->SetGraphicsRootShaderResourceView(idx::LIGHT_GRID, delight::light_grid_opaque(light_culling_id, frame_index));
-				cmd_list->SetGraphicsRootShaderResourceView(idx::LIGHT_INDEX_LIST, delight::light_index_list_opaque(light_culling_id ,frame_index));
-			}
-
-			if (current_pipeline_state != cache.gpass_pipeline_states[i]) {
-				current_pipeline_state = cache.gpass_pipeline_states[i];
-				cmd_list->SetPipelineState(current_pipeline_state);
-			}
-
-			set_root_parameters(cmd_list, i);
-
-			const D3D12_INDEX_BUFFER_VIEW& ibv{ cache.index_buffer_views[i] };
-			const u32 index_count{ ibv.SizeInBytes >> (ibv.Format == DXGI_FORMAT_R16_UINT ? 1 : 2) };
-
-			cmd_list->IASetIndexBuffer(&ibv);
-			cmd_list->IASetPrimitiveTopology(cache.primitive_topologies[i]);
-			cmd_list->DrawIndexedInstanced(index_count, 1, 0, 0, 0);
-		}
+		record_pass(cmd_list, info, Pass::GPASS);
 	}
 
 	void add_transitions_for_depth_prepass(d3dx::D3D12ResourceBarrier& barriers) {
@@ -395,14 +936,11 @@ namespace lightning::graphics::direct3d12::gpass {
 	void set_render_targets_for_depth_prepass(id3d12_graphics_command_list* cmd_list) {
 		const D3D12_CPU_DESCRIPTOR_HANDLE dsv{ gpass_depth_buffer.dsv() };
 		cmd_list->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 0.f, 0, 0, nullptr);
-		cmd_list->OMSetRenderTargets(0, nullptr, 0, &dsv);
+		bind_render_targets(cmd_list, Pass::DEPTH_PREPASS);
 	}
 
 	void set_render_targets_for_gpass(id3d12_graphics_command_list* cmd_list) {
-		const D3D12_CPU_DESCRIPTOR_HANDLE rtv{ gpass_main_buffer.rtv(0) };
-		const D3D12_CPU_DESCRIPTOR_HANDLE dsv{ gpass_depth_buffer.dsv() };
-
-		cmd_list->ClearRenderTargetView(rtv, clear_value, 0, nullptr);
-		cmd_list->OMSetRenderTargets(1, &rtv, 0, &dsv);
+		cmd_list->ClearRenderTargetView(gpass_main_buffer.rtv(0), clear_value, 0, nullptr);
+		bind_render_targets(cmd_list, Pass::GPASS);
 	}
 }
\ No newline at end of file
@@ -14,7 +14,8 @@ namespace lightning::graphics::direct3d12::gpass {
 	struct OpaqueRootParameter {
 		enum parameter : u32 {
 			GLOBAL_SHADER_DATA,
-			PER_OBJECT_DATA,
+			PER_OBJECT_DATA,		// object data of every render item
+			INSTANCES,				// per_object_data indices of the instances of a draw
 			POSITION_BUFFER,
 			ELEMENT_BUFFER,
 			SRV_INDICIES,
@@ -27,11 +28,21 @@ namespace lightning::graphics::direct3d12::gpass {
 		};
 	};
 
+	// Counted over the depth prepass and the gpass of the last rendered frame.
+	struct FrameStats {
+		u32 draw_count;
+		u32 instance_count;
+		u32 root_signature_changes;
+		u32 pipeline_state_changes;
+		u32 execute_indirect_count;
+	};
+
 	bool initialize();
 	void shutdown();
 
 	[[nodiscard]] const D3D12RenderTexture& main_buffer();
 	[[nodiscard]] const D3D12DepthBuffer& depth_buffer();
+	[[nodiscard]] FrameStats get_frame_stats();
 
 	void set_size(math::u32v2 size);
 	void depth_prepass(id3d12_graphics_command_list* cmd_list, const D3D12FrameInfo& info);
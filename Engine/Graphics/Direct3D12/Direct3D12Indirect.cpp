@@ -0,0 +1,171 @@
+#include "Direct3D12Indirect.h"
+#include "Direct3D12Core.h"
+#include "Direct3D12GPass.h"
+
+namespace lightning::graphics::direct3d12::indirect {
+	namespace {
+
+		// The arguments are read back to back, without any padding between them.
+		static_assert(offsetof(DrawArguments, index_buffer_view) == 4 * sizeof(D3D12_GPU_VIRTUAL_ADDRESS));
+		static_assert(offsetof(DrawArguments, draw) == offsetof(DrawArguments, index_buffer_view) + sizeof(D3D12_INDEX_BUFFER_VIEW));
+
+		[[nodiscard]] bool is_valid_srv(D3D12_GPU_VIRTUAL_ADDRESS address) {
+			return address && !(address & (sizeof(u32) - 1));
+		}
+
+		[[nodiscard]] bool is_valid_draw(const DrawArguments& arguments) {
+			const D3D12_INDEX_BUFFER_VIEW& ibv{ arguments.index_buffer_view };
+			const D3D12_DRAW_INDEXED_ARGUMENTS& draw{ arguments.draw };
+
+			return
+				is_valid_srv(arguments.instances) &&
+				is_valid_srv(arguments.position_buffer) &&
+				is_valid_srv(arguments.element_buffer) &&
+				is_valid_srv(arguments.srv_indices) &&
+				ibv.BufferLocation && ibv.SizeInBytes &&
+				(ibv.Format == DXGI_FORMAT_R16_UINT || ibv.Format == DXGI_FORMAT_R32_UINT) &&
+				draw.IndexCountPerInstance && draw.InstanceCount &&
+				draw.StartIndexLocation + draw.IndexCountPerInstance <= index_count(ibv);
+		}
+	}
+
+	DrawArguments get_draw_arguments(D3D12_GPU_VIRTUAL_ADDRESS instances, u32 instance_count, D3D12_GPU_VIRTUAL_ADDRESS position_buffer,
+		D3D12_GPU_VIRTUAL_ADDRESS element_buffer, D3D12_GPU_VIRTUAL_ADDRESS srv_indices, const D3D12_INDEX_BUFFER_VIEW& ibv) {
+
+		DrawArguments arguments{};
+		arguments.instances = instances;
+		arguments.position_buffer = position_buffer;
+		// Every root descriptor of the signature gets an address. Position only submeshes have no element buffer and
+		// shaders of materials without textures never read the srv indices, so any valid address will do.
+		arguments.element_buffer = element_buffer ? element_buffer : position_buffer;
+		arguments.srv_indices = srv_indices ? srv_indices : position_buffer;
+		arguments.index_buffer_view = ibv;
+		arguments.draw.IndexCountPerInstance = index_count(ibv);
+		arguments.draw.InstanceCount = instance_count;
+		return arguments;
+	}
+
+	void build_batches(const u64* const states, u32 draw_count, util::vector<Batch>& batches) {
+		assert(states || !draw_count);
+		batches.clear();
+		if (!draw_count) return;
+
+		u32 first{ 0 };
+		for (u32 i{ 1 }; i < draw_count; ++i) {
+			if (states[i] != states[first]) {
+				batches.emplace_back(Batch{ first, i - first });
+				first = i;
+			}
+		}
+
+		batches.emplace_back(Batch{ first, draw_count - first });
+	}
+
+	void build_instances(const InstanceItem* const items, u32 item_count, InstanceState& state, util::vector<u32>& draw_items,
+		util::vector<InstanceRange>& instances, util::vector<id::id_type>& instance_rows) {
+
+		assert(items || !item_count);
+		draw_items.clear();
+		instances.clear();
+		state.item_draws.resize(item_count);
+		u64 run_key{ ~0ull };
+
+		for (u32 n{ 0 }; n < item_count; ++n) {
+			const InstanceItem& item{ items[n] };
+
+			// A new run makes every older submesh entry stale, so the table never has to be cleared.
+			if (!n || item.run_key != run_key) {
+				run_key = item.run_key;
+				++state.current_run;
+			}
+
+			InstanceState::SubmeshDraw* submesh_draw{ nullptr };
+			u32 draw{ u32_invalid_id };
+
+			if (!item.is_transparent) {
+				if (item.submesh_id >= state.submesh_draws.size()) state.submesh_draws.resize(item.submesh_id + 1, InstanceState::SubmeshDraw{ 0, 0 });
+				submesh_draw = &state.submesh_draws[item.submesh_id];
+
+				if (submesh_draw->run == state.current_run && items[draw_items[submesh_draw->draw]].material_id == item.material_id) {
+					draw = submesh_draw->draw;
+				}
+			}
+
+			if (draw == u32_invalid_id) {
+				draw = (u32)draw_items.size();
+				draw_items.emplace_back(n);
+				instances.emplace_back(InstanceRange{ 0, 0 });
+				if (submesh_draw) *submesh_draw = { state.current_run, draw };
+			}
+
+			++instances[draw].count;
+			state.item_draws[n] = draw;
+		}
+
+		u32 first{ 0 };
+		for (InstanceRange& range : instances) {
+			range.first = first;
+			first += range.count;
+			range.count = 0;
+		}
+
+		// Instances keep the order of the items, front to back for opaque items.
+		instance_rows.resize(item_count);
+		for (u32 n{ 0 }; n < item_count; ++n) {
+			InstanceRange& range{ instances[state.item_draws[n]] };
+			instance_rows[range.first + range.count] = items[n].row;
+			++range.count;
+		}
+	}
+
+	bool validate(const DrawArguments* const arguments, const u64* const states, u32 draw_count, const Batch* const batches, u32 batch_count) {
+		if (!draw_count) return !batch_count;
+		if (!arguments || !states || !batches || !batch_count) return false;
+
+		u32 next_draw{ 0 };
+		for (u32 b{ 0 }; b < batch_count; ++b) {
+			const Batch& batch{ batches[b] };
+			if (batch.first != next_draw || !batch.count || batch.count > draw_count - batch.first) return false;
+			// Batches are as long as possible, otherwise there's an ExecuteIndirect more than needed.
+			if (b && states[batch.first] == states[batch.first - 1]) return false;
+
+			for (u32 i{ batch.first }; i < batch.first + batch.count; ++i) {
+				if (states[i] != states[batch.first] || !is_valid_draw(arguments[i])) return false;
+			}
+
+			next_draw += batch.count;
+		}
+
+		return next_draw == draw_count;
+	}
+
+	ID3D12CommandSignature* create_command_signature(ID3D12RootSignature* root_signature) {
+		assert(root_signature);
+		using params = gpass::OpaqueRootParameter;
+
+		D3D12_INDIRECT_ARGUMENT_DESC arguments[6]{};
+		arguments[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+		arguments[0].ShaderResourceView.RootParameterIndex = params::INSTANCES;
+		arguments[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+		arguments[1].ShaderResourceView.RootParameterIndex = params::POSITION_BUFFER;
+		arguments[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+		arguments[2].ShaderResourceView.RootParameterIndex = params::ELEMENT_BUFFER;
+		arguments[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+		arguments[3].ShaderResourceView.RootParameterIndex = params::SRV_INDICIES;
+		arguments[4].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+		arguments[5].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+		D3D12_COMMAND_SIGNATURE_DESC desc{};
+		desc.ByteStride = sizeof(DrawArguments);
+		desc.NumArgumentDescs = _countof(arguments);
+		desc.pArgumentDescs = &arguments[0];
+		desc.NodeMask = 0;
+
+		ID3D12CommandSignature* signature{ nullptr };
+		DXCall(core::device()->CreateCommandSignature(&desc, root_signature, IID_PPV_ARGS(&signature)));
+		assert(signature);
+		NAME_D3D12_OBJECT(signature, L"GPass Command Signature");
+
+		return signature;
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "Direct3D12CommonHeaders.h"
+
+namespace lightning::graphics::direct3d12::indirect {
+
+	// Arguments of one opaque draw, in the order of the command signature's arguments.
+	struct DrawArguments {
+		D3D12_GPU_VIRTUAL_ADDRESS instances;
+		D3D12_GPU_VIRTUAL_ADDRESS position_buffer;
+		D3D12_GPU_VIRTUAL_ADDRESS element_buffer;
+		D3D12_GPU_VIRTUAL_ADDRESS srv_indices;
+		D3D12_INDEX_BUFFER_VIEW index_buffer_view;
+		D3D12_DRAW_INDEXED_ARGUMENTS draw;
+	};
+
+	// Consecutive draws with the same state (root signature, pipeline state and primitive topology),
+	// executed with one ExecuteIndirect.
+	struct Batch {
+		u32 first;
+		u32 count;
+	};
+
+	// A sorted item that can be merged with others into an instanced draw.
+	struct InstanceItem {
+		u64 run_key;				// sort key without the depth bits, only items with equal keys are merged
+		id::id_type submesh_id;
+		id::id_type material_id;	// the full id, the sort key only has its low bits
+		id::id_type row;			// object data row of the item
+		bool is_transparent;		// transparent items are drawn back to front, they're never merged
+	};
+
+	// Instances of a draw in the instance rows.
+	struct InstanceRange {
+		u32 first;
+		u32 count;
+	};
+
+	// Kept between frames, so the per submesh table doesn't have to be cleared every frame.
+	struct InstanceState {
+		struct SubmeshDraw {
+			u32 run;
+			u32 draw;
+		};
+
+		util::vector<SubmeshDraw> submesh_draws;	// indexed by submesh gpu id
+		util::vector<u32> item_draws;				// draw of every item
+		u32 current_run{ 0 };
+	};
+
+	[[nodiscard]] constexpr u32 index_count(const D3D12_INDEX_BUFFER_VIEW& ibv) {
+		return ibv.SizeInBytes >> (ibv.Format == DXGI_FORMAT_R16_UINT ? 1 : 2);
+	}
+
+	// instances points at the per object data indices of the instance_count instances of the draw.
+	// element_buffer can be 0 for position only submeshes, srv_indices for materials without textures.
+	[[nodiscard]] DrawArguments get_draw_arguments(D3D12_GPU_VIRTUAL_ADDRESS instances, u32 instance_count, D3D12_GPU_VIRTUAL_ADDRESS position_buffer,
+		D3D12_GPU_VIRTUAL_ADDRESS element_buffer, D3D12_GPU_VIRTUAL_ADDRESS srv_indices, const D3D12_INDEX_BUFFER_VIEW& ibv);
+
+	// Splits the draws into batches of equal states. The draws are expected to be sorted, so equal states are next to each other.
+	void build_batches(const u64* const states, u32 draw_count, util::vector<Batch>& batches);
+
+	// Merges the items that share submesh, full material id and sort key into instanced draws. The items are expected to be sorted,
+	// every draw takes the place of its first item, which draw_items gets the index of. instance_rows gets the rows of every draw
+	// next to each other, in item order, and instances the range of every draw in it.
+	void build_instances(const InstanceItem* const items, u32 item_count, InstanceState& state, util::vector<u32>& draw_items,
+		util::vector<InstanceRange>& instances, util::vector<id::id_type>& instance_rows);
+
+	// Checks the arguments and batches before they're handed to the GPU: the batches have to cover every draw once,
+	// in order, without mixing states, and every draw needs valid buffers.
+	[[nodiscard]] bool validate(const DrawArguments* const arguments, const u64* const states, u32 draw_count, const Batch* const batches, u32 batch_count);
+
+	// The command signature for the opaque root signature, only the per draw root parameters change between draws.
+	[[nodiscard]] ID3D12CommandSignature* create_command_signature(ID3D12RootSignature* root_signature);
+}
@@ -34,6 +34,7 @@ namespace lightning::graphics::direct3d12 {
 		pi.resources.add_submesh = content::submesh::add;
 		pi.resources.remove_submesh = content::submesh::remove;
 		pi.resources.add_texture = content::texture::add;
+		pi.resources.update_texture = content::texture::update;
 		pi.resources.remove_texture = content::texture::remove;
 		pi.resources.add_material = content::material::add;
 		pi.resources.remove_material = content::material::remove;
@@ -0,0 +1,38 @@
+#include "Direct3D12Recording.h"
+#include "Utilities/ThreadPool.h"
+#include <algorithm>
+
+namespace lightning::graphics::direct3d12::recording {
+
+	void partition(u32 draw_count, u32 max_list_count, u32 min_draws_per_list, util::vector<Range>& ranges) {
+		assert(max_list_count && min_draws_per_list);
+		ranges.clear();
+		if (!draw_count) return;
+
+		const u32 list_count{ std::max(1u, std::min(max_list_count, draw_count / min_draws_per_list)) };
+		const u32 draws_per_list{ draw_count / list_count };
+		const u32 remainder{ draw_count % list_count };
+		u32 first{ 0 };
+
+		// The first lists get one more draw when the draws don't divide evenly.
+		for (u32 i{ 0 }; i < list_count; ++i) {
+			const u32 count{ draws_per_list + (i < remainder ? 1 : 0) };
+			ranges.emplace_back(Range{ first, count });
+			first += count;
+		}
+
+		assert(first == draw_count);
+	}
+
+	void record(const Backend& backend, const Range* const ranges, u32 range_count) {
+		assert(backend.begin_list && backend.record && backend.end_list);
+		assert(ranges || !range_count);
+
+		util::thread_pool::parallel_for(range_count, [&](u32 i) {
+			void* const list{ backend.begin_list(backend.context, i) };
+			assert(list);
+			backend.record(backend.context, list, i, ranges[i]);
+			backend.end_list(backend.context, list);
+		});
+	}
+}
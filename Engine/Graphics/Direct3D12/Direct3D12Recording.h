@@ -0,0 +1,120 @@
+#pragma once
+#include "CommonHeaders.h"
+
+namespace lightning::graphics::direct3d12::recording {
+
+	struct Range {
+		u32 first;
+		u32 count;
+	};
+
+	// Records draws into command lists. The renderer records into the command lists of core, without a GPU
+	// (e.g. in tests) a null backend can just keep track of the calls. Every function is called from the job
+	// recording the list, never for the same list from two threads.
+	struct Backend {
+		// Returns the list_index-th list of the pass, ready for recording.
+		void* (*begin_list)(void* context, u32 list_index);
+		void (*record)(void* context, void* list, u32 list_index, Range range);
+		void (*end_list)(void* context, void* list);
+		void* context;
+	};
+
+	// Splits draw_count draws into at most max_list_count contiguous ranges in draw order.
+	// Fewer lists are used when they'd get less than min_draws_per_list draws.
+	void partition(u32 draw_count, u32 max_list_count, u32 min_draws_per_list, util::vector<Range>& ranges);
+
+	// Records range i into list i, on the thread pool. Returns when every list has been ended.
+	void record(const Backend& backend, const Range* const ranges, u32 range_count);
+
+	// The command lists for parallel recording of a command queue, and their submission order. The lists are shared by the
+	// frames, every frame has its own allocator for each list, so the lists can be reset as soon as the caller made sure
+	// the frame's earlier work is done on the GPU. Lists are submitted in the order they were handed out.
+	// Device objects go through Device (list_type, allocator_type, create_list(index), create_allocator(frame_index, index),
+	// reset(list, allocator), close(list), release_list(list&) and release_allocator(allocator&)), so this works without a GPU.
+	template<typename Device, u32 frame_count> class ListPool {
+		public:
+			using list_type = typename Device::list_type;
+			using allocator_type = typename Device::allocator_type;
+
+			ListPool() = default;
+			DISABLE_COPY_AND_MOVE(ListPool);
+
+			~ListPool() {
+				assert(_lists.empty());
+			}
+
+			// main_list has to be reset already, it's the current list until parallel recording begins.
+			void begin_frame(u32 frame_index, list_type main_list) {
+				assert(frame_index < frame_count && main_list);
+				_frame_index = frame_index;
+				_current_list = main_list;
+				_used_list_count = 0;
+				_submitted_lists.clear();
+			}
+
+			// Closes the current list and returns count lists for recording in parallel, followed by the new current list.
+			// The parallel lists are closed by whoever records them.
+			list_type const* begin_parallel_recording(Device& device, u32 count) {
+				assert(count && _current_list);
+				close_current_list(device);
+
+				const u32 first{ _used_list_count };
+				_used_list_count += count + 1;
+				util::vector<allocator_type>& allocators{ _allocators[_frame_index] };
+
+				for (u32 i{ first }; i < _used_list_count; ++i) {
+					if (i == _lists.size()) _lists.emplace_back(device.create_list(i));
+					if (i == allocators.size()) allocators.emplace_back(device.create_allocator(_frame_index, i));
+					device.reset(_lists[i], allocators[i]);
+				}
+
+				// The new current list is submitted once it's closed.
+				for (u32 i{ first }; i < _used_list_count - 1; ++i) {
+					_submitted_lists.emplace_back(_lists[i]);
+				}
+
+				_current_list = _lists[_used_list_count - 1];
+				return &_lists[first];
+			}
+
+			// Closes the current list, the submitted lists are ready for execution.
+			void end_frame(Device& device) {
+				assert(_current_list);
+				close_current_list(device);
+			}
+
+			void release(Device& device) {
+				for (auto& list : _lists) device.release_list(list);
+				_lists.clear();
+
+				for (u32 i{ 0 }; i < frame_count; ++i) {
+					for (auto& allocator : _allocators[i]) device.release_allocator(allocator);
+					_allocators[i].clear();
+				}
+
+				_submitted_lists.clear();
+				_current_list = list_type{};
+				_used_list_count = 0;
+			}
+
+			[[nodiscard]] constexpr list_type current_list() const { return _current_list; }
+			[[nodiscard]] constexpr const list_type* submitted_lists() const { return _submitted_lists.data(); }
+			[[nodiscard]] constexpr u32 submitted_count() const { return (u32)_submitted_lists.size(); }
+			[[nodiscard]] constexpr u32 list_count() const { return (u32)_lists.size(); }
+			[[nodiscard]] constexpr u32 allocator_count(u32 frame_index) const { return (u32)_allocators[frame_index].size(); }
+
+		private:
+			void close_current_list(Device& device) {
+				device.close(_current_list);
+				_submitted_lists.emplace_back(_current_list);
+				_current_list = list_type{};
+			}
+
+			util::vector<list_type> _lists;
+			util::vector<allocator_type> _allocators[frame_count];		// one for each list, in every frame
+			util::vector<list_type> _submitted_lists;
+			list_type _current_list{};
+			u32 _used_list_count{ 0 };
+			u32 _frame_index{ 0 };
+	};
+}
@@ -133,19 +133,15 @@ namespace lightning::graphics::direct3d12 {
 	}
 
 	u8* const ConstantBuffer::allocate(u32 size) {
-		std::lock_guard lock{ _mutex };
-
 		const u32 aligned_size{ (u32)d3dx::align_size_for_constant_buffer(size) };
-		assert(_cpu_offset + aligned_size <= _buffer.size());
+		u32 offset{ _cpu_offset.load(std::memory_order_relaxed) };
 
-		if (_cpu_offset + aligned_size <= _buffer.size()) {
-			u8* const address{ _cpu_address + _cpu_offset };
-			_cpu_offset += aligned_size;
-
-			return address;
-		}
+		do {
+			assert(offset + aligned_size <= _buffer.size());
+			if (offset + aligned_size > _buffer.size()) return nullptr;
+		} while (!_cpu_offset.compare_exchange_weak(offset, offset + aligned_size, std::memory_order_relaxed));
 
-		return nullptr;
+		return _cpu_address + offset;
 	}
 
 	#pragma endregion
@@ -121,7 +121,8 @@ namespace lightning::graphics::direct3d12 {
 				_cpu_offset = 0;
 			}
 
-			constexpr void clear() { _cpu_offset = 0; }
+			void clear() { _cpu_offset = 0; }
+			// Lock free, render preparation jobs allocate from it concurrently.
 			[[nodiscard]] u8* const allocate(u32 size);
 			template<typename T> [[nodiscard]] constexpr T* const allocate() { return (T* const)allocate(sizeof(T)); }
 			[[nodiscard]] constexpr ID3D12Resource* const buffer() const { return _buffer.buffer(); }
@@ -129,12 +130,11 @@ namespace lightning::graphics::direct3d12 {
 			[[nodiscard]] constexpr u32 size() const { return _buffer.size(); }
 			[[nodiscard]] constexpr u8* const cpu_address() const { return _cpu_address; }
 
-			template<typename T> [[nodiscard]] constexpr D3D12_GPU_VIRTUAL_ADDRESS gpu_address(T* const allocate) {
-				std::lock_guard lock{ _mutex };
+			template<typename T> [[nodiscard]] D3D12_GPU_VIRTUAL_ADDRESS gpu_address(T* const allocate) const {
 				assert(_cpu_address);
 				if (!_cpu_address) return {};
 				const u8* const address{ (const u8* const)allocate };
-				assert(address <= _cpu_address + _cpu_offset);
+				assert(address <= _cpu_address + _cpu_offset.load(std::memory_order_relaxed));
 				assert(address >= _cpu_address);
 				const u64 offset{ (u64)(address - _cpu_address) };
 				return _buffer.gpu_address() + offset;
@@ -152,8 +152,7 @@ namespace lightning::graphics::direct3d12 {
 		private:
 			D3D12Buffer _buffer{};
 			u8* _cpu_address{ nullptr };
-			u32 _cpu_offset{ 0 };
-			std::mutex _mutex;
+			std::atomic<u32> _cpu_offset{ 0 };
 	};
 
 	class UAVClearebleBuffer {
@@ -27,7 +27,6 @@ struct PerObjectData
 {
     float4x4 world;
     float4x4 inv_world;
-    float4x4 world_view_projection;
     float4 base_color;
     float3 emissive;
     float emissive_intensity;
@@ -37,6 +37,7 @@ namespace lightning::graphics {
 			id::id_type(*add_submesh)(const u8*&);
 			void(*remove_submesh)(id::id_type);
 			id::id_type(*add_texture)(const u8* const);
+			void(*update_texture)(id::id_type, const u8* const);
 			void(*remove_texture)(id::id_type);
 			id::id_type(*add_material)(MaterialInitInfo);
 			void(*remove_material)(id::id_type);
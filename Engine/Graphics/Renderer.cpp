@@ -315,6 +315,10 @@ namespace lightning::graphics {
 		return gfx.resources.add_texture(data);
 	}
 
+	void update_texture(id::id_type id, const u8* const data) {
+		gfx.resources.update_texture(id, data);
+	}
+
 	void remove_texture(id::id_type id) {
 		gfx.resources.remove_texture(id);
 	}
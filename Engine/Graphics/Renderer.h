@@ -17,10 +17,12 @@ namespace lightning::graphics {
 
 	struct FrameInfo {
 		id::id_type* render_item_ids{ nullptr };
-		f32* thresholds{ nullptr };
+		f32* thresholds{ nullptr };			// LOD thresholds per render item, calculated by the renderer when null
 		u64 light_set_key{ 0 };
 		f32 last_frame_time{ 16.7f };
 		f32 average_frame_time{ 16.7f };
+		f32 lod_bias{ 0.f };				// positive values select less detailed LODs sooner
+		f32 lod_hysteresis{ .1f };			// relative change needed before an automatic threshold is updated
 		u32 render_item_count{ 0 };
 		camera_id camera_id{ id::invalid_id };
 	};
@@ -251,6 +253,8 @@ namespace lightning::graphics {
 	void remove_submesh(id::id_type id);
 
 	id::id_type add_texture(const u8* const data);
+	// Replaces the resource of the texture. The id stays the same, so materials using it don't have to change.
+	void update_texture(id::id_type id, const u8* const data);
 	void remove_texture(id::id_type id);
 
 	void create_light_set(u64 light_set_key);
@@ -0,0 +1,118 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+namespace lightning::util::thread_pool {
+	namespace {
+
+		struct ParallelForState {
+			std::function<void(u32)> func;
+			u32 job_count;
+			std::atomic<u32> next{ 0 };
+			std::atomic<u32> done{ 0 };
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+
+		std::mutex queue_mutex;
+		std::condition_variable queue_condition;
+		std::deque<task> tasks;
+		util::vector<std::thread> workers;
+		bool stopping{ false };
+
+		void worker_loop() {
+			while (true) {
+				task work{};
+				{
+					std::unique_lock lock{ queue_mutex };
+					queue_condition.wait(lock, [] { return stopping || !tasks.empty(); });
+
+					if (tasks.empty()) break;
+
+					work = std::move(tasks.front());
+					tasks.pop_front();
+				}
+
+				work();
+			}
+		}
+
+		// The calling thread is expected to work as well, so leave one core for it.
+		void start_workers() {
+			if (!workers.empty()) return;
+
+			const u32 count{ std::max(std::thread::hardware_concurrency(), 2u) - 1 };
+			stopping = false;
+			workers.reserve(count);
+
+			for (u32 i{ 0 }; i < count; ++i) workers.emplace_back(worker_loop);
+		}
+
+		void run_jobs(ParallelForState& state) {
+			for (u32 job{ state.next++ }; job < state.job_count; job = state.next++) {
+				state.func(job);
+
+				if (++state.done == state.job_count) {
+					std::lock_guard lock{ state.mutex };
+					state.finished.notify_all();
+				}
+			}
+		}
+	}
+
+	void submit(task&& work) {
+		{
+			std::lock_guard lock{ queue_mutex };
+			start_workers();
+			tasks.emplace_back(std::move(work));
+		}
+
+		queue_condition.notify_one();
+	}
+
+	u32 worker_count() {
+		std::lock_guard lock{ queue_mutex };
+		start_workers();
+		return (u32)workers.size();
+	}
+
+	void parallel_for(u32 job_count, std::function<void(u32)> func) {
+		if (!job_count) return;
+
+		if (job_count == 1) {
+			func(0);
+			return;
+		}
+
+		// Helpers may only get to run after every job is done, so the state must outlive this call.
+		std::shared_ptr<ParallelForState> state{ std::make_shared<ParallelForState>() };
+		state->func = std::move(func);
+		state->job_count = job_count;
+
+		const u32 helper_count{ std::min(job_count - 1, worker_count()) };
+		for (u32 i{ 0 }; i < helper_count; ++i) submit([state]() { run_jobs(*state); });
+
+		run_jobs(*state);
+
+		std::unique_lock lock{ state->mutex };
+		state->finished.wait(lock, [&state]() { return state->done == state->job_count; });
+	}
+
+	void shutdown() {
+		{
+			std::lock_guard lock{ queue_mutex };
+			stopping = true;
+		}
+
+		queue_condition.notify_all();
+
+		for (auto& worker : workers) worker.join();
+
+		std::lock_guard lock{ queue_mutex };
+		workers.clear();
+		stopping = false;
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "CommonHeaders.h"
+#include <functional>
+
+namespace lightning::util::thread_pool {
+
+	using task = std::function<void()>;
+
+	void submit(task&& work);
+	[[nodiscard]] u32 worker_count();
+
+	// Runs func for every job in [0, job_count) and returns when all of them finished.
+	// The calling thread takes part, so it's safe to call from inside pool tasks.
+	void parallel_for(u32 job_count, std::function<void(u32)> func);
+
+	void shutdown();
+}
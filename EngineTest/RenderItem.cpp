@@ -80,10 +80,14 @@ namespace {
 
 		const char* shader_path{ "../../EngineTest/" };
 
-		std::wstring defines[]{ L"ELEMENTS_TYPE=1", L"ELEMENTS_TYPE=3" };
+		std::wstring defines[]{ L"ELEMENTS_TYPE=1", L"ELEMENTS_TYPE=3", L"ELEMENTS_TYPE=17", L"ELEMENTS_TYPE=19", L"ELEMENTS_TYPE=35", L"ELEMENTS_TYPE=51" };
 		util::vector<u32> keys;
 		keys.emplace_back(tools::elements::ElementsType::STATIC_NORMAL);
 		keys.emplace_back(tools::elements::ElementsType::STATIC_NORMAL_TEXTURE);
+		keys.emplace_back(tools::elements::ElementsType::STATIC_NORMAL | tools::elements::ElementsType::QUANTIZED_POSITION);
+		keys.emplace_back(tools::elements::ElementsType::STATIC_NORMAL_TEXTURE | tools::elements::ElementsType::QUANTIZED_POSITION);
+		keys.emplace_back(tools::elements::ElementsType::STATIC_NORMAL_TEXTURE_HALF_UV);
+		keys.emplace_back(tools::elements::ElementsType::STATIC_NORMAL_TEXTURE_HALF_UV | tools::elements::ElementsType::QUANTIZED_POSITION);
 
 		util::vector<std::wstring> extra_args{};
 		util::vector<std::unique_ptr<u8[]>> vertex_shaders;
@@ -2,16 +2,30 @@
 #include <thread>
 #include <chrono>
 #include <string>
+#include <iostream>
 
 #define TEST_ENTITY_COMPONENTS 0
 #define TEST_WINDOW 0
+#define TEST_TEXTURE_RESIDENCY 0
 #define TEST_RENDERER 1
+#define TEST_RECORDING 0
+#define TEST_INDIRECT 0
 
 class Test {
 	public:
 		virtual bool initialize() = 0;
 		virtual void run() = 0;
 		virtual void shutdown() = 0;
+
+	protected:
+		// Reports a failed condition, tests that check conditions pass when there are no errors after a run.
+		void check(bool condition, const char* message) {
+			if (condition) return;
+			std::cout << "FAILED: " << message << '\n';
+			++_errors;
+		}
+
+		unsigned int _errors{ 0 };
 };
 
 #if _WIN64
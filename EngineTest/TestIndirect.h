@@ -0,0 +1,224 @@
+#pragma once
+
+#include <iostream>
+#include <random>
+#include <algorithm>
+
+#include "Test.h"
+#include "..\Engine\Graphics\Direct3D12\Direct3D12Indirect.h"
+
+using namespace lightning;
+using namespace lightning::graphics::direct3d12;
+
+// Builds indirect draw arguments and batches for made up draws, the same way the gpass does, and validates them
+// without creating a device. Broken arguments and batches have to be rejected by the validation.
+// Instanced draws are built from made up sorted items and compared to the expected merges.
+class EngineTest : public Test {
+	private:
+		constexpr static u32 state_count{ 16 };
+		constexpr static D3D12_GPU_VIRTUAL_ADDRESS instances_base{ 0x10000000 };
+		constexpr static D3D12_GPU_VIRTUAL_ADDRESS geometry_base{ 0x20000000 };
+
+		util::vector<indirect::DrawArguments> _arguments;
+		util::vector<u64> _states;
+		util::vector<indirect::Batch> _batches;
+		util::vector<indirect::InstanceItem> _items;
+		indirect::InstanceState _instance_state;
+		util::vector<u32> _draw_items;
+		util::vector<indirect::InstanceRange> _instances;
+		util::vector<id::id_type> _instance_rows;
+		std::mt19937 _random{ 37 };
+
+		// Sorted draws, like they come out of the gpass sort. Every 4th draw has textures, draws have 1 to 3 instances.
+		void create_draws(u32 draw_count) {
+			_arguments.resize(draw_count);
+			_states.resize(draw_count);
+
+			std::uniform_int_distribution<u32> state{ 0, state_count - 1 };
+			for (u32 i{ 0 }; i < draw_count; ++i) _states[i] = state(_random);
+			std::sort(_states.begin(), _states.end());
+
+			for (u32 i{ 0 }; i < draw_count; ++i) {
+				D3D12_INDEX_BUFFER_VIEW ibv{};
+				ibv.BufferLocation = geometry_base + _states[i] * 0x10000;
+				ibv.Format = (i & 1) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+				ibv.SizeInBytes = 36 * ((i & 1) ? sizeof(u32) : sizeof(u16));
+
+				const D3D12_GPU_VIRTUAL_ADDRESS srv_indices{ (i & 3) ? 0 : geometry_base + 0x8000 + i * sizeof(u32) };
+				_arguments[i] = indirect::get_draw_arguments(instances_base + i * 3 * sizeof(u32), instance_count(i),
+					ibv.BufferLocation + 0x1000, ibv.BufferLocation + 0x2000, srv_indices, ibv);
+			}
+		}
+
+		[[nodiscard]] constexpr static u32 instance_count(u32 draw) { return draw % 3 + 1; }
+
+		[[nodiscard]] bool validate() const {
+			return indirect::validate(_arguments.data(), _states.data(), (u32)_arguments.size(), _batches.data(), (u32)_batches.size());
+		}
+
+		void test_batches(u32 draw_count) {
+			create_draws(draw_count);
+			indirect::build_batches(_states.data(), draw_count, _batches);
+
+			u32 state_changes{ 0 };
+			for (u32 i{ 1 }; i < draw_count; ++i) if (_states[i] != _states[i - 1]) ++state_changes;
+
+			check(_batches.size() == (draw_count ? state_changes + 1 : 0), "one batch for every state");
+			check(validate(), "valid draws were rejected");
+
+			for (u32 i{ 0 }; i < draw_count; ++i) {
+				check(_arguments[i].draw.IndexCountPerInstance == 36 && _arguments[i].draw.InstanceCount == instance_count(i), "wrong draw arguments");
+				check(_arguments[i].srv_indices != 0, "srv indices without an address");
+			}
+		}
+
+		// Every broken copy of valid draws has to fail the validation.
+		void test_rejection() {
+			create_draws(1000);
+			indirect::build_batches(_states.data(), 1000, _batches);
+			check(_batches.size() > 2, "too few batches for the rejection test");
+
+			auto expect_rejected = [this](const char* message, auto&& corrupt, auto&& restore) {
+				corrupt();
+				check(!validate(), message);
+				restore();
+				check(validate(), "restored draws were rejected");
+			};
+
+			indirect::DrawArguments& draw{ _arguments[500] };
+			const indirect::DrawArguments saved_draw{ draw };
+			const auto restore_draw = [&] { draw = saved_draw; };
+
+			expect_rejected("unaligned instances", [&] { draw.instances += 2; }, restore_draw);
+			expect_rejected("missing position buffer", [&] { draw.position_buffer = 0; }, restore_draw);
+			expect_rejected("missing srv indices", [&] { draw.srv_indices = 0; }, restore_draw);
+			expect_rejected("index count out of range", [&] { ++draw.draw.IndexCountPerInstance; }, restore_draw);
+			expect_rejected("no instances", [&] { draw.draw.InstanceCount = 0; }, restore_draw);
+			expect_rejected("wrong index format", [&] { draw.index_buffer_view.Format = DXGI_FORMAT_R8_UINT; }, restore_draw);
+
+			indirect::Batch& batch{ _batches[1] };
+			const indirect::Batch saved_batch{ batch };
+			const auto restore_batch = [&] { batch = saved_batch; };
+
+			expect_rejected("gap between batches", [&] { ++batch.first; --batch.count; }, restore_batch);
+			expect_rejected("empty batch", [&] { batch.count = 0; }, restore_batch);
+			expect_rejected("batch mixing states", [&] { ++batch.count; }, restore_batch);
+
+			const u64 saved_state{ _states[saved_batch.first] };
+			expect_rejected("batch that could be merged", [&] {
+				for (u32 i{ saved_batch.first }; i < saved_batch.first + saved_batch.count; ++i) _states[i] = _states[saved_batch.first - 1];
+			}, [&] {
+				for (u32 i{ saved_batch.first }; i < saved_batch.first + saved_batch.count; ++i) _states[i] = saved_state;
+			});
+		}
+
+		// Rows are the item indices, so the instance order shows the item order.
+		void add_item(u64 run_key, id::id_type submesh_id, id::id_type material_id, bool is_transparent = false) {
+			_items.emplace_back(indirect::InstanceItem{ run_key, submesh_id, material_id, (id::id_type)_items.size(), is_transparent });
+		}
+
+		void build_instances() {
+			indirect::build_instances(_items.data(), (u32)_items.size(), _instance_state, _draw_items, _instances, _instance_rows);
+
+			check(_draw_items.size() == _instances.size(), "draws without instances");
+			check(_instance_rows.size() == _items.size(), "items without instances");
+
+			u32 first{ 0 };
+			for (const indirect::InstanceRange& range : _instances) {
+				check(range.first == first && range.count, "instances of the draws aren't next to each other");
+				first += range.count;
+			}
+		}
+
+		// Draws, with the rows of their instances, in draw order.
+		[[nodiscard]] bool has_draws(std::initializer_list<std::initializer_list<id::id_type>> expected) const {
+			if (expected.size() != _instances.size()) return false;
+
+			u32 draw{ 0 };
+			for (const auto& rows : expected) {
+				const indirect::InstanceRange& range{ _instances[draw] };
+				if (rows.size() != range.count || _draw_items[draw] != *rows.begin()) return false;
+				if (!std::equal(rows.begin(), rows.end(), &_instance_rows[range.first])) return false;
+				++draw;
+			}
+
+			return true;
+		}
+
+		void test_instances() {
+			_items.clear();
+			build_instances();
+			check(has_draws({}), "instances without items");
+
+			// Same submesh and material in one run: one draw, instances front to back.
+			_items.clear();
+			add_item(1, 7, 3);
+			add_item(1, 8, 3);
+			add_item(1, 7, 3);
+			add_item(1, 7, 3);
+			build_instances();
+			check(has_draws({ { 0, 2, 3 }, { 1 } }), "items of a run weren't merged front to back");
+
+			// The same submesh and material in the next run is another draw.
+			_items.clear();
+			add_item(1, 7, 3);
+			add_item(2, 7, 3);
+			add_item(2, 7, 3);
+			build_instances();
+			check(has_draws({ { 0 }, { 1, 2 } }), "items of different runs were merged");
+
+			// Transparent items are drawn back to front, every one on its own.
+			_items.clear();
+			add_item(1, 7, 3, true);
+			add_item(1, 7, 3, true);
+			add_item(1, 7, 3);
+			build_instances();
+			check(has_draws({ { 0 }, { 1 }, { 2 } }), "transparent items were merged");
+
+			// Material ids that only differ above the bits in the sort key.
+			_items.clear();
+			add_item(1, 7, 0x00003);
+			add_item(1, 7, 0x00003);
+			add_item(1, 7, 0x10003);
+			add_item(1, 7, 0x10003);
+			build_instances();
+			check(has_draws({ { 0, 1 }, { 2, 3 } }), "different materials with the same low bits were merged");
+
+			// The submesh table is kept between frames, old entries must not merge items of a new frame.
+			_items.clear();
+			add_item(1, 7, 3);
+			build_instances();
+			build_instances();
+			check(has_draws({ { 0 } }), "items were merged with a draw of the last frame");
+		}
+
+		// Position only submeshes have no element buffer, their draws still have to be valid.
+		void test_position_only_draw() {
+			create_draws(10);
+			indirect::build_batches(_states.data(), 10, _batches);
+
+			indirect::DrawArguments& draw{ _arguments[5] };
+			draw = indirect::get_draw_arguments(draw.instances, draw.draw.InstanceCount, draw.position_buffer, 0, draw.srv_indices, draw.index_buffer_view);
+
+			check(draw.element_buffer != 0, "position only draw without an element buffer address");
+			check(validate(), "position only draw was rejected");
+		}
+
+	public:
+		bool initialize() override { return true; }
+
+		void run() override {
+			do {
+				_errors = 0;
+
+				for (const u32 draw_count : { 0u, 1u, 2u, 100u, 10000u }) test_batches(draw_count);
+				test_rejection();
+				test_position_only_draw();
+				test_instances();
+
+				std::cout << (_errors ? "Indirect draw test failed\n" : "Indirect draw test passed\n");
+			} while (getchar() != 'q');
+		}
+
+		void shutdown() override {}
+};
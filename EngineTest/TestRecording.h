@@ -0,0 +1,200 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+
+#include "Test.h"
+#include "..\Engine\Graphics\Direct3D12\Direct3D12Recording.h"
+#include "..\Engine\Utilities\ThreadPool.h"
+
+using namespace lightning;
+using namespace lightning::graphics::direct3d12;
+
+// Records frames with a null device, the same way the renderer does, but without a GPU: a main list, then the depth
+// prepass and the gpass, each recorded into lists of the list pool in parallel when they have enough draws.
+// Executing the submitted lists in order has to give every command of the frame exactly once, in recording order.
+class EngineTest : public Test {
+	private:
+		constexpr static u32 frame_buffer_count{ 3 };
+		constexpr static u32 pass_count{ 2 };
+		constexpr static u32 min_draws_per_list{ 512 };
+		constexpr static u32 pass_stride{ 1 << 24 };		// commands are pass * pass_stride + draw
+		constexpr static u32 end_of_pass{ pass_stride - 1 };
+		constexpr static u32 begin_of_frame{ ~0u };
+
+		struct NullAllocator {
+			u32 frame_index;
+		};
+
+		struct NullList {
+			util::vector<u32> commands;
+			NullAllocator* allocator{ nullptr };
+			std::thread::id thread;
+			u32 submitted_frame{ u32_invalid_id };
+			bool is_open{ false };
+		};
+
+		struct NullDevice {
+			using list_type = NullList*;
+			using allocator_type = NullAllocator*;
+
+			std::atomic<u32> errors{ 0 };
+			u32 frame_index{ 0 };
+
+			[[nodiscard]] list_type create_list(u32) { return new NullList{}; }
+			[[nodiscard]] allocator_type create_allocator(u32 index, u32) { return new NullAllocator{ index }; }
+
+			void reset(list_type list, allocator_type allocator) {
+				// An allocator of another frame could still be in use by the GPU.
+				if (list->is_open || allocator->frame_index != frame_index) ++errors;
+				list->commands.clear();
+				list->allocator = allocator;
+				list->is_open = true;
+			}
+
+			void close(list_type list) {
+				if (!list->is_open) ++errors;
+				list->is_open = false;
+			}
+
+			void release_list(list_type& list) { delete list; list = nullptr; }
+			void release_allocator(allocator_type& allocator) { delete allocator; allocator = nullptr; }
+		};
+
+		struct PassContext {
+			NullDevice* device;
+			NullList* const* lists;
+			u32 pass;
+		};
+
+		NullDevice _device;
+		recording::ListPool<NullDevice, frame_buffer_count> _pool;
+		NullList _main_lists[frame_buffer_count];
+		NullAllocator _main_allocators[frame_buffer_count]{};
+		util::vector<recording::Range> _ranges;
+		util::vector<u32> _executed;
+		u32 _frame{ 0 };
+
+		static void* begin_null_list(void* context, u32 list_index) {
+			const PassContext& c{ *(const PassContext*)context };
+			NullList* const list{ c.lists[list_index] };
+			if (!list->is_open) ++c.device->errors;
+			list->thread = std::this_thread::get_id();
+			return list;
+		}
+
+		static void record_null_list(void* context, void* list_ptr, u32, recording::Range range) {
+			const PassContext& c{ *(const PassContext*)context };
+			NullList& list{ *(NullList*)list_ptr };
+			if (!list.is_open || list.thread != std::this_thread::get_id()) ++c.device->errors;
+
+			for (u32 i{ 0 }; i < range.count; ++i) list.commands.emplace_back(c.pass * pass_stride + range.first + i);
+		}
+
+		// Like the gpass, the list is closed by the job that recorded it.
+		static void end_null_list(void* context, void* list_ptr) {
+			const PassContext& c{ *(const PassContext*)context };
+			NullList* const list{ (NullList*)list_ptr };
+			if (list->thread != std::this_thread::get_id()) ++c.device->errors;
+			c.device->close(list);
+		}
+
+		void record_pass(u32 pass, u32 draw_count, u32 list_count) {
+			recording::partition(draw_count, list_count, min_draws_per_list, _ranges);
+
+			const u32 range_count{ (u32)_ranges.size() };
+			check(range_count <= list_count, "too many ranges");
+			check(!draw_count || range_count, "draws without ranges");
+			check(draw_count >= range_count * min_draws_per_list || range_count <= 1, "ranges smaller than the minimum");
+
+			if (range_count < 2) {
+				for (u32 i{ 0 }; i < draw_count; ++i) _pool.current_list()->commands.emplace_back(pass * pass_stride + i);
+			}
+			else {
+				PassContext context{ &_device, _pool.begin_parallel_recording(_device, range_count), pass };
+				const recording::Backend backend{ begin_null_list, record_null_list, end_null_list, &context };
+				recording::record(backend, _ranges.data(), range_count);
+			}
+
+			_pool.current_list()->commands.emplace_back(pass * pass_stride + end_of_pass);
+		}
+
+		// Executing the submitted lists in order has to give the commands in the order they were recorded.
+		void execute_frame(u32 draw_count) {
+			_executed.clear();
+
+			for (u32 i{ 0 }; i < _pool.submitted_count(); ++i) {
+				NullList* const list{ _pool.submitted_lists()[i] };
+				check(!list->is_open, "submitted list wasn't closed");
+				check(list->submitted_frame != _frame, "list was submitted twice");
+				list->submitted_frame = _frame;
+
+				for (const u32 command : list->commands) _executed.emplace_back(command);
+			}
+
+			u32 next{ 0 };
+			bool is_in_order{ _executed.size() == 1 + pass_count * ((u64)draw_count + 1) && _executed[next++] == begin_of_frame };
+
+			for (u32 pass{ 0 }; pass < pass_count && is_in_order; ++pass) {
+				for (u32 i{ 0 }; i < draw_count && is_in_order; ++i) is_in_order = _executed[next++] == pass * pass_stride + i;
+				is_in_order = is_in_order && _executed[next++] == pass * pass_stride + end_of_pass;
+			}
+
+			check(is_in_order, "submitted commands are missing or out of order");
+		}
+
+		void record_frame(u32 draw_count, u32 list_count) {
+			const u32 frame_index{ _frame % frame_buffer_count };
+			_device.frame_index = frame_index;
+
+			NullList& main_list{ _main_lists[frame_index] };
+			_device.reset(&main_list, &_main_allocators[frame_index]);
+			_pool.begin_frame(frame_index, &main_list);
+			main_list.commands.emplace_back(begin_of_frame);
+
+			for (u32 pass{ 0 }; pass < pass_count; ++pass) record_pass(pass, draw_count, list_count);
+
+			_pool.end_frame(_device);
+			execute_frame(draw_count);
+
+			// Lists are shared by the frames, allocators aren't.
+			check(_pool.list_count() <= pass_count * (list_count + 1), "lists weren't reused");
+			check(_pool.allocator_count(frame_index) <= _pool.list_count(), "more allocators than lists");
+			++_frame;
+		}
+
+		void run_frames() {
+			constexpr u32 draw_counts[]{ 0, 1, 511, 512, 1023, 1024, 4097, 20000 };
+			constexpr u32 list_counts[]{ 1, 2, 3, 8 };
+
+			for (const u32 list_count : list_counts) {
+				for (const u32 draw_count : draw_counts) {
+					record_frame(draw_count, list_count);
+				}
+
+				_pool.release(_device);
+			}
+
+			check(_device.errors == 0, "null device saw a list used from the wrong thread, reset with another frame's allocator or closed twice");
+		}
+
+	public:
+		bool initialize() override {
+			for (u32 i{ 0 }; i < frame_buffer_count; ++i) _main_allocators[i].frame_index = i;
+			return true;
+		}
+
+		void run() override {
+			do {
+				_errors = 0;
+				_device.errors = 0;
+				run_frames();
+				std::cout << (_errors ? "Recording test failed\n" : "Recording test passed\n");
+			} while (getchar() != 'q');
+		}
+
+		void shutdown() override {
+			_pool.release(_device);
+			util::thread_pool::shutdown();
+		}
+};
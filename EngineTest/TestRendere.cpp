@@ -294,17 +294,13 @@
 		for (u32 i{ 0 }; i < _countof(_surfaces); ++i) {
 			if (_surfaces[i].surface.surface.is_valid()) {
 
-				f32 thresholds[4 + 12]{};
-
 				graphics::FrameInfo info{};
 				info.render_item_ids = render_item_id_cache.data();
 				info.render_item_count = 4 + 12;
-				info.thresholds = &thresholds[0];
 				info.light_set_key = light_set_key;
 				info.average_frame_time = dt;
 				info.camera_id = _surfaces[i].camera.get_id();
 
-				assert(_countof(thresholds) >= info.render_item_count);
 				_surfaces[i].surface.surface.render(info);
 			}
 		}
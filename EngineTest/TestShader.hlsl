@@ -7,6 +7,7 @@ struct VertexOut {
     float3 world_normal : NORMAL;
     float4 world_tangent : TANGENT;
     float2 uv : TEXTURE;
+    nointerpolation uint object_index : OBJECT_INDEX;
 };
 
 struct PixelOut {
@@ -39,17 +40,28 @@ struct Surface
 #define ELEMENTS_TYPE_SKELETAL_NORMAL_COLOR ELEMENTS_TYPE_SKELETAL_NORMAL | ELEMENTS_TYPE_STATIC_COLOR
 #define ELEMENTS_TYPE_SKELETAL_NORMAL_TEXTURE ELEMENTS_TYPE_SKELETAL | ELEMENTS_TYPE_STATIC_NORMAL_TEXTURE
 #define ELEMENTS_TYPE_SKELETAL_NORMAL_TEXTURE_COLOR ELEMENTS_TYPE_SKELETAL_NORMAL_TEXTURE | ELEMENTS_TYPE_STATIC_COLOR
+#define ELEMENTS_TYPE_QUANTIZED_POSITION 0x10
+#define ELEMENTS_TYPE_HALF_UV 0x20
+#define ELEMENTS_TYPE_STATIC_NORMAL_TEXTURE_HALF_UV (ELEMENTS_TYPE_STATIC_NORMAL_TEXTURE | ELEMENTS_TYPE_HALF_UV)
+
+// Vertex element layout without the position modifier bit
+#define ELEMENTS_LAYOUT (ELEMENTS_TYPE & ~ELEMENTS_TYPE_QUANTIZED_POSITION)
 
 struct VertexElement
 {
-    #if ELEMENTS_TYPE == ELEMENTS_TYPE_STATIC_NORMAL
+    #if ELEMENTS_LAYOUT == ELEMENTS_TYPE_STATIC_NORMAL
     uint color_t_sign;
     uint16_t2 normal;
-    #elif ELEMENTS_TYPE == ELEMENTS_TYPE_STATIC_NORMAL_TEXTURE
+    #elif ELEMENTS_LAYOUT == ELEMENTS_TYPE_STATIC_NORMAL_TEXTURE
     uint color_t_sign;
     uint16_t2 normal;
     uint16_t2 tangent;
     float2 uv;
+    #elif ELEMENTS_LAYOUT == ELEMENTS_TYPE_STATIC_NORMAL_TEXTURE_HALF_UV
+    uint color_t_sign;
+    uint16_t2 normal;
+    uint16_t2 tangent;
+    uint16_t2 uv;
     #elif ELEMENTS_TYPE == ELEMENTS_TYPE_STATIC_COLOR
     #elif ELEMENTS_TYPE == ELEMENTS_TYPE_SKELETAL
     #elif ELEMENTS_TYPE == ELEMENTS_TYPE_SKELETAL_NORMAL
@@ -62,40 +74,63 @@ struct VertexElement
 const static float inv_intervals = 2.f / ((1 << 16) - 1);
 
 ConstantBuffer<GlobalShaderData> global_data : register(b0, space0);
-ConstantBuffer<PerObjectData> per_object_buffer : register(b1, space0);
 
+#if ELEMENTS_TYPE & ELEMENTS_TYPE_QUANTIZED_POSITION
+StructuredBuffer<uint2> vertex_positions : register(t0, space0);
+#else
 StructuredBuffer<float3> vertex_positions : register(t0, space0);
+#endif
 StructuredBuffer<VertexElement> elements : register(t1, space0);
 StructuredBuffer<uint> srv_indicies : register(t2, space0);
 StructuredBuffer<DirectionalLightParameters> directional_lights : register(t3, space0);
 StructuredBuffer<LightParameters> cullable_lights : register(t4, space0);
 StructuredBuffer<uint2> light_grid : register(t5, space0);
 StructuredBuffer<uint> light_index_list : register(t6, space0);
+StructuredBuffer<PerObjectData> per_object_buffer : register(t7, space0);
+StructuredBuffer<uint> instances : register(t8, space0);     // per_object_buffer index of every instance of the draw
 
 SamplerState point_sampler : register(s0, space0);
 SamplerState linear_sampler : register(s1, space0);
 SamplerState anisotropic_sampler : register(s2, space0);
 
-VertexOut test_shader_vs(in uint vertex_idx : SV_VertexID) {
+float3 load_position(uint vertex_idx)
+{
+#if ELEMENTS_TYPE & ELEMENTS_TYPE_QUANTIZED_POSITION
+    // The first 4 entries hold the decode range: min.xy | min.z, pad | extent.xy | extent.z, pad
+    float3 p_min = asfloat(uint3(vertex_positions[0], vertex_positions[1].x));
+    float3 p_extent = asfloat(uint3(vertex_positions[2], vertex_positions[3].x));
+    uint2 q = vertex_positions[vertex_idx + 4];
+    float3 unit_position = float3(q.x & 0xffff, q.x >> 16, q.y & 0xffff) * (1.f / ((1 << 16) - 1));
+    return p_min + unit_position * p_extent;
+#else
+    return vertex_positions[vertex_idx];
+#endif
+}
+
+VertexOut test_shader_vs(in uint vertex_idx : SV_VertexID, in uint instance_idx : SV_InstanceID) {
     VertexOut vs_out;
     
-    float4 position = float4(vertex_positions[vertex_idx], 1.f);
-    float4 world_position = mul(per_object_buffer.world, position);
+    const uint object_index = instances[instance_idx];
+    const PerObjectData object_data = per_object_buffer[object_index];
+    vs_out.object_index = object_index;
+    
+    float4 position = float4(load_position(vertex_idx), 1.f);
+    float4 world_position = mul(object_data.world, position);
     
-    #if ELEMENTS_TYPE == ELEMENTS_TYPE_STATIC_NORMAL
+    #if ELEMENTS_LAYOUT == ELEMENTS_TYPE_STATIC_NORMAL
     VertexElement element = elements[vertex_idx];
     float2 n_xy = element.normal * inv_intervals - 1.f;
     uint signs = element.color_t_sign >> 24;
     float n_sign = float((signs & 0x04) >> 1) - 1.f;
     float3 normal = float3(n_xy, sqrt(saturate(1.f - dot(n_xy, n_xy))) * n_sign);
     
-    vs_out.homogeneous_position = mul(per_object_buffer.world_view_projection, position);
+    vs_out.homogeneous_position = mul(global_data.view_projection, world_position);
     vs_out.world_position = world_position.xyz;
-    vs_out.world_normal = mul(float4(normal, 0.f), per_object_buffer.inv_world).xyz;
+    vs_out.world_normal = mul(float4(normal, 0.f), object_data.inv_world).xyz;
     vs_out.world_tangent = 0.f;
     vs_out.uv = 0.f;
 
-    #elif ELEMENTS_TYPE == ELEMENTS_TYPE_STATIC_NORMAL_TEXTURE
+    #elif ELEMENTS_LAYOUT == ELEMENTS_TYPE_STATIC_NORMAL_TEXTURE || ELEMENTS_LAYOUT == ELEMENTS_TYPE_STATIC_NORMAL_TEXTURE_HALF_UV
     VertexElement element = elements[vertex_idx];
     uint signs = element.color_t_sign >> 24;
     float n_sign = float((signs & 0x04) >> 1) - 1.f;
@@ -109,15 +144,19 @@ VertexOut test_shader_vs(in uint vertex_idx : SV_VertexID) {
     float3 tangent = float3(t_xy, sqrt(saturate(1.f - dot(t_xy, t_xy))) * t_sign);
     tangent = tangent - normal * dot(normal, tangent);
     
-    vs_out.homogeneous_position = mul(per_object_buffer.world_view_projection, position);
+    vs_out.homogeneous_position = mul(global_data.view_projection, world_position);
     vs_out.world_position = world_position.xyz;
-    vs_out.world_normal = normalize(mul(normal, (float3x3)per_object_buffer.inv_world));
-    vs_out.world_tangent = float4(normalize(mul(tangent, (float3x3)per_object_buffer.inv_world)), h_sign);
+    vs_out.world_normal = normalize(mul(normal, (float3x3)object_data.inv_world));
+    vs_out.world_tangent = float4(normalize(mul(tangent, (float3x3)object_data.inv_world)), h_sign);
+    #if ELEMENTS_LAYOUT == ELEMENTS_TYPE_STATIC_NORMAL_TEXTURE_HALF_UV
+    vs_out.uv = f16tof32(uint2(element.uv));
+    #else
     vs_out.uv = element.uv;
+    #endif
     
     #else
     #undef ELEMENTS_TYPE
-    vs_out.homogeneous_position = mul(per_object_buffer.world_view_projection, position);
+    vs_out.homogeneous_position = mul(global_data.view_projection, world_position);
     vs_out.world_position = world_position.xyz;
     vs_out.world_normal = 0.f;
     vs_out.world_tangent = 0.f;
@@ -253,14 +292,15 @@ float3 spotlight(Surface s, float3 world_position, LightParameters light)
 Surface get_surface(VertexOut ps_in, float3 v)
 {   
     Surface s;
+    const PerObjectData object_data = per_object_buffer[ps_in.object_index];
     
-    s.base_color = per_object_buffer.base_color.rgb;
-    s.metallic = per_object_buffer.metallic;
+    s.base_color = object_data.base_color.rgb;
+    s.metallic = object_data.metallic;
     s.normal = normalize(ps_in.world_normal);
-    s.perceptual_roughness = max(per_object_buffer.roughness, .045f);
-    s.emissive_color = per_object_buffer.emissive;
-    s.emissive_intensity = per_object_buffer.emissive_intensity;
-    s.ambient_occlusion = per_object_buffer.ambient_occlusion;
+    s.perceptual_roughness = max(object_data.roughness, .045f);
+    s.emissive_color = object_data.emissive;
+    s.emissive_intensity = object_data.emissive_intensity;
+    s.ambient_occlusion = object_data.ambient_occlusion;
     
     #if TEXTURED_MTL
     float2 uv = ps_in.uv;
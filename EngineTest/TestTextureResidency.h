@@ -0,0 +1,234 @@
+#pragma once
+
+#include <iostream>
+#include <unordered_map>
+
+#include "Test.h"
+#include "..\Engine\Content\ContentToEngine.h"
+#include "..\Engine\Content\TextureResidency.h"
+
+using namespace lightning;
+
+// Runs the residency policy without a renderer. The null backend only keeps track of
+// the size of the textures it was asked to create.
+class EngineTest : public Test {
+	private:
+		constexpr static u32 texture_count{ 64 };
+		constexpr static u32 texture_size{ 2048 };
+		constexpr static u32 block_size{ 16 };
+
+		static std::unordered_map<id::id_type, u64> gpu_textures;
+		static id::id_type next_gpu_id;
+
+		util::vector<u8> _container;
+		util::vector<id::id_type> _ids;
+		util::vector<id::id_type> _gpu_ids;
+		util::vector<f32> _screen_sizes;
+
+		static id::id_type create_null_texture(const u8* const container) {
+			const content::TextureContainerHeader& header{ *(const content::TextureContainerHeader* const)container };
+			const id::id_type id{ next_gpu_id++ };
+			gpu_textures[id] = content::get_texture_load_size(container, 0) - header.data_offset;
+			return id;
+		}
+
+		static void update_null_texture(id::id_type id, const u8* const container) {
+			const content::TextureContainerHeader& header{ *(const content::TextureContainerHeader* const)container };
+			assert(gpu_textures.count(id));
+			gpu_textures[id] = content::get_texture_load_size(container, 0) - header.data_offset;
+		}
+
+		static void remove_null_texture(id::id_type id) {
+			assert(gpu_textures.count(id));
+			gpu_textures.erase(id);
+		}
+
+		static u64 null_backend_size() {
+			u64 size{ 0 };
+			for (const auto& [id, texture_bytes] : gpu_textures) size += texture_bytes;
+			return size;
+		}
+
+		// Block compressed 2D texture with a full mip chain and zeroed pixels.
+		void create_container() {
+			using namespace lightning::content;
+			using header_type = TextureContainerHeader;
+
+			u32 mip_levels{ 1 };
+			while ((texture_size >> (mip_levels - 1)) > 1) ++mip_levels;
+
+			const u64 data_offset{ math::align_size_up<header_type::placement_alignment>(sizeof(header_type) + sizeof(TextureSubresource) * mip_levels) };
+			util::vector<TextureSubresource> subresources(mip_levels);
+			u64 offset{ data_offset };
+
+			for (u32 mip{ mip_levels }; mip-- > 0;) {
+				const u32 size{ std::max(texture_size >> mip, 1u) };
+				const u32 blocks{ std::max((size + 3) >> 2, 1u) };
+				TextureSubresource& subresource{ subresources[mip] };
+				subresource.offset = offset;
+				subresource.width = size;
+				subresource.height = size;
+				subresource.depth = 1;
+				subresource.row_count = blocks;
+				subresource.row_pitch = (u32)math::align_size_up<header_type::row_pitch_alignment>(blocks * block_size);
+				subresource.slice_pitch = subresource.row_pitch * blocks;
+				offset = math::align_size_up<header_type::placement_alignment>(offset + subresource.slice_pitch);
+			}
+
+			_container.resize(offset);
+			memset(_container.data(), 0, offset);
+
+			header_type& header{ *(header_type*)_container.data() };
+			header.version = header_type::current_version;
+			header.width = texture_size;
+			header.height = texture_size;
+			header.array_size = 1;
+			header.mip_levels = mip_levels;
+			header.format = 98;		// DXGI_FORMAT_BC7_UNORM
+			header.subresource_count = mip_levels;
+			header.data_offset = data_offset;
+			header.data_size = offset - data_offset;
+			memcpy(_container.data() + sizeof(header_type), subresources.data(), sizeof(TextureSubresource) * mip_levels);
+		}
+
+		void print_stats(const char* step) {
+			const content::texture_residency::Stats stats{ content::texture_residency::get_stats() };
+			std::cout << step << ": resident " << (stats.resident_size >> 20) << "MB / " << (stats.budget >> 20) << "MB, requested " << (stats.requested_size >> 20)
+				<< "MB, loads " << stats.loads << ", evictions " << stats.evictions << ", over budget " << stats.over_budget_count << '\n';
+		}
+
+		void run_frames(u32 frame_count) {
+			for (u32 i{ 0 }; i < frame_count; ++i) {
+				content::texture_residency::request_screen_size(_ids.data(), _screen_sizes.data(), (u32)_ids.size());
+				content::texture_residency::update();
+
+				const content::texture_residency::Stats stats{ content::texture_residency::get_stats() };
+				check(stats.resident_size <= stats.budget, "resident size is over budget");
+				check(stats.resident_size == null_backend_size(), "resident size doesn't match the backend");
+				check(gpu_textures.size() == texture_count, "backend textures were created or removed by a mip change");
+			}
+
+			for (u32 i{ 0 }; i < texture_count; ++i) {
+				check(content::texture_residency::gpu_id(_ids[i]) == _gpu_ids[i], "gpu id changed, materials would use a stale texture");
+			}
+		}
+
+		void test_budget() {
+			for (u32 i{ 0 }; i < texture_count; ++i) _screen_sizes[i] = (f32)texture_size;
+			run_frames(8);
+			print_stats("Everything close");
+			check(content::texture_residency::get_stats().over_budget_count > 0, "budget should limit the resident mips");
+
+			for (u32 i{ 0 }; i < texture_count; ++i) _screen_sizes[i] = i < 8 ? (f32)texture_size : 64.f;
+			run_frames(content::texture_residency::Settings{}.eviction_delay + 8);
+			print_stats("8 close, rest far");
+
+			for (u32 i{ 0 }; i < 8; ++i) check(content::texture_residency::resident_mip(_ids[i]) == 0, "close textures should be fully resident");
+		}
+
+		void test_hysteresis() {
+			u32 evictions{ 0 };
+
+			for (u32 frame{ 0 }; frame < 20; ++frame) {
+				_screen_sizes[0] = frame & 1 ? (f32)texture_size : (f32)(texture_size >> 2);
+				run_frames(1);
+				evictions += content::texture_residency::get_stats().evictions;
+			}
+
+			print_stats("Flickering request");
+			check(evictions == 0, "alternating requests shouldn't evict mips");
+		}
+
+		void test_eviction() {
+			for (u32 i{ 0 }; i < texture_count; ++i) _screen_sizes[i] = 0.f;
+			run_frames(content::texture_residency::Settings{}.eviction_delay + 1);
+			print_stats("Nothing visible");
+
+			for (u32 i{ 0 }; i < texture_count; ++i) check(content::texture_residency::resident_mip(_ids[i]) != 0, "unused textures should be trimmed");
+		}
+
+		// A version 0 RGBA8 texture has to come out of the conversion with the same pixels, placed like the importer does.
+		void test_legacy_texture() {
+			using namespace lightning::content;
+			constexpr u32 size{ 8 };
+			constexpr u32 mip_levels{ 4 };
+			util::vector<u8> legacy;
+
+			auto write_u32 = [&legacy](u32 value) {
+				for (u32 i{ 0 }; i < sizeof(u32); ++i) legacy.emplace_back((u8)(value >> (i * 8)));
+			};
+
+			for (const u32 value : { size, size, 1u, 0u, mip_levels, 28u }) write_u32(value);		// DXGI_FORMAT_R8G8B8A8_UNORM
+
+			for (u32 mip{ 0 }; mip < mip_levels; ++mip) {
+				const u32 mip_size{ size >> mip };
+				write_u32(mip_size * 4);
+				write_u32(mip_size * mip_size * 4);
+				for (u32 i{ 0 }; i < mip_size * mip_size * 4; ++i) legacy.emplace_back((u8)(mip * 64 + i));
+			}
+
+			check(!is_texture_container(legacy.data()), "version 0 texture was taken for a container");
+
+			util::vector<u8> container;
+			convert_legacy_texture(legacy.data(), container);
+			check(is_texture_container(container.data()), "converted texture isn't a container");
+
+			const TextureContainerHeader& header{ *(const TextureContainerHeader* const)container.data() };
+			check(header.width == size && header.mip_levels == mip_levels && header.subresource_count == mip_levels, "converted header doesn't match");
+			check(get_texture_load_size(container.data(), 0) == container.size(), "converted data isn't placed smallest mip first");
+
+			const TextureSubresource* const subresources{ get_texture_subresources(container.data()) };
+
+			for (u32 mip{ 0 }; mip < mip_levels; ++mip) {
+				const TextureSubresource& subresource{ subresources[mip] };
+				const u32 mip_size{ size >> mip };
+				check(subresource.width == mip_size && subresource.row_count == mip_size, "converted subresource size doesn't match");
+				check(subresource.row_pitch % TextureContainerHeader::row_pitch_alignment == 0, "converted row pitch isn't aligned");
+				check(subresource.offset % TextureContainerHeader::placement_alignment == 0, "converted subresource isn't aligned");
+
+				for (u32 row{ 0 }; row < mip_size; ++row) {
+					const u8* const pixels{ container.data() + subresource.offset + (u64)subresource.row_pitch * row };
+					for (u32 i{ 0 }; i < mip_size * 4; ++i) check(pixels[i] == (u8)(mip * 64 + row * mip_size * 4 + i), "converted pixels don't match");
+				}
+			}
+		}
+
+	public:
+		bool initialize() override {
+			content::texture_residency::Settings settings{};
+			settings.budget = 64ull * 1024 * 1024;
+			const content::texture_residency::Backend backend{ create_null_texture, update_null_texture, remove_null_texture };
+			content::texture_residency::initialize(settings, &backend);
+
+			create_container();
+
+			for (u32 i{ 0 }; i < texture_count; ++i) {
+				_ids.emplace_back(content::texture_residency::add(_container.data()));
+				_gpu_ids.emplace_back(content::texture_residency::gpu_id(_ids.back()));
+			}
+
+			_screen_sizes.resize(texture_count, 0.f);
+
+			return true;
+		}
+
+		void run() override {
+			do {
+				_errors = 0;
+				test_budget();
+				test_hysteresis();
+				test_eviction();
+				test_legacy_texture();
+				std::cout << (_errors ? "Texture residency test failed\n" : "Texture residency test passed\n");
+			} while (getchar() != 'q');
+		}
+
+		void shutdown() override {
+			for (id::id_type id : _ids) content::texture_residency::remove(id);
+			content::texture_residency::shutdown();
+			assert(gpu_textures.empty());
+		}
+};
+
+std::unordered_map<id::id_type, u64> EngineTest::gpu_textures{};
+id::id_type EngineTest::next_gpu_id{ 0 };
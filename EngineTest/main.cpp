@@ -6,8 +6,14 @@
 #include "TestEntityComponents.h"
 #elif TEST_WINDOW
 #include "TestWindow.h"
+#elif TEST_TEXTURE_RESIDENCY
+#include "TestTextureResidency.h"
 #elif TEST_RENDERER
 #include "TestRenderer.h"
+#elif TEST_RECORDING
+#include "TestRecording.h"
+#elif TEST_INDIRECT
+#include "TestIndirect.h"
 #else
 #error One of the tests need to be enabled
 #endif